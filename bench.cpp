@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mpz.h"
+#include "mpz_io.h"
+#include "mpz_mul.h"
+#include "mpz_ntt.h"
+#include "mpz_random.h"
+#include "mpz_serial.h"
+#include "mpz_special.h"
+#include "mpz_stats.h"
+
+
+using namespace std;
+
+
+
+//Benchmark suite
+//
+//  mpz_bench [--filter s] [--max-bits n] [--min-time s] [--json out.json]
+//            [--baseline base.json] [--tolerance 0.1]
+//
+//Every case runs over operand sizes from one limb up to 10^7 bits (capped
+//per case where a single operation would take seconds). Each measurement
+//repeats the operation until min-time has passed, the best of three runs
+//is reported as ns/op together with GMP allocations per operation (n/a
+//without MPZ_INSTRUMENT, null in the JSON).
+//--json writes the results, --baseline compares against such a file and
+//flags everything slower by more than the tolerance or allocating more.
+//The exit code is 1 if anything regressed.
+
+
+
+//GMP allocations & reallocations since the counters were installed, all
+//zero without MPZ_INSTRUMENT
+static unsigned long allocations() {
+    const MpzAllocSnapshot s = MpzAllocStats::snapshot();
+    return s.allocations + s.reallocations;
+}
+
+static const double notCounted = nan("");
+
+static string allocs_text(const double allocsPerOp) {
+    if(isnan(allocsPerOp)) {
+        return "n/a";
+    }
+    ostringstream os;
+    os << fixed << setprecision(2) << allocsPerOp;
+    return os.str();
+}
+
+
+
+//Cases
+//setup(bits) prepares the operands and returns the operation to time,
+//results go into the captured state so nothing is optimised away
+using Op = function<void()>;
+
+struct Case {
+    string name;
+    unsigned long maxBits;
+    function<Op(unsigned long)> setup;
+    vector<unsigned long> sizes = {}; //instead of the default sweep
+};
+
+static const vector<unsigned long> defaultSizes{64, 256, 1'024, 4'096, 16'384, 65'536, 262'144, 1'048'576,
+        4'194'304, 10'000'000};
+
+static MpzRandom rng{0x6d707a62656e6368};
+static unsigned long sink = 0;
+
+//exactly bits bits
+static Mpz operand(const unsigned long bits) {
+    return rng.bits(bits - 1) + (Mpz{1ul} << (bits - 1));
+}
+
+static Op unary(const unsigned long bits, function<Mpz(const Mpz&)> f) {
+    return [a=operand(bits), r=Mpz{}, f=std::move(f)]() mutable {
+        r = f(a);
+    };
+}
+
+static Op binary(const unsigned long bits, function<Mpz(const Mpz&, const Mpz&)> f) {
+    return [a=operand(bits), b=operand(bits), r=Mpz{}, f=std::move(f)]() mutable {
+        r = f(a, b);
+    };
+}
+
+//mpz_mul without multiply()'s routing
+static Mpz gmp_mul(const Mpz& a, const Mpz& b) {
+    Mpz r;
+    mpz_mul(r.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+    return r;
+}
+
+//around the crossover, on both sides of powers of two where the
+//transform is full or just over half empty
+static const vector<unsigned long> nttSizes{16'384, 65'536, 131'072, 131'136, 262'144, 1'048'576, 1'048'640,
+        4'194'304, 10'000'000};
+
+static vector<Case> cases() {
+    constexpr unsigned long k = 0x9e3779b97f4a7c15;
+    const unsigned long all = defaultSizes.back();
+    return {
+        //operators
+        {"add", all, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return a + b; }); }},
+        {"sub", all, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return a - b; }); }},
+        {"add_ui", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return a + k; }); }},
+        {"mul", all, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return a * b; }); }},
+        {"sqr", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return a * a; }); }},
+        {"parallel_mul", all, [](const unsigned long n) {
+            return binary(n, [](const Mpz& a, const Mpz& b) { return parallel_mul(a, b); });
+        }, {262'144, 1'048'576, 4'194'304, 10'000'000}},
+        {"parallel_sqr", all, [](const unsigned long n) {
+            return unary(n, [](const Mpz& a) { return parallel_mul(a, a); });
+        }, {262'144, 1'048'576, 4'194'304, 10'000'000}},
+        //NTT (best kernel of the CPU) against plain mpz_mul
+        {"gmp_mul", all, [](const unsigned long n) {
+            return binary(n, [](const Mpz& a, const Mpz& b) { return gmp_mul(a, b); });
+        }, nttSizes},
+        {"gmp_sqr", all, [](const unsigned long n) {
+            return unary(n, [](const Mpz& a) { return gmp_mul(a, a); });
+        }, nttSizes},
+        {"ntt_mul", all, [](const unsigned long n) {
+            return binary(n, [](const Mpz& a, const Mpz& b) { return ntt_mul(a, b); });
+        }, nttSizes},
+        {"ntt_sqr", all, [](const unsigned long n) {
+            return unary(n, [](const Mpz& a) { return ntt_mul(a, a); });
+        }, nttSizes},
+        {"mul_ui", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return a * k; }); }},
+        {"div", all, [](const unsigned long n) {
+            return [a=operand(2*n), b=operand(n), r=Mpz{}]() mutable { r = a / b; };
+        }},
+        {"mod", all, [](const unsigned long n) {
+            return [a=operand(2*n), b=operand(n), r=Mpz{}]() mutable { r = a % b; };
+        }},
+        {"div_ui", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return a / k; }); }},
+        {"mod_ui", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return a % k; }); }},
+        {"shl", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return a << 17; }); }},
+        {"shr", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return a >> 17; }); }},
+        {"and", all, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return a & b; }); }},
+        {"or", all, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return a | b; }); }},
+        {"xor", all, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return a ^ b; }); }},
+        {"neg", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return -a; }); }},
+        {"abs", all, [](const unsigned long n) {
+            return [a=-operand(n), r=Mpz{}]() mutable { r = abs(a); };
+        }},
+        {"cmp", all, [](const unsigned long n) {
+            //equal up to the lowest limb, so the whole operands are compared
+            const Mpz a = operand(n);
+            return [a, b=a+1ul]() { sink += (a <=> b) < 0; };
+        }},
+        {"addmul", all, [](const unsigned long n) {
+            return [a=operand(n), b=operand(n), r=Mpz{}]() mutable { r.addmul(a, b); };
+        }},
+        {"add_inplace", all, [](const unsigned long n) {
+            return [a=operand(n), r=operand(n)]() mutable { r += a; };
+        }},
+        {"mul_rvalue", all, [](const unsigned long n) {
+            return [a=operand(n), b=operand(n), r=Mpz{}]() mutable { r = Mpz{a} * b; };
+        }},
+
+        //functions
+        {"pow", all, [](const unsigned long n) {
+            return [e=static_cast<unsigned long>(n / log2(3.0)), r=Mpz{}]() mutable { r = pow(Mpz{3ul}, e); };
+        }},
+        {"powm", 16'384, [](const unsigned long n) {
+            return [b=operand(n), e=operand(n), m=operand(n) + 1ul, r=Mpz{}]() mutable { r = powm(b, e, m); };
+        }},
+        {"sqrt", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return sqrt(a); }); }},
+        {"root3", all, [](const unsigned long n) { return unary(n, [](const Mpz& a) { return root(a, 3); }); }},
+        {"gcd", 1'048'576, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return gcd(a, b); }); }},
+        {"lcm", 1'048'576, [](const unsigned long n) { return binary(n, [](const Mpz& a, const Mpz& b) { return lcm(a, b); }); }},
+        {"is_probable_prime", 1'024, [](const unsigned long n) {
+            Mpz p = operand(n);
+            mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+            return [p=std::move(p)]() { sink += p.is_probable_prime(); };
+        }},
+        {"fac", all, [](const unsigned long n) {
+            //smallest m with m! of about n bits
+            unsigned long m = 1;
+            for(double bits=0; bits<n; bits+=log2(static_cast<double>(++m))) {}
+            return [m, r=Mpz{}]() mutable { r = fac(m); };
+        }},
+        {"bin", all, [](const unsigned long n) {
+            return [m=n/2, r=Mpz{}]() mutable { r = bin(2*m, m); };
+        }},
+        {"fib", all, [](const unsigned long n) {
+            return [m=static_cast<unsigned long>(n / 0.6942419136), r=Mpz{}]() mutable { r = fib(m); };
+        }},
+        {"parallel_fac", all, [](const unsigned long n) {
+            unsigned long m = 1;
+            for(double bits=0; bits<n; bits+=log2(static_cast<double>(++m))) {}
+            return [m, r=Mpz{}]() mutable { r = parallel_fac(m); };
+        }, {262'144, 1'048'576, 4'194'304, 10'000'000}},
+        {"parallel_bin", all, [](const unsigned long n) {
+            return [m=n/2, r=Mpz{}]() mutable { r = parallel_bin(2*m, m); };
+        }, {262'144, 1'048'576, 4'194'304, 10'000'000}},
+        {"parallel_fib", all, [](const unsigned long n) {
+            return [m=static_cast<unsigned long>(n / 0.6942419136), r=Mpz{}]() mutable { r = parallel_fib(m); };
+        }, {262'144, 1'048'576, 4'194'304, 10'000'000}},
+        {"factorise", all, [](const unsigned long n) {
+            Mpz p = operand(n/2), q = operand(n - n/2);
+            mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+            mpz_nextprime(q.get_mpz_t(), q.get_mpz_t());
+            return [pq=p*q]() { sink += factorise(pq).size(); };
+        }, {32, 48, 64, 80}},
+
+        //conversions
+        {"to_string", all, [](const unsigned long n) {
+            return [a=operand(n)]() { sink += a.to_string().size(); };
+        }},
+        {"to_string_16", all, [](const unsigned long n) {
+            return [a=operand(n)]() { sink += a.to_string(16).size(); };
+        }},
+        {"parse", all, [](const unsigned long n) {
+            return [s=operand(n).to_string(), r=Mpz{}]() mutable { r = Mpz{s}; };
+        }},
+        {"from_chars", all, [](const unsigned long n) {
+            return [s=operand(n).to_string(), r=Mpz{}]() mutable { sink += from_chars(s, r).ptr != nullptr; };
+        }},
+        {"encode", all, [](const unsigned long n) {
+            const Mpz a = operand(n);
+            return [a, s=string(encoded_size(a), '\0')]() mutable { sink += encode(a, s.data()) - s.data(); };
+        }},
+        {"decode", all, [](const unsigned long n) {
+            const Mpz a = operand(n);
+            string s(encoded_size(a), '\0');
+            encode(a, s.data());
+            return [s=std::move(s), r=Mpz{}]() mutable { sink += decode(s.data(), s.data() + s.size(), r) - s.data(); };
+        }},
+    };
+}
+
+
+
+//Measurement
+struct Result {
+    string name;
+    unsigned long bits;
+    unsigned long iterations;
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+//Doubles the iterations until a run takes min-time, best of three
+static Result measure(const string& name, const unsigned long bits, const Op& op, const double minTime) {
+    Result best{name, bits, 0, 0, 0};
+    unsigned long iterations = 1;
+    for(int run=0; run<3; ++run) {
+        while(true) {
+            const unsigned long allocated = allocations();
+            const auto start = chrono::steady_clock::now();
+            for(unsigned long i=0; i<iterations; ++i) {
+                op();
+            }
+            const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            if(elapsed.count() < minTime) {
+                const double factor = elapsed.count() > 0 ? clamp(minTime / elapsed.count() * 1.2, 2.0, 100.0) : 100;
+                iterations = static_cast<unsigned long>(iterations * factor);
+                continue;
+            }
+            const double ns = elapsed.count() * 1e9 / iterations;
+            if(!best.iterations || ns < best.nsPerOp) {
+                best.iterations = iterations;
+                best.nsPerOp = ns;
+                best.allocsPerOp = MpzAllocStats::enabled
+                        ? static_cast<double>(allocations() - allocated) / iterations : notCounted;
+            }
+            break;
+        }
+    }
+    return best;
+}
+
+
+
+//JSON, one result per line, so baselines can be read back line by line
+static void write_json(const string& path, const vector<Result>& results) {
+    ofstream os{path};
+    os << "{\n  \"version\": 1,\n  \"results\": [\n";
+    for(size_t i=0; i<results.size(); ++i) {
+        const Result& r = results[i];
+        os << "    {\"name\": \"" << r.name << "\", \"bits\": " << r.bits << ", \"iterations\": " << r.iterations
+                << ", \"ns_per_op\": " << setprecision(6) << r.nsPerOp << ", \"allocs_per_op\": ";
+        if(isnan(r.allocsPerOp)) {
+            os << "null";
+        } else {
+            os << r.allocsPerOp;
+        }
+        os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+    if(!os) {
+        cerr << "can't write " << path << endl;
+        exit(2);
+    }
+}
+
+static string field(const string& line, const string& key) {
+    const size_t k = line.find("\"" + key + "\":");
+    if(k == string::npos) {
+        return {};
+    }
+    size_t begin = line.find_first_not_of(" \"", k + key.size() + 3);
+    size_t end = line.find_first_of(",}\"", begin);
+    return begin == string::npos ? string{} : line.substr(begin, end - begin);
+}
+
+static map<pair<string, unsigned long>, Result> read_json(const string& path) {
+    ifstream is{path};
+    if(!is) {
+        cerr << "can't read " << path << endl;
+        exit(2);
+    }
+    map<pair<string, unsigned long>, Result> results;
+    for(string line; getline(is, line);) {
+        const string name = field(line, "name");
+        if(name.empty()) {
+            continue;
+        }
+        const string allocs = field(line, "allocs_per_op");
+        const Result r{name, stoul(field(line, "bits")), stoul(field(line, "iterations")),
+                stod(field(line, "ns_per_op")), allocs == "null" ? notCounted : stod(allocs)};
+        results[{r.name, r.bits}] = r;
+    }
+    return results;
+}
+
+
+
+int main(const int argc, const char* const argv[]) {
+    MpzAllocStats::install();
+
+    string filter, json, baseline;
+    unsigned long maxBits = defaultSizes.back();
+    double minTime = 0.05, tolerance = 0.1;
+    for(int i=1; i<argc; ++i) {
+        const string arg = argv[i];
+        if(i + 1 == argc) {
+            cerr << "missing value for " << arg << endl;
+            return 2;
+        }
+        const string value = argv[++i];
+        if(arg == "--filter") {
+            filter = value;
+        } else if(arg == "--max-bits") {
+            maxBits = stoul(value);
+        } else if(arg == "--min-time") {
+            minTime = stod(value);
+        } else if(arg == "--json") {
+            json = value;
+        } else if(arg == "--baseline") {
+            baseline = value;
+        } else if(arg == "--tolerance") {
+            tolerance = stod(value);
+        } else {
+            cerr << "unknown option " << arg << endl;
+            return 2;
+        }
+    }
+    const auto base = baseline.empty() ? map<pair<string, unsigned long>, Result>{} : read_json(baseline);
+
+    vector<Result> results;
+    unsigned int regressions = 0;
+    cout << left << setw(20) << "case" << right << setw(10) << "bits" << setw(16) << "ns/op" << setw(12) << "allocs/op"
+            << (base.empty() ? "" : "  vs baseline") << endl;
+    for(const Case& c : cases()) {
+        if(c.name.find(filter) == string::npos) {
+            continue;
+        }
+        for(const unsigned long bits : c.sizes.empty() ? defaultSizes : c.sizes) {
+            if(bits > maxBits || (c.sizes.empty() && bits > c.maxBits)) {
+                continue;
+            }
+            const Op op = c.setup(bits);
+            const Result& r = results.emplace_back(measure(c.name, bits, op, minTime));
+            cout << left << setw(20) << r.name << right << setw(10) << r.bits << setw(16) << fixed << setprecision(1)
+                    << r.nsPerOp << setw(12) << allocs_text(r.allocsPerOp);
+            if(const auto b = base.find({r.name, r.bits}); b != base.end()) {
+                const double ratio = r.nsPerOp / b->second.nsPerOp;
+                //false if either wasn't counted
+                const bool slower = ratio > 1 + tolerance, allocating = r.allocsPerOp > b->second.allocsPerOp + 0.5;
+                cout << "  " << setprecision(2) << ratio << "x" << (slower ? "  SLOWER" : "")
+                        << (allocating ? "  MORE ALLOCATIONS" : "");
+                regressions += slower || allocating;
+            }
+            cout << endl;
+        }
+    }
+
+    if(!json.empty()) {
+        write_json(json, results);
+    }
+    if(!base.empty()) {
+        cout << regressions << " regression" << (regressions == 1 ? "" : "s") << " against " << baseline << endl;
+    }
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <functional>
+
+#include "mpz.h"
+#include "mpz_alloc.h"
+
+
+using namespace std;
+
+
+
+//Workloads, results are folded into a checksum so nothing gets optimised away
+unsigned long work_fib() {
+    unsigned long s = 0;
+    for(unsigned long n=0; n<20'000; n+=7) {
+        s += static_cast<unsigned long>(fib(n) % 1'000'003ul);
+    }
+    //iterated additions, buffers grow one limb at a time
+    Mpz a, b{1ul};
+    for(unsigned int i=0; i<50'000; ++i) {
+        a += b;
+        swap(a, b);
+    }
+    return s + static_cast<unsigned long>(b % 1'000'003ul);
+}
+
+unsigned long work_factorise() {
+    unsigned long s = 0;
+    const Mpz base{"340282366920938463463374607431768211297"}; //> 2^128, no small values
+    for(unsigned long n=1'000'000'000; n<1'000'000'300; ++n) {
+        for(const auto& [p, e] : factorise(Mpz{n})) {
+            s += static_cast<unsigned long>((base*p + e) % 1'000'003ul);
+        }
+    }
+    return s;
+}
+
+unsigned long work_products() {
+    unsigned long s = 0;
+    Mpz x{"123456789012345678901234567890123456789"};
+    for(unsigned long i=0; i<200'000; ++i) {
+        const Mpz y = x*x + x*i;
+        x = y % Mpz{"98765432109876543210987654321098765432109876543210"} + i;
+        s += static_cast<unsigned long>(x % 97ul);
+    }
+    return s;
+}
+
+//GMP's memory functions alone, the share of the above that the allocator
+//decides: short lived temporaries, a few longer lived ones & growing buffers
+unsigned long work_churn() {
+    void* (*alloc)(size_t);
+    void* (*realloc)(void*, size_t, size_t);
+    void (*free)(void*, size_t);
+    mp_get_memory_functions(&alloc, &realloc, &free);
+    unsigned long s = 0;
+    void* kept[64] = {};
+    for(unsigned long i=0; i<2'000'000; ++i) {
+        const size_t n = 64 + (i % 5) * 16;
+        void* const t = alloc(48);
+        void* b = alloc(n);
+        static_cast<char*>(b)[n-1] = 1;
+        b = realloc(b, n, 200);
+        s += static_cast<char*>(b)[n-1];
+        free(t, 48);
+        if(kept[i % 64]) {
+            free(kept[i % 64], 40);
+        }
+        kept[i % 64] = alloc(40);
+        free(b, 200);
+    }
+    for(void* const k : kept) {
+        free(k, 40);
+    }
+    return s;
+}
+
+
+
+//best of a few runs, the workloads are short
+double time(const function<unsigned long()>& f, unsigned long& checksum) {
+    double best = 0;
+    for(int run=0; run<7; ++run) {
+        const auto start{std::chrono::steady_clock::now()};
+        checksum = f();
+        const auto end{std::chrono::steady_clock::now()};
+        const std::chrono::duration<double> duration{end - start};
+        best = run ? min(best, duration.count()) : duration.count();
+    }
+    return best;
+}
+
+int main() {
+    const pair<const char*, function<unsigned long()>> workloads[] = {
+        {"fib", work_fib},
+        {"factorise", work_factorise},
+        {"products", work_products},
+        {"churn", work_churn},
+    };
+
+    //each workload frees everything it allocated, so the memory functions
+    //can be swapped in between
+    for(const auto& [name, f] : workloads) {
+        unsigned long c0, c1, c2;
+
+        MpzPool::uninstall();
+        const double tMalloc = time(f, c0);
+
+        MpzPool::install();
+        const double tPool = time(f, c1);
+
+        const double tArena = time([&f]() {
+            MpzArena arena;
+            return f();
+        }, c2);
+        MpzPool::trim();
+
+        if(c0 != c1 || c0 != c2) {
+            cerr << name << ": checksum mismatch" << endl;
+            return 1;
+        }
+        cout << name << ":\tmalloc " << tMalloc << " s\tpool " << tPool << " s\tarena " << tArena << " s" << endl;
+    }
+    MpzPool::uninstall();
+
+    return 0;
+}
@@ -1,9 +1,39 @@
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <optional>
 #include <random>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <unordered_map>
+#include <unistd.h>
 
 #include "mpz.h"
+#include "mpz_expr.h"
+#include "mpz_alloc.h"
+#include "mpz_factor.h"
+#include "mpz_executor.h"
+#include "mpz_prime.h"
+#include "mpz_random.h"
+#include "mpz_recurrence.h"
+#include "mpz_montgomery.h"
+#include "mpz_batch_gcd.h"
+#include "mpz_range.h"
+#include "mpz_io.h"
+#include "mpz_serial.h"
+#include "mpz_view.h"
+#include "mpz_vector.h"
+#include "mpz_map.h"
+#include "mpz_memo.h"
+#include "mpz_mul.h"
+#include "mpz_ntt.h"
+#include "mpz_special.h"
+#include "mpz_stats.h"
 
 
 using namespace std;
@@ -241,45 +271,1373 @@ void test_mpz_pow() {
     }
 }
 
+void test_mpz_powm() {
+    MpzRandom rng{random_device{}()};
 
+    cout << "Testing powm" << endl;
+    //huge exponents
+    const Mpz huge = pow(Mpz{2ul}, 100);
+    assert(pow(Mpz{}, huge) == 0ul && pow(Mpz{1ul}, huge) == 1ul && pow(Mpz{-1l}, huge) == 1ul && pow(Mpz{-1l}, huge+1ul) == -1l);
+    assert(pow(Mpz{3ul}, Mpz{5ul}) == 243ul && pow(Mpz{-2l}, Mpz{3ul}) == -8l);
+    bool thrown = false;
+    try {
+        (void)pow(Mpz{2ul}, huge);
+    } catch(const overflow_error&) {
+        thrown = true;
+    }
+    assert(thrown);
 
+    for(const unsigned long bits : {3ul, 64ul, 200ul, 1000ul}) {
+        for(unsigned int i=0; i<20; ++i) {
+            const Mpz m = rng.bits(bits), b = rng.bits(bits+5) - rng.bits(bits+4), e = rng.bits(bits);
+            Mpz r;
+            mpz_powm(r.get_mpz_t(), b.get_mpz_t(), e.get_mpz_t(), m.get_mpz_t());
+            assert(powm(b, e, m) == r && powm(b, e, -m) == r);
+            const unsigned long u = rng();
+            assert(powm(b, u, m) == powm(b, Mpz{u}, m));
+            if(m.is_odd() && e != 0ul) {
+                assert(powm_sec(b, e, m) == r);
+            }
+            //negative powers are inverses
+            if(gcd(b, m) == 1ul && m > 1ul) {
+                assert(powm(powm(b, -e, m) * r, 1ul, m) == 1ul);
+            }
+            //fixed base, within & beyond maxBits
+            const MpzFixedBase fixed{b, m, bits};
+            for(unsigned int j=0; j<5; ++j) {
+                const Mpz f = rng.bits(rng() % (bits+1)), g = rng.bits(bits + 50);
+                assert(fixed.pow(f) == powm(b, f, m) && fixed.pow(g) == powm(b, g, m));
+            }
+            assert(MpzFixedBase(b, m, bits, 1).pow(e) == r && MpzFixedBase(b, m, bits, 8).pow(e) == r);
+        }
+    }
+    thrown = false;
+    try {
+        (void)powm(Mpz{2ul}, Mpz{-1l}, Mpz{4ul});
+    } catch(const invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
 
+void test_mpz_small() {
+    random_device dev;
+    mt19937_64 rng(dev());
+    //magnitudes around the single limb boundary, random sign
+    const auto draw = [&rng]() {
+        const Mpz m{rng() >> rng()%64};
+        return rng()%2 ? -m : m;
+    };
+    //same value, but heap allocated: results from GMP only
+    const auto heap = [](const Mpz& a) {
+        return Mpz{a.to_string()};
+    };
 
+    cout << "Testing small values" << endl;
+    for(unsigned int i=0; i<10000; ++i) {
+        const Mpz a = draw(), b = draw();
+        const Mpz A = heap(a), B = heap(b);
+        const unsigned long k{rng() >> rng()%64};
+        const unsigned long s{rng() % 130};
 
-unordered_map<void*, size_t> allocation_map;
+        assert(-a == -A && abs(a) == abs(A));
+        assert(a+b == A+B && a+k == A+k && k+a == k+A);
+        assert(a-b == A-B && a-k == A-k && k-a == k-A);
+        assert(a*b == A*B && a*k == A*k);
+        assert(a*static_cast<long>(k/2) == A*static_cast<long>(k/2));
+        if(b) {
+            assert(a/b == A/B && a%b == A%B);
+        }
+        if(k) {
+            assert(a/k == A/k && a%k == A%k);
+        }
+        assert((a&b) == (A&B) && (a|b) == (A|B) && (a^b) == (A^B));
+        assert(a<<s == A<<s && a>>s == A>>s);
+        assert((a<=>b) == (A<=>B) && (a<=>k) == (A<=>k) && a == A);
+        assert(gcd(a, b) == gcd(A, B) && gcd(a, k) == gcd(A, k));
 
-void* custom_alloc(const size_t size) {
-    void* ptr = malloc(size);
-    if(ptr) {
-        allocation_map[ptr] = size;
+        Mpz c = a, C = A;
+        c += b; C += B;
+        assert(c == C);
+        c *= b; C *= B;
+        assert(c == C);
+        c = a; C = A;
+        c.addmul(b, k); C.addmul(B, k);
+        assert(c == C);
+        c.submul(a, b); C.submul(A, B);
+        assert(c == C);
+        c = a; C = A;
+        c <<= s; C <<= s;
+        assert(c == C);
+        c >>= s/2; C >>= s/2;
+        assert(c == C);
+        if(b) {
+            c %= b; C %= B;
+            assert(c == C);
+        }
+
+        Mpz d = std::move(c);
+        assert(d == C);
+        c = d;
+        d = std::move(C);
+        assert(c == d);
     }
-    return ptr;
 }
 
-void* custom_realloc(void* ptr, size_t old_size, const size_t new_size) {
-    if(ptr) {
-        allocation_map.erase(ptr);
+void test_mpz_rvalue() {
+    random_device dev;
+    mt19937_64 rng(dev());
+    //small and multi limb values
+    const auto draw = [&rng]() {
+        Mpz m{rng() >> rng()%64};
+        for(unsigned long i=rng()%4; i; --i) {
+            m = (m << 64) + rng();
+        }
+        return rng()%2 ? -m : m;
+    };
+    //forces the rvalue overloads
+    const auto tmp = [](const Mpz& a) {
+        return Mpz{a};
+    };
+
+    cout << "Testing rvalue overloads" << endl;
+    for(unsigned int i=0; i<10000; ++i) {
+        const Mpz a = draw(), b = draw();
+        const unsigned long k{rng() >> rng()%64 | 1};
+        const long l{static_cast<long>(rng() >> 2) - (1l << 61)};
+        const unsigned long s{rng() % 130};
+
+        assert(-tmp(a) == -a && abs(tmp(a)) == abs(a));
+        assert(tmp(a)+b == a+b && a+tmp(b) == a+b && tmp(a)+tmp(b) == a+b);
+        assert(tmp(a)+k == a+k && k+tmp(a) == k+a);
+        assert(tmp(a)-b == a-b && a-tmp(b) == a-b && tmp(a)-tmp(b) == a-b);
+        assert(tmp(a)-k == a-k && k-tmp(a) == k-a);
+        assert(tmp(a)*b == a*b && a*tmp(b) == a*b && tmp(a)*tmp(b) == a*b);
+        assert(tmp(a)*k == a*k && k*tmp(a) == k*a && tmp(a)*l == a*l && l*tmp(a) == l*a);
+        if(b) {
+            assert(tmp(a)/b == a/b && a/tmp(b) == a/b && tmp(a)/tmp(b) == a/b);
+            assert(tmp(a)%b == a%b && a%tmp(b) == a%b && tmp(a)%tmp(b) == a%b);
+        }
+        assert(tmp(a)/k == a/k && tmp(a)%k == a%k);
+        assert((tmp(a)&b) == (a&b) && (a&tmp(b)) == (a&b) && (tmp(a)&tmp(b)) == (a&b));
+        assert((tmp(a)|b) == (a|b) && (a|tmp(b)) == (a|b) && (tmp(a)|tmp(b)) == (a|b));
+        assert((tmp(a)^b) == (a^b) && (a^tmp(b)) == (a^b) && (tmp(a)^tmp(b)) == (a^b));
+        assert(tmp(a)<<s == a<<s && tmp(a)>>s == a>>s);
+        assert(pow(tmp(a), s%8) == pow(a, s%8) && bin(tmp(a), s%8) == bin(a, s%8));
+        assert(root(tmp(abs(a)), s%8+1) == root(abs(a), s%8+1) && sqrt(tmp(abs(a))) == sqrt(abs(a)));
+        assert(gcd(tmp(a), b) == gcd(a, b) && gcd(a, tmp(b)) == gcd(a, b) && gcd(tmp(a), tmp(b)) == gcd(a, b));
+        assert(gcd(tmp(a), k) == gcd(a, k) && lcm(tmp(a), k) == lcm(a, k));
+        assert(lcm(tmp(a), b) == lcm(a, b) && lcm(a, tmp(b)) == lcm(a, b) && lcm(tmp(a), tmp(b)) == lcm(a, b));
     }
-    void* new_ptr = realloc(ptr, new_size);
-    if(new_ptr) {
-        allocation_map[new_ptr] = new_size;
+}
+
+void test_factorise() {
+    random_device dev;
+    mt19937_64 rng(dev());
+
+    cout << "Testing factorise" << endl;
+    const auto check = [](const Mpz& n) {
+        const auto f = factorise(n);
+        Mpz p{1l};
+        for(size_t i=0; i<f.size(); ++i) {
+            const auto& [q, e] = f[i];
+            assert(i == 0 || f[i-1].first < q);
+            assert(q == -1l || n == 0l || mpz_probab_prime_p(q.get_mpz_t(), 25));
+            p *= pow(q, e);
+        }
+        assert(p == n);
+        return f;
+    };
+    const auto prime = [&rng](const unsigned long bits) {
+        Mpz p{rng() | 1};
+        while(p.size_in_base(2) < bits) {
+            p = (p << 64) | Mpz{rng()};
+        }
+        p >>= p.size_in_base(2) - bits;
+        mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+        return p;
+    };
+
+    assert(check(Mpz{}).size() == 1 && check(Mpz{1l}).empty() && check(Mpz{-1l}).size() == 1);
+    for(unsigned int i=0; i<200; ++i) {
+        check(Mpz{static_cast<long>(rng())});
+    }
+    //repeated & perfect power factors
+    check(pow(prime(40), 3) * pow(prime(20), 2) * 12ul);
+    check(pow(prime(70), 4));
+    //rho, p-1 & ECM sized factors
+    for(const unsigned long bits : {30ul, 45ul, 60ul}) {
+        const Mpz p = prime(bits), q = prime(bits+20);
+        const auto f = check(p*q);
+        assert(f.size() == 2 && f[0].first == p && f[1].first == q);
+    }
+    assert(pollard_rho(Mpz{1'000'000'007ul*998'244'353ul}, 1, 1ul << 20));
+    //threaded, same result as serial
+    {
+        const Mpz n = prime(50) * prime(55) * pow(prime(60), 2) * prime(90);
+        const auto f = check(n);
+        MpzExecutor executor{4};
+        assert(factorise(n, executor) == f && factorise(n, 3) == f);
+        assert(f.size() == 4);
     }
-    return new_ptr;
 }
 
-void custom_free(void* ptr, size_t size) {
-    if(ptr) {
-        allocation_map.erase(ptr);
+void test_mpz_prime() {
+    random_device dev;
+    mt19937_64 rng(dev());
+
+    cout << "Testing is_probable_prime" << endl;
+    //exact below 2^64, including strong pseudoprimes to several bases
+    for(const unsigned long n : {0ul, 1ul, 2ul, 3ul, 4ul, 2047ul, 3215031751ul, 3825123056546413051ul, 18446744073709551557ul}) {
+        assert(Mpz{n}.is_probable_prime() == (mpz_probab_prime_p(Mpz{n}.get_mpz_t(), 50) > 0));
+    }
+    assert(!Mpz{-7l}.is_probable_prime());
+    //the same values with heap limbs
+    const Mpz big = Mpz{1ul} << 200;
+    for(const char* const n : {"0", "1", "2", "3", "4", "5", "7", "11", "97", "251", "2047", "18446744073709551557"}) {
+        const Mpz heap{n};
+        const bool expected = mpz_probab_prime_p(heap.get_mpz_t(), 50) > 0;
+        assert(heap.is_probable_prime() == expected && heap.is_probable_prime(10) == expected);
+    }
+    assert((big * 3ul / big).is_probable_prime() && (big * 3ul / big).is_probable_prime(5));
+    const vector<Mpz> parsed{Mpz{"3"}, Mpz{"7"}, Mpz{5ul}, Mpz{"9"}};
+    assert(probable_primes(parsed) == (vector<size_t>{0, 1, 2}));
+    for(unsigned int i=0; i<10'000; ++i) {
+        const Mpz n{rng() >> (rng() % 64)};
+        assert(n.is_probable_prime() == (mpz_probab_prime_p(n.get_mpz_t(), 50) > 0));
     }
-    free(ptr);
+    const Mpz m61 = pow(Mpz{2ul}, 61) - 1, m89 = pow(Mpz{2ul}, 89) - 1, m127 = pow(Mpz{2ul}, 127) - 1;
+    assert(m89.is_probable_prime() && m127.is_probable_prime() && m127.is_probable_prime(20));
+    assert(!(m61*m89).is_probable_prime() && !(m61*m89).is_probable_prime(20) && !(m127*m127).is_probable_prime());
+    for(unsigned int i=0; i<2'000; ++i) {
+        Mpz n{rng()};
+        for(unsigned long k=rng()%8; k>0; --k) {
+            n = (n << 64) | Mpz{rng()};
+        }
+        const bool expected = mpz_probab_prime_p(n.get_mpz_t(), 50) > 0;
+        assert(n.is_probable_prime() == expected && n.is_probable_prime(10) == expected);
+    }
+
+    //batches
+    vector<Mpz> candidates;
+    for(unsigned int i=0; i<5'000; ++i) {
+        candidates.push_back((Mpz{rng()} << 192) + rng());
+    }
+    candidates.push_back(Mpz{2ul});
+    candidates.push_back(Mpz{-3l});
+    vector<size_t> expected;
+    for(size_t i=0; i<candidates.size(); ++i) {
+        if(candidates[i].is_probable_prime()) {
+            expected.push_back(i);
+        }
+    }
+    MpzExecutor executor{3};
+    assert(probable_primes(candidates, 0, executor) == expected);
+    assert(probable_primes(span(candidates).first(100), 5) == probable_primes(span(candidates).first(100)));
+    assert(probable_primes({}).empty());
 }
 
-void report_unfreed_memory() {
-    if(!allocation_map.empty()) {
-        cerr << "Memory leaks detected:" << endl;
-        for(const auto& [ptr, size] : allocation_map) {
-            cerr << "  Address: " << ptr << ", Size: " << size << " bytes" << endl;
+void test_mpz_random() {
+    cout << "Testing random" << endl;
+    //reproducible, streams are independent
+    MpzRandom a{42}, b{42}, c{42, 1};
+    for(unsigned int i=0; i<100; ++i) {
+        const unsigned long x = a();
+        assert(x == b() && x != c());
+    }
+    MpzRandom j{42};
+    j.jump();
+    assert(MpzRandom(42, 1)() == j());
+
+    //bounds & bit lengths, bulk fills continue the same sequence
+    const Mpz bound = pow(Mpz{3ul}, 100), small{1000ul};
+    MpzRandom d{7}, e{7};
+    vector<Mpz> v(100), w(100);
+    d.fill_below(v, bound);
+    d.fill_below(w, small);
+    for(size_t i=0; i<v.size(); ++i) {
+        assert(v[i] == e.below(bound) && sgn(v[i]) >= 0 && v[i] < bound);
+    }
+    for(size_t i=0; i<w.size(); ++i) {
+        assert(w[i] == e.below(small) && w[i] < small);
+    }
+    for(const unsigned long bits : {0ul, 1ul, 63ul, 64ul, 65ul, 1000ul}) {
+        d.fill_bits(v, bits);
+        for(const Mpz& x : v) {
+            assert(bits ? x.size_in_base(2) == bits : x == 0ul);
+        }
+    }
+    //roughly uniform
+    unsigned int counts[10] = {};
+    for(unsigned int i=0; i<100'000; ++i) {
+        ++counts[static_cast<unsigned long>(d.below(Mpz{10ul}))];
+    }
+    for(const unsigned int n : counts) {
+        assert(9'000 < n && n < 11'000);
+    }
+    bool thrown = false;
+    try {
+        (void)Mpz::rand(Mpz{});
+    } catch(const invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    //per thread generators
+    unsigned long x, y;
+    thread t1([&x]() {
+        MpzRandom::seed_local(5, 2);
+        x = static_cast<unsigned long>(Mpz::rand(Mpz{~0ul}));
+    });
+    thread t2([&y]() {
+        MpzRandom::seed_local(5, 2);
+        y = static_cast<unsigned long>(Mpz::rand(Mpz{~0ul}));
+    });
+    t1.join();
+    t2.join();
+    assert(x == y && x == static_cast<unsigned long>(MpzRandom(5, 2).below(Mpz{~0ul})));
+}
+
+void test_mpz_montgomery() {
+    MpzRandom rng{random_device{}()};
+
+    cout << "Testing Montgomery" << endl;
+    for(const unsigned long bits : {2ul, 20ul, 64ul, 65ul, 128ul, 300ul, 2500ul}) {
+        for(unsigned int i=0; i<20; ++i) {
+            const Mpz n = rng.bits(bits) | Mpz{1ul};
+            if(n == 1ul) {
+                continue;
+            }
+            const MpzMontgomery m{n};
+            const auto mod = [&n](const Mpz& x) {
+                Mpz r;
+                mpz_mod(r.get_mpz_t(), x.get_mpz_t(), n.get_mpz_t());
+                return r;
+            };
+            const Mpz a = rng.below(n), b = rng.below(n), c = -rng.bits(bits+10), e = rng.bits(bits);
+            const Mpz A = m.to_montgomery(a), B = m.to_montgomery(b);
+            assert(m.from_montgomery(A) == a && m.from_montgomery(m.to_montgomery(c)) == mod(c));
+            assert(m.from_montgomery(m.mul(A, B)) == a*b % n);
+            assert(m.from_montgomery(m.sqr(A)) == a*a % n);
+            assert(m.from_montgomery(m.add(A, B)) == (a+b) % n);
+            assert(m.from_montgomery(m.sub(A, B)) == mod(a-b));
+            assert(m.from_montgomery(m.one()) == 1ul);
+            Mpz r;
+            mpz_powm(r.get_mpz_t(), a.get_mpz_t(), e.get_mpz_t(), n.get_mpz_t());
+            assert(m.from_montgomery(m.pow(A, e)) == r && m.pow(A, Mpz{}) == m.one());
+            //in place
+            Mpz x = A;
+            m.mul(x, x, x);
+            m.add(x, x, B);
+            assert(m.from_montgomery(x) == (a*a + b) % n);
+        }
+    }
+    //batches
+    const MpzMontgomery m{pow(Mpz{2ul}, 255) - 19ul};
+    vector<Mpz> v(100), w(100), u(100);
+    rng.fill_bits(v, 300);
+    m.to_montgomery(v, w);
+    m.from_montgomery(w, u);
+    for(size_t i=0; i<v.size(); ++i) {
+        assert(u[i] == v[i] % m.modulus() && w[i] == m.to_montgomery(v[i]));
+    }
+}
+
+void test_batch_gcd() {
+    MpzRandom rng{random_device{}()};
+
+    cout << "Testing batch_gcd" << endl;
+    //RSA like moduli, some sharing a prime
+    vector<Mpz> primes(60), moduli;
+    rng.fill_bits(primes, 100);
+    for(Mpz& p : primes) {
+        mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+    }
+    for(size_t i=0; i+1<primes.size(); i+=2) {
+        moduli.push_back(primes[i] * primes[i+1]);
+    }
+    moduli.push_back(primes[0] * primes[3]);
+    moduli.push_back(-primes[5] * primes[7]);
+    moduli.push_back(primes[9] * primes[9]);
+    moduli.push_back(Mpz{1ul});
+    moduli.push_back(Mpz{12ul});
+    const auto expected = [&moduli](const size_t i) {
+        Mpz others{1ul};
+        for(size_t j=0; j<moduli.size(); ++j) {
+            if(j != i) {
+                others *= moduli[j];
+            }
+        }
+        return gcd(abs(moduli[i]), others);
+    };
+    MpzExecutor executor{3};
+    const vector<Mpz> g = batch_gcd(moduli, executor), h = batch_gcd(moduli, executor, 4);
+    for(size_t i=0; i<moduli.size(); ++i) {
+        assert(g[i] == expected(i) && h[i] == g[i]);
+    }
+    assert(g[0] == primes[0] && g[1] == primes[3] && g[2] == primes[5] && g[4] == primes[9] && g[29] == 1ul);
+    assert(batch_gcd({}).empty() && batch_gcd(span(moduli).first(1))[0] == 1ul);
+}
+
+void test_mpz_range() {
+    mt19937_64 rng(random_device{}());
+
+    cout << "Testing range reductions" << endl;
+    MpzExecutor executor{3}, serial{0};
+    for(const size_t n : {0ul, 1ul, 7ul, 100ul, 5'000ul}) {
+        vector<unsigned long> u(n);
+        vector<Mpz> v(n);
+        for(size_t i=0; i<n; ++i) {
+            u[i] = rng() >> (rng() % 64);
+            v[i] = Mpz{u[i]} * Mpz{rng()};
+        }
+        Mpz p{1ul}, q{1ul}, s, t, g, h, l{1ul}, m{1ul};
+        for(size_t i=0; i<n; ++i) {
+            p *= u[i];
+            q *= v[i];
+            s += u[i];
+            t += v[i];
+            g = gcd(g, Mpz{u[i]});
+            h = gcd(h, v[i]);
+        }
+        assert(product(u, executor) == p && product(v, executor) == q && product(u.begin(), u.end(), serial) == p);
+        assert(sum(u) == s && sum(v.begin(), v.end(), executor) == t);
+        assert(gcd(u) == g && gcd(span<const Mpz>(v), executor) == h);
+        //lcm only of small values, it grows too fast otherwise
+        if(n <= 100) {
+            for(size_t i=0; i<n; ++i) {
+                l = lcm(l, Mpz{u[i]});
+                m = lcm(m, v[i]);
+            }
+            assert(lcm(u) == l && lcm(v, executor) == m);
+        }
+    }
+    const vector<unsigned int> small{2, 3, 4, 5, 6, 0};
+    assert(product(span(small).first(5)) == 720ul && lcm(span(small).first(5)) == 60ul && lcm(small) == 0ul);
+    assert(gcd(vector<unsigned long>{12, 18, 0}) == 6ul && sum(vector<unsigned long>{~0ul, ~0ul}) == Mpz{~0ul} * 2ul);
+}
+
+void test_mpz_io() {
+    MpzRandom rng{random_device{}()};
+    const auto gmp = [](const Mpz& x, const int base) {
+        string s(x.size_in_base(base) + 2, '\0');
+        mpz_get_str(s.data(), base, x.get_mpz_t());
+        s.resize(s.find('\0'));
+        return s;
+    };
+
+    cout << "Testing output" << endl;
+    MpzExecutor executor{3};
+    vector<Mpz> values{Mpz{}, Mpz{7ul}, Mpz{-12345l}, pow(Mpz{10ul}, 8192), pow(Mpz{10ul}, 8192) - 1ul, -pow(Mpz{10ul}, 50'000)};
+    for(const unsigned long bits : {100ul, 27'213ul, 27'214ul, 200'000ul, 1'000'000ul}) {
+        values.push_back(rng.bits(bits));
+        values.push_back(-rng.bits(bits));
+    }
+    for(const Mpz& x : values) {
+        for(const int base : {10, 2, 16, 36, 62}) {
+            const string expected = gmp(x, base);
+            string buffer(x.size_in_base(base) + 1, '?');
+            const auto [end, ec] = to_chars(buffer.data(), buffer.data() + buffer.size(), x, base, executor);
+            assert(ec == errc{} && string(buffer.data(), end) == expected);
+            assert(to_chars(buffer.data(), buffer.data() + expected.size() - 1, x, base).ec == errc::value_too_large);
+            if(base == 10 || base == 16) {
+                ostringstream os;
+                assert(write_digits(os, x, base, executor) == expected.size() && os.str() == expected);
+                assert(x.to_string(base) == expected);
+            }
+        }
+        ostringstream os;
+        os << x;
+        assert(os.str() == gmp(x, 10));
+    }
+    //file descriptors
+    FILE* const f = tmpfile();
+    const Mpz& big = values.back();
+    const size_t n = write_digits(fileno(f), big, 10, executor);
+    rewind(f);
+    string read(n, '\0');
+    assert(fread(read.data(), 1, n, f) == n && read == gmp(big, 10));
+    fclose(f);
+    assert(to_chars(nullptr, nullptr, Mpz{}, 1).ec == errc::invalid_argument);
+    assert(Mpz{255ul}.to_string(-16) == "FF" && Mpz{-35l}.to_string(-36) == "-Z");
+    for(const int base : {0, 1, -1, 63, -37}) {
+        try {
+            (void)big.to_string(base);
+            assert(false);
+        } catch(const invalid_argument&) {}
+    }
+}
+
+void test_mpz_io_input() {
+    MpzRandom rng{random_device{}()};
+
+    cout << "Testing input" << endl;
+    MpzExecutor executor{3};
+    vector<Mpz> values{Mpz{}, Mpz{7ul}, Mpz{-12345l}, pow(Mpz{10ul}, 8192), pow(Mpz{10ul}, 8192) - 1ul};
+    for(const unsigned long bits : {64ul, 100ul, 27'214ul, 200'000ul, 1'000'000ul}) {
+        values.push_back(rng.bits(bits));
+        values.push_back(-rng.bits(bits));
+    }
+    for(const Mpz& x : values) {
+        for(const int base : {10, 2, 8, 16, 32, 36, 62}) {
+            const string s = x.to_string(base);
+            Mpz y{1ul};
+            const auto [end, ec] = from_chars(s, y, base, executor);
+            assert(ec == errc{} && end == s.data() + s.size() && y == x);
+            //leading zeros & a stop at the first non digit
+            const string padded = (x < 0l ? "-000" + s.substr(1) : "000" + s) + "@1";
+            Mpz z;
+            const auto [zEnd, zEc] = from_chars(padded, z, base);
+            assert(zEc == errc{} && zEnd == padded.data() + padded.size() - 2 && z == x);
+        }
+    }
+    //mpz_set_str's digits: either case up to base 36, above upper case first
+    Mpz x;
+    assert(from_chars("fF", x, 16).ec == errc{} && x == 255ul);
+    assert(from_chars("Az", x, 62).ec == errc{} && x == 10ul*62 + 61);
+    assert(from_chars("-", x).ec == errc::invalid_argument && x == 10ul*62 + 61);
+    assert(from_chars("z", x, 35).ec == errc::invalid_argument);
+    assert(from_chars("", x).ec == errc::invalid_argument);
+    assert(from_chars("1", x, 63).ec == errc::invalid_argument);
+
+    istringstream is{"  -ff 17\n12x"};
+    Mpz a, b, c;
+    is >> hex >> a >> oct >> b >> dec >> c;
+    assert(is && a == -255l && b == 15ul && c == 12ul);
+    is >> a;
+    assert(is.fail() && a == -255l);
+    istringstream end{"42"};
+    end >> a;
+    assert(!end.fail() && end.eof() && a == 42ul);
+
+    const Mpz& big = values.back();
+    char path[] = "/tmp/mpz_io_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    {
+        ofstream os{path};
+        os << "\n  " << big << " \n";
+    }
+    assert(load_digits(path, 10, executor) == big);
+    {
+        ofstream os{path};
+        os << "12 34";
+    }
+    try {
+        load_digits(path);
+        assert(false);
+    } catch(const invalid_argument&) {}
+    close(fd);
+    unlink(path);
+    try {
+        load_digits(path);
+        assert(false);
+    } catch(const system_error&) {}
+}
+
+void test_mpz_serial() {
+    MpzRandom rng{random_device{}()};
+
+    cout << "Testing serialization" << endl;
+    MpzExecutor executor{3};
+    vector<Mpz> values{Mpz{}, Mpz{1ul}, Mpz{-1l}, Mpz{255ul}, Mpz{256ul}, Mpz{~0ul}, -Mpz{~0ul}, Mpz{~0ul} + 1ul};
+    for(const unsigned long bits : {7ul, 56ul, 65ul, 1000ul, 100'000ul}) {
+        values.push_back(rng.bits(bits));
+        values.push_back(-rng.bits(bits));
+    }
+    for(unsigned int i=0; i<10'000; ++i) {
+        values.push_back(rng.bits(rng.below(Mpz{300ul}) ? 64 : 700) * (i%3 ? 1l : -1l));
+    }
+    //varint headers
+    assert(encoded_size(Mpz{}) == 1 && encoded_size(Mpz{-255l}) == 2 && encoded_size(Mpz{1ul} << 55) == 8);
+    for(const Mpz& x : values) {
+        string s(encoded_size(x), '\0');
+        assert(encode(x, s.data()) == s.data() + s.size());
+        Mpz y{3ul};
+        assert(decode(s.data(), s.data() + s.size(), y) == s.data() + s.size() && y == x);
+        if(x) {
+            try {
+                (void)decode(s.data(), s.data() + s.size() - 1, y);
+                assert(false);
+            } catch(const invalid_argument&) {}
+        }
+    }
+
+    //vectors
+    stringstream ss;
+    write_mpzs(ss, values, executor);
+    const string bytes = ss.str();
+    assert(read_mpzs(ss) == values);
+    for(const size_t cut : {size_t{2}, size_t{6}, bytes.size() - 1}) {
+        istringstream is{bytes.substr(0, cut)};
+        try {
+            (void)read_mpzs(is);
+            assert(false);
+        } catch(const invalid_argument&) {}
+    }
+    //lengths aren't trusted before the data is there
+    for(const unsigned long long length : {1ull << 30, 1ull << 39, 1ull << 62}) {
+        string bogus = "MPZV\1\1"; //version 1, one value
+        for(unsigned long long h=length << 1; ; h >>= 7) {
+            bogus += static_cast<char>((h & 0x7F) | (h >= 0x80 ? 0x80 : 0));
+            if(h < 0x80) {
+                break;
+            }
+        }
+        bogus += string(3 << 20, '\1');
+        istringstream in{bogus};
+        try {
+            (void)read_mpzs(in);
+            assert(false);
+        } catch(const invalid_argument&) {}
+    }
+    string future = bytes;
+    future[4] = 2;
+    istringstream is{future};
+    try {
+        (void)read_mpzs(is);
+        assert(false);
+    } catch(const invalid_argument&) {}
+
+    //archives
+    char path[] = "/tmp/mpz_archive_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    write_archive(path, values);
+    {
+        MpzArchive archive{path};
+        assert(archive.size() == values.size());
+        for(unsigned int k=0; k<1000; ++k) {
+            const size_t i = static_cast<unsigned long>(rng.below(Mpz{values.size()}));
+            assert(archive[i] == values[i] && archive.sign(i) == sgn(values[i]));
+            assert(archive.limbs(i).size() == mpz_size(values[i].get_mpz_t()));
+        }
+        assert(archive.at(values.size()-1) == values.back());
+        assert(archive.view(values.size()-1) == values.back() && archive.view(0) == 0ul);
+        try {
+            (void)archive.at(values.size());
+            assert(false);
+        } catch(const out_of_range&) {}
+        const MpzArchive moved = std::move(archive);
+        assert(moved[1] == 1ul);
+    }
+    {
+        ofstream os{path};
+        os << "MPZV";
+    }
+    try {
+        const MpzArchive archive{path};
+        assert(false);
+    } catch(const invalid_argument&) {}
+    unlink(path);
+    try {
+        const MpzArchive archive{path};
+        assert(false);
+    } catch(const system_error&) {}
+}
+
+void test_mpz_view() {
+    MpzRandom rng{random_device{}()};
+
+    cout << "Testing views" << endl;
+    const Mpz a = rng.bits(5000) + 1ul, b = -rng.bits(3000), m = rng.bits(2000) * 2ul + 1ul;
+    //external limbs with high zero limbs
+    vector<mp_limb_t> buffer(mpz_size(a.get_mpz_t()) + 3, 0);
+    mpz_export(buffer.data(), nullptr, -1, sizeof(mp_limb_t), 0, 0, a.get_mpz_t());
+    const MpzView va{buffer, +1}, vb{b}, vm{m.get_mpz_t()};
+    assert(va.limbs().size() == mpz_size(a.get_mpz_t()) && va.limbs().data() == buffer.data());
+    assert(vb.limbs().data() == mpz_limbs_read(b.get_mpz_t()));
+    assert(va == a && vb == b && va != vb && va > vb && va == va);
+    assert(va + vb == a + b && va * 3ul == a * 3ul && va % vm == a % m && va / vb == a / b);
+    //qualified, std::gcd & std::lcm would be exact matches for views here
+    assert(::gcd(va, vb) == gcd(a, b) && ::lcm(vb, 12ul) == lcm(b, 12ul) && powm(va, -vb, vm) == powm(a, -b, m));
+    assert((va >> 100) == (a >> 100) && -vb == -b && abs(vb) == abs(b) && sgn(vb) == -1);
+    assert(va->to_string(16) == a.to_string(16) && vb->size_in_base(10) == b.size_in_base(10));
+    ostringstream os;
+    os << vb;
+    assert(os.str() == b.to_string());
+    Mpz c = va;
+    c += vb;
+    assert(c == a + b && buffer[0] == mpz_getlimbn(a.get_mpz_t(), 0));
+    //small & zero values live in the view
+    const mp_limb_t small[] = {42, 0};
+    MpzView vs{small, -1}, vz{span<const mp_limb_t>{}};
+    assert(vs == -42l && vz == 0ul && !*vz && vz.limbs().empty());
+    const MpzView copy = vs;
+    vs = va;
+    assert(copy == -42l && vs == a);
+    assert((MpzView{small, 0} == 0ul));
+    //a Mpz copy owns its limbs
+    Mpz owned = vs;
+    owned += 1ul;
+    assert(owned == a + 1ul && va == a);
+}
+
+void test_mpz_vector() {
+    MpzRandom rng{random_device{}()};
+
+    cout << "Testing vectors" << endl;
+    vector<Mpz> values{Mpz{}, Mpz{1ul}, Mpz{-1l}, Mpz{~0ul}, -Mpz{~0ul} - 1ul};
+    for(unsigned int i=0; i<1000; ++i) {
+        values.push_back(rng.bits(static_cast<unsigned long>(rng.below(Mpz{500ul}))) * (i%3 ? 1l : -1l));
+    }
+    MpzVector v{values};
+    assert(v.size() == values.size() && v.to_vector() == values);
+    size_t limbs = 0;
+    for(size_t i=0; i<values.size(); ++i) {
+        assert(v[i] == values[i]);
+        limbs += mpz_size(values[i].get_mpz_t());
+    }
+    assert(v.limbs().size() == limbs);
+    try {
+        (void)v.at(values.size());
+        assert(false);
+    } catch(const out_of_range&) {}
+
+    //elementwise against Mpz arithmetic
+    const Mpz k = -rng.bits(130), m = rng.bits(100) + 1ul;
+    vector<Mpz> w = values;
+    v += 5ul;
+    v *= k;
+    v += v[3];
+    for(Mpz& x : w) {
+        x = (x + 5ul) * k;
+    }
+    const Mpz third = w[3];
+    for(Mpz& x : w) {
+        x += third;
+    }
+    assert(v.to_vector() == w);
+    v %= v[7];
+    const Mpz seventh = w[7];
+    for(Mpz& x : w) {
+        x = x % seventh;
+    }
+    assert(v.to_vector() == w);
+    v *= m;
+    v %= 1000ul;
+    for(Mpz& x : w) {
+        x = x * m % 1000ul;
+    }
+    assert(v.to_vector() == w);
+    MpzVector u{w};
+    v += u;
+    for(Mpz& x : w) {
+        x *= 2ul;
+    }
+    assert(v.to_vector() == w);
+    assert(u != v && v == MpzVector{w});
+    try {
+        v %= Mpz{};
+        assert(false);
+    } catch(const invalid_argument&) {}
+
+    //appending, also from itself
+    v.clear();
+    v.append(u);
+    v.append(v);
+    v.push_back(v[1]);
+    v.push_back(Mpz{7ul});
+    assert(v.size() == 2*w.size() + 2 && v[w.size() + 1] == u[1] && v[2*w.size()] == u[1] && v[2*w.size()+1] == 7ul);
+}
+
+void test_mpz_map() {
+    MpzRandom rng{random_device{}()};
+
+    cout << "Testing hash tables" << endl;
+    //equal values hash equal, inline, on the heap or borrowed
+    const Mpz big = rng.bits(1000);
+    Mpz small{12345ul}, promoted{12345ul};
+    (void)promoted.get_mpz_t();
+    const hash<Mpz> h;
+    assert(h(small) == h(promoted) && h(Mpz{}) == h(Mpz{}) && h(MpzView{big}) == h(big) && h(-big) != h(big));
+
+    //random inserts & erases against unordered_map
+    MpzMap<unsigned long> map;
+    MpzSet set;
+    unordered_map<Mpz, unsigned long> expected;
+    for(unsigned int i=0; i<200'000; ++i) {
+        const unsigned long r = rng();
+        //few distinct keys, so erases & reinserts hit occupied chains
+        Mpz key{r % 5'000};
+        if(r & (1ul << 40)) {
+            key = key * big;
+        }
+        if(r & (1ul << 41)) {
+            key = -key;
+        }
+        if(r & (1ul << 42) && r & (1ul << 43)) {
+            assert(map.erase(key) == (expected.erase(key) == 1));
+            set.erase(key);
+        } else {
+            ++map[key];
+            ++expected[key];
+            set.insert(key);
+        }
+    }
+    assert(map.size() == expected.size() && set.size() == expected.size());
+    size_t visited = 0;
+    map.for_each([&](const Mpz& key, const unsigned long n) {
+        assert(expected.at(key) == n && set.contains(key));
+        ++visited;
+    });
+    assert(visited == expected.size());
+    for(const auto& [key, n] : expected) {
+        assert(map.find(key) && *map.find(key) == n);
+    }
+    assert(!map.find(big + 1ul) && !set.contains(big + 1ul));
+    const auto [value, inserted] = map.try_emplace(big + 1ul, 7ul);
+    assert(inserted && *value == 7ul && !map.try_emplace(big + 1ul, 8ul).second && map[big + 1ul] == 7ul);
+
+    MpzMap<unsigned long> copy = map;
+    map.clear();
+    assert(map.empty() && !map.find(big + 1ul) && copy.size() == expected.size() + 1);
+    map = std::move(copy);
+    assert(map.contains(big + 1ul));
+}
+
+void test_mpz_stats() {
+    cout << "Testing allocation statistics" << endl;
+    const MpzAllocSnapshot before = MpzAllocStats::snapshot();
+    {
+        Mpz a{1ul};
+        for(unsigned int i=0; i<64; ++i) {
+            a <<= 64; //grows by a limb at a time
+        }
+        //some on other threads, freed here
+        MpzExecutor executor{2};
+        vector<Mpz> v(8);
+        parallel_for(executor, v.size(), [&v](const size_t i) {
+            v[i] = fib(10'000 + i);
+        });
+    }
+    const MpzAllocSnapshot after = MpzAllocStats::snapshot();
+    if(!MpzAllocStats::enabled) {
+        assert(after.allocations == 0 && after.to_json().find("\"allocations\": 0") != string::npos);
+        return;
+    }
+    assert(after.allocations > before.allocations && after.reallocations >= before.reallocations + 32);
+    assert(after.frees - before.frees == after.allocations - before.allocations);
+    assert(after.liveBytes == before.liveBytes && after.liveBlocks == before.liveBlocks);
+    assert(after.bytesAllocated - before.bytesAllocated == after.bytesFreed - before.bytesFreed);
+    assert(after.threads >= 1 && after.peakLiveBytes >= 64 * sizeof(mp_limb_t));
+    //a limb or two at a time
+    assert(after.reallocGrowth[4] + after.reallocGrowth[5] >= before.reallocGrowth[4] + before.reallocGrowth[5] + 32);
+    size_t threads = 0;
+    for(const uint64_t n : after.peakLiveHistogram) {
+        threads += n;
+    }
+    assert(threads == after.threads);
+    const string json = after.to_json();
+    assert(json.front() == '{' && json.back() == '}' && json.find("\"realloc_growth\": [") != string::npos);
+}
+
+void test_mpz_parallel_mul() {
+    cout << "Testing parallel multiplication" << endl;
+    MpzRandom rng{21};
+    const auto reference = [](const Mpz& a, const Mpz& b) {
+        Mpz r;
+        mpz_mul(r.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+        return r;
+    };
+    //no split, one Karatsuba level, two levels
+    for(const unsigned int threads : {0u, 2u, 8u}) {
+        MpzExecutor executor{threads};
+        for(const unsigned long n : {1ul, 63ul, 64ul, 129ul, 1'000ul, 3'001ul}) {
+            for(const unsigned long m : {n, n - n/3, n/2 + 1, n/5 + 1, 1ul}) {
+                Mpz a = rng.bits(64*n), b = rng.bits(64*m - rng() % 64);
+                if(rng() & 1) {
+                    a.negate();
+                }
+                if(rng() & 1) {
+                    b.negate();
+                }
+                assert(parallel_mul(a, b, executor) == reference(a, b));
+                assert(parallel_mul(b, a, executor) == reference(a, b));
+                assert(parallel_mul(a, a, executor) == reference(a, a));
+                assert(parallel_mul(MpzView{b}, a, executor) == reference(a, b));
+            }
+        }
+        assert(parallel_mul(Mpz{}, rng.bits(64*500), executor) == 0l);
+        //sparse halves, the high half of a zero
+        const Mpz c = Mpz{1ul} << 64*400, d = rng.bits(64*300);
+        assert(parallel_mul(c, d, executor) == reference(c, d));
+        assert(parallel_mul(c, c, executor) == reference(c, c));
+    }
+
+    //operators & pow go through the threshold
+    MpzExecutor executor{8};
+    const size_t defaultLimbs = MpzParallelMul::threshold();
+    {
+        MpzParallelMul scope{executor, 64};
+        {
+            MpzParallelMul inner{executor, SIZE_MAX};
+        }
+        Mpz a = rng.bits(64*2'000), b = -rng.bits(64*1'500);
+        const Mpz ab = reference(a, b), aa = reference(a, a);
+        assert(a * b == ab && Mpz{a} * Mpz{b} == ab && a * a == aa);
+        Mpz c = a;
+        c *= b;
+        assert(c == ab);
+        c = a;
+        c *= c;
+        assert(c == aa);
+        for(const unsigned long e : {0ul, 1ul, 2ul, 97ul, 1'000ul}) {
+            for(const Mpz& base : {Mpz{3ul}, Mpz{-12l}, Mpz{1ul} << 70, -rng.bits(300), Mpz{0ul}, Mpz{-1l}}) {
+                Mpz r;
+                mpz_pow_ui(r.get_mpz_t(), base.get_mpz_t(), e);
+                assert(pow(base, e) == r && pow(Mpz{base}, e) == r);
+            }
         }
+    }
+    assert(MpzParallelMul::threshold() == defaultLimbs);
+    MpzParallelMul::set_threshold(100);
+    const Mpz a = rng.bits(64*500);
+    assert(a * a == reference(a, a) && pow(a, 7) == reference(pow(a, 3), pow(a, 4)));
+    MpzParallelMul::set_threshold(defaultLimbs);
+}
+
+void test_mpz_ntt() {
+    cout << "Testing NTT multiplication" << endl;
+    MpzRandom rng{22};
+    const auto reference = [](const Mpz& a, const Mpz& b) {
+        Mpz r;
+        mpz_mul(r.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+        return r;
+    };
+    const MpzNttKernel kernel = ntt_kernel();
+    assert(ntt_supported(MpzNttKernel::scalar) && ntt_supported(kernel));
+    for(const MpzNttKernel k : {MpzNttKernel::scalar, MpzNttKernel::avx2, MpzNttKernel::avx512}) {
+        if(!ntt_supported(k)) {
+            bool thrown = false;
+            try {
+                set_ntt_kernel(k);
+            } catch(const invalid_argument&) {
+                thrown = true;
+            }
+            assert(thrown && ntt_kernel() == kernel);
+            continue;
+        }
+        set_ntt_kernel(k);
+        assert(ntt_kernel() == k);
+        //transforms from 4 elements up, full & just over half empty
+        for(const unsigned long n : {1ul, 2ul, 3ul, 7ul, 64ul, 65ul, 1'000ul, 4'096ul, 4'097ul, 20'000ul}) {
+            for(const unsigned long m : {n, n/3 + 1, 1ul}) {
+                Mpz a = rng.bits(64*n - rng() % 64), b = rng.bits(64*m - rng() % 64);
+                if(rng() & 1) {
+                    a.negate();
+                }
+                if(rng() & 1) {
+                    b.negate();
+                }
+                assert(ntt_mul(a, b) == reference(a, b) && ntt_mul(b, a) == reference(a, b));
+                assert(ntt_mul(a, a) == reference(a, a));
+            }
+            //largest coefficients
+            const Mpz ones = (Mpz{1ul} << 64*n) - 1ul;
+            assert(ntt_mul(ones, ones) == reference(ones, ones));
+            assert(ntt_mul(ones, -ones) == reference(ones, -ones));
+        }
+        //aliased result, zero
+        Mpz x = rng.bits(64*300), y = -rng.bits(64*200);
+        const Mpz xy = reference(x, y), xx = reference(x, x);
+        ntt_mul(x.get_mpz_t(), x.get_mpz_t(), y.get_mpz_t());
+        assert(x == xy);
+        x = xy;
+        ntt_mul(y.get_mpz_t(), x.get_mpz_t(), x.get_mpz_t());
+        assert(y == reference(xy, xy));
+        assert(ntt_mul(Mpz{}, xx) == 0l && ntt_mul(xx, Mpz{}) == 0l);
+        assert(!ntt_preferred(0, 1'000'000) && !ntt_preferred(mpzNttMaxLimbs, 1));
+    }
+    set_ntt_kernel(kernel);
+    release_ntt_tables();
+
+    //products through multiply() above the crossover
+    if(kernel != MpzNttKernel::scalar) {
+        const Mpz a = rng.bits(64*6'000), b = -rng.bits(64*5'000);
+        assert(ntt_preferred(6'000, 5'000));
+        assert(a * b == reference(a, b) && a * a == reference(a, a));
+    }
+}
+
+void test_mpz_special() {
+    cout << "Testing parallel factorials, binomials & Fibonacci numbers" << endl;
+    const auto gmp = [](void (*f)(mpz_ptr, unsigned long), const unsigned long n) {
+        Mpz r;
+        f(r.get_mpz_t(), n);
+        return r;
+    };
+    for(const unsigned int threads : {0u, 3u}) {
+        MpzExecutor executor{threads};
+        //GMP below the crossovers, the prime products across segments above
+        for(const unsigned long n : {0ul, 1ul, 2ul, 20ul, 16'383ul, 16'384ul, 40'001ul, 300'000ul}) {
+            assert(parallel_fac(n, executor) == gmp(mpz_fac_ui, n));
+            assert(parallel_fac2(n, executor) == gmp(mpz_2fac_ui, n));
+            assert(parallel_fac2(n + 1, executor) == gmp(mpz_2fac_ui, n + 1));
+        }
+        for(const unsigned long n : {0ul, 1ul, 2ul, 1'000ul, 131'071ul, 131'072ul, 140'000ul, 700'001ul}) {
+            for(const unsigned long k : {0ul, 1ul, n/3, n/2, n - std::min(n, 65'536ul), n, n + 1}) {
+                Mpz r;
+                mpz_bin_uiui(r.get_mpz_t(), n, k);
+                assert(parallel_bin(n, k, executor) == r);
+            }
+        }
+        for(const unsigned long n : {0ul, 1ul, 2ul, 1'000ul, 131'071ul, 131'072ul, 262'145ul, 1'000'003ul, 2'000'000ul}) {
+            assert(parallel_fib(n, executor) == gmp(mpz_fib_ui, n));
+        }
+    }
+
+    //fac, fac2, bin & fib through the threshold
+    const size_t defaultLimbs = MpzParallelMul::threshold();
+    MpzParallelMul::set_threshold(64);
+    assert(fac(50'000) == gmp(mpz_fac_ui, 50'000) && fac2(50'001) == gmp(mpz_2fac_ui, 50'001));
+    assert(fib(300'000) == gmp(mpz_fib_ui, 300'000) && bin(200'000, 100'000) == parallel_bin(200'000, 100'000));
+    MpzParallelMul::set_threshold(defaultLimbs);
+}
+
+void test_mpz_memo() {
+    cout << "Testing memoization" << endl;
+    const auto gmp = [](void (*f)(mpz_ptr, unsigned long), const unsigned long n) {
+        Mpz r;
+        f(r.get_mpz_t(), n);
+        return r;
+    };
+    const auto gmp_bin = [](const unsigned long n, const unsigned long k) {
+        Mpz r;
+        mpz_bin_uiui(r.get_mpz_t(), n, k);
+        return r;
+    };
+    MpzMemo memo{MpzMemo::defaultBudget, 64};
+    //a miss caches the checkpoint too, neighbours on both sides extend
+    assert(memo.fac(5'000) == gmp(mpz_fac_ui, 5'000));
+    MpzMemoStats s = memo.stats();
+    assert(s.misses == 1 && s.hits == 0 && s.entries == 2 && s.bytes > 0);
+    assert(memo.fac(5'000) == gmp(mpz_fac_ui, 5'000) && memo.stats().hits == 1);
+    for(const unsigned long n : {4'999ul, 4'970ul, 5'030ul, 4'940ul, 5'001ul}) {
+        assert(memo.fac(n) == gmp(mpz_fac_ui, n));
+    }
+    assert(memo.stats().extensions == 5 && memo.stats().misses == 1);
+    assert(memo.fac(10) == gmp(mpz_fac_ui, 10) && memo.stats().entries == 7); //not cached
+
+    for(const unsigned long n : {30'000ul, 30'001ul, 29'950ul, 30'063ul, 29'937ul, 30'000ul}) {
+        assert(memo.fib(n) == gmp(mpz_fib_ui, n));
+    }
+    assert(memo.stats().misses == 2 && memo.stats().hits == 2);
+
+    //rows & columns, either half of a row
+    for(const auto& [n, k] : {pair{20'000ul, 7'000ul}, {20'000ul, 7'050ul}, {20'000ul, 6'990ul}, {20'000ul, 13'000ul},
+            {20'040ul, 7'000ul}, {19'990ul, 7'000ul}, {20'000ul, 20'001ul}}) {
+        assert(memo.bin(n, k) == gmp_bin(n, k));
+    }
+    s = memo.stats();
+    assert(s.misses == 3 && s.hits == 3 && s.extensions == 5 + 4 + 4);
+
+    //least recently used out first
+    memo.set_budget(s.bytes / 2);
+    assert(memo.stats().bytes <= s.bytes / 2 && memo.stats().evictions > 0 && memo.budget() == s.bytes / 2);
+    memo.clear();
+    assert(memo.stats().entries == 0 && memo.stats().bytes == 0);
+    memo.set_budget(MpzMemo::defaultBudget);
+
+    //concurrent callers
+    const MpzMemoStats before = memo.stats();
+    MpzExecutor executor{4};
+    parallel_for(executor, 64, [&](const size_t i) {
+        const unsigned long n = 8'000 + 37 * (i % 16);
+        assert(memo.fac(n) == gmp(mpz_fac_ui, n) && memo.fib(4 * n) == gmp(mpz_fib_ui, 4 * n));
+        assert(memo.bin(2 * n, n/2 + i) == gmp_bin(2 * n, n/2 + i));
+    });
+    s = memo.stats();
+    assert(s.hits + s.extensions + s.misses == before.hits + before.extensions + before.misses + 3 * 64);
+
+    //opted in, fac, bin & fib go through the cache
+    assert(!MpzMemo::installed());
+    {
+        MpzMemo scoped;
+        scoped.install();
+        assert(MpzMemo::installed() == &scoped);
+        assert(fac(6'000) == gmp(mpz_fac_ui, 6'000) && fib(50'000) == gmp(mpz_fib_ui, 50'000));
+        assert(bin(20'000, 9'000) == gmp_bin(20'000, 9'000) && fac(6'000) == gmp(mpz_fac_ui, 6'000));
+        assert(scoped.stats().misses == 3 && scoped.stats().hits == 1);
+    }
+    assert(!MpzMemo::installed());
+}
+
+void test_mpz_recurrence() {
+    cout << "Testing recurrences modulo m" << endl;
+    const Mpz word{1'000'000'007ul}, top{~0ul};
+    const Mpz odd = (Mpz{1ul} << 200) + 235ul, even = (Mpz{1ul} << 150) + 6ul;
+    const auto lucas = [](const unsigned long n) {
+        Mpz r;
+        mpz_lucnum_ui(r.get_mpz_t(), n);
+        return r;
+    };
+    //word, full word, Montgomery & mpz_mod arithmetic against the full numbers
+    for(const Mpz& m : {Mpz{1ul}, Mpz{2ul}, Mpz{10ul}, word, top, odd, even}) {
+        for(const unsigned long n : {0ul, 1ul, 2ul, 3ul, 10ul, 63ul, 64ul, 1'000ul, 12'345ul}) {
+            const Mpz f = fib(n) % m, l = lucas(n) % m;
+            assert(fib_mod(n, m) == f && lucas_mod(n, m) == l);
+            //F(-n) = (-1)^(n+1) F(n), L(-n) = (-1)^n L(n)
+            const Mpz fn = n % 2 ? f : (m - f) % m, ln = n % 2 ? (m - l) % m : l;
+            assert(fib_mod(-Mpz{n}, m) == fn && lucas_mod(-Mpz{n}, m) == ln);
+        }
+    }
+
+    //indices far beyond the full numbers
+    const Mpz huge = (Mpz{1ul} << 1'000) + 7ul;
+    assert(fib_mod(huge, Mpz{10ul}) == fib(mpz_fdiv_ui(huge.get_mpz_t(), 60)) % 10ul); //Pisano period 60
+    for(const Mpz& m : {word, odd, even}) {
+        const Mpz f = fib_mod(huge, m), l = lucas_mod(huge, m);
+        assert(fib_mod(2ul * huge, m) == f * l % m);
+        assert((l*l - 5ul * f*f + 4ul) % m == 0l); //L^2 - 5F^2 = 4(-1)^n, n odd
+    }
+
+    //Tribonacci by iteration
+    const MpzRecurrence tribonacci{{Mpz{1ul}, Mpz{1ul}, Mpz{1ul}}, {Mpz{0ul}, Mpz{0ul}, Mpz{1ul}}, odd};
+    assert(tribonacci.order() == 3 && tribonacci.modulus() == odd);
+    Mpz a{0ul}, b{0ul}, c{1ul};
+    for(unsigned long n=0; n<500; ++n) {
+        assert(tribonacci(Mpz{n}) == a % odd);
+        Mpz d = a + b + c;
+        a = std::move(b);
+        b = std::move(c);
+        c = std::move(d);
+    }
+    //a(n) = 3a(n-1) - 2a(n-2) = 2^n with negative & unreduced coefficients
+    for(const Mpz& m : {Mpz{1ul}, word, odd, even}) {
+        const MpzRecurrence powers{{Mpz{3ul} + m, Mpz{-2l}}, {Mpz{1ul}, Mpz{2ul}}, m};
+        for(const unsigned long n : {0ul, 1ul, 2ul, 77ul, 1'000ul}) {
+            assert(powers(Mpz{n}) == powm(Mpz{2ul}, Mpz{n}, m));
+        }
+        assert(powers(huge) == powm(Mpz{2ul}, huge, m));
+        assert(MpzRecurrence({Mpz{1ul}, Mpz{1ul}}, {Mpz{0ul}, Mpz{1ul}}, m)(huge) == fib_mod(huge, m));
+    }
+    //order 1, a(n) = 3^n * 5
+    assert(MpzRecurrence({Mpz{3ul}}, {Mpz{5ul}}, word)(Mpz{100ul}) == powm(Mpz{3ul}, Mpz{100ul}, word) * 5ul % word);
+
+    //batches are the singles
+    MpzExecutor executor{4};
+    vector<Mpz> indices;
+    for(unsigned long i=0; i<40; ++i) {
+        indices.push_back((Mpz{i} << (5 * i)) - 17l * i);
+    }
+    for(const Mpz& m : {word, odd, even}) {
+        const vector<Mpz> f = fib_mod(indices, m, executor), l = lucas_mod(indices, m, executor);
+        for(size_t i=0; i<indices.size(); ++i) {
+            assert(f[i] == fib_mod(indices[i], m) && l[i] == lucas_mod(indices[i], m));
+        }
+    }
+    indices.erase(indices.begin() + 1, indices.begin() + 5); //the negative ones
+    const vector<Mpz> t = tribonacci(indices, executor);
+    for(size_t i=0; i<indices.size(); ++i) {
+        assert(t[i] == tribonacci(indices[i]));
+    }
+
+    const auto throws = [](const function<void()>& f) {
+        try {
+            f();
+        } catch(const invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    assert(throws([] { (void)fib_mod(5ul, Mpz{}); }) && throws([] { (void)lucas_mod(Mpz{5ul}, Mpz{-3l}); }));
+    assert(throws([] { MpzRecurrence({}, {}, Mpz{7ul}); }));
+    assert(throws([] { MpzRecurrence({Mpz{1ul}}, {Mpz{1ul}, Mpz{1ul}}, Mpz{7ul}); }));
+    assert(throws([] { MpzRecurrence({Mpz{1ul}}, {Mpz{1ul}}, Mpz{0ul}); }));
+    assert(throws([&] { (void)tribonacci(Mpz{-1l}); }));
+}
+
+void test_mpz_executor() {
+    cout << "Testing executor" << endl;
+    for(const unsigned int threads : {0u, 1u, 4u}) {
+        MpzExecutor executor{threads};
+        //nested groups, waiting threads help out
+        const function<unsigned long(unsigned long, unsigned long)> sum = [&](const unsigned long lo, const unsigned long hi) {
+            if(hi - lo < 1000) {
+                unsigned long s = 0;
+                for(unsigned long i=lo; i<hi; ++i) {
+                    s += i;
+                }
+                return s;
+            }
+            unsigned long a, b;
+            MpzTaskGroup group{executor};
+            group.run([&]() { a = sum(lo, (lo+hi)/2); });
+            b = sum((lo+hi)/2, hi);
+            group.wait();
+            return a + b;
+        };
+        assert(sum(0, 1'000'000) == 999'999ul*1'000'000/2);
+        //exceptions reach the waiter
+        MpzTaskGroup group{executor};
+        group.run([]() { throw runtime_error("task"); });
+        bool thrown = false;
+        try {
+            group.wait();
+        } catch(const runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+}
+
+void test_mpz_expr() {
+    random_device dev;
+    mt19937 rng(dev());
+    uniform_int_distribution<long> dist(-0xFFFF-1, 0xFFFF/2);
+    uniform_int_distribution<unsigned long> udist(0x00, 0xFF);
+
+    cout << "Testing expressions" << endl;
+    for(unsigned int i=0; i<1000; ++i) {
+        const Mpz a{dist(rng)}, b{dist(rng)}, c{dist(rng)}, d{dist(rng)}, e{dist(rng)};
+        const unsigned long k{udist(rng)};
+        Mpz x{dist(rng)}, y;
+
+        //evaluation into destination
+        y = lazy(a)*b + lazy(c)*d - e;
+        assert(y == a*b + c*d - e);
+        y = -(lazy(a) + b)*(lazy(c) - d);
+        assert(y == -(a+b)*(c-d));
+        y = k - lazy(a)*k + 1ul;
+        assert(y == k - a*k + 1ul);
+        const Mpz z = lazy(a)*b*c;
+        assert(z == a*b*c);
+
+        //fused accumulation
+        y = x;
+        x += lazy(a)*b;
+        assert(x == y + a*b);
+        y = x;
+        x -= lazy(a)*k;
+        assert(x == y - a*k);
+        y = x;
+        x += lazy(a)*(lazy(b) + c) - lazy(d)*e;
+        assert(x == y + a*(b+c) - d*e);
+
+        //aliasing destination
+        y = x;
+        x = lazy(a)*x + lazy(x)*b;
+        assert(x == a*y + y*b);
+        y = x;
+        x = lazy(x)*x - x;
+        assert(x == y*y - y);
+        y = x;
+        x = lazy(x)*(lazy(b) + c);
+        assert(x == y*(b+c));
+        y = x;
+        x += lazy(a) + x;
+        assert(x == y + a + y);
+        y = x;
+        x += lazy(a)*b + lazy(x)*c;
+        assert(x == y + a*b + y*c);
+        y = x;
+        x -= lazy(a) - x;
+        assert(x == y - (a - y));
+        y = x;
+        x -= lazy(x)*(lazy(a) + k) - lazy(b)*x;
+        assert(x == y - (y*(a+k) - b*y));
+    }
+}
+
+
+
+//runs with the pool installed, needs every other allocation to be freed
+void test_mpz_alloc() {
+    cout << "Testing pool & arena" << endl;
+    MpzPool::install();
+    {
+        const Mpz expected = fib(10'000) * fib(9'999);
+
+        Mpz a = fib(10'000);
+        a *= fib(9'999);
+        assert(a == expected);
+
+        Mpz kept;
+        {
+            MpzArena arena;
+            Mpz b = fib(10'000);
+            for(unsigned long i=0; i<100; ++i) {
+                b += b * i; //grows the last block in place
+                b /= i + 1;
+            }
+            const Mpz c = b * fib(9'999);
+            assert(c == expected);
+            assert(arena.bytes_used() > 0);
+
+            const MpzArena::Suspend s;
+            kept = c;
+            a += c; //a was allocated before the arena
+        }
+        assert(kept == expected && a == 2ul*expected);
+
+        //emptied chunks get reused, blocks freed from a nested arena & big ones from the pool
+        const Mpz m{"98765432109876543210987654321098765432109876543210"};
+        Mpz z{"123456789012345678901234567890123456789"};
+        for(unsigned long i=0; i<20'000; ++i) {
+            z = (z*z + z*i) % m + i;
+        }
+        {
+            MpzArena arena{1};
+            Mpz x{"123456789012345678901234567890123456789"};
+            for(unsigned long i=0; i<20'000; ++i) {
+                x = (x*x + x*i) % m + i;
+            }
+            assert(x == z);
+            optional<Mpz> outer = fib(5'000);
+            {
+                MpzArena inner{1};
+                const Mpz t = *outer * fib(100'000);
+                outer.reset();
+                assert(t / fib(100'000) == fib(5'000));
+            }
+            assert(x == z);
+        }
+
+        //caches filled inside an arena outlive it
+        const Mpz big = fib(400'000);
+        string digits(big.size_in_base(10) + 1, '\0');
+        mpz_get_str(digits.data(), 10, big.get_mpz_t());
+        digits.resize(digits.find('\0'));
+        Mpz y = big;
+        MpzMemo memo;
+        {
+            MpzArena arena;
+            assert(memo.fac(20'000) == fac(20'000) && memo.fib(100'000) == fib(100'000));
+            assert(big.to_string() == digits); //radix powers
+            const Mpz x = lazy(big)*(lazy(y) + 1ul) - lazy(y)*y; //scratch integers
+            {
+                const MpzArena::Suspend outer;
+                {
+                    const MpzArena::Suspend inner;
+                }
+                assert(!MpzArena::active());
+                kept = x;
+            }
+            assert(MpzArena::active());
+        }
+        assert(!MpzArena::active() && kept == big);
+        assert(memo.fac(20'000) == fac(20'000) && memo.fib(100'001) == fib(100'001));
+        assert(big.to_string() == digits);
+        y = lazy(big)*(lazy(y) + 1ul) - lazy(y)*y;
+        assert(y == big);
+    }
+    release_radix_powers();
+    MpzScratch::release();
+    MpzPool::trim();
+    MpzPool::uninstall();
+}
+
+
+
+
+void report_unfreed_memory() {
+    const MpzAllocSnapshot s = MpzAllocStats::snapshot();
+    if(!MpzAllocStats::enabled) {
+        cerr << "Allocation tracking disabled, build with MPZ_INSTRUMENT." << endl;
+    } else if(s.liveBlocks || s.liveBytes) {
+        cerr << "Memory leaks detected: " << s.liveBlocks << " blocks, " << s.liveBytes << " bytes" << endl;
     } else {
         cerr << "No memory leaks detected." << endl;
     }
@@ -289,22 +1647,40 @@ void report_unfreed_memory() {
 
 
 int main() {
-    mp_set_memory_functions(custom_alloc, custom_realloc, custom_free);
+    MpzAllocStats::install();
 
     test_mpz_add_sub();
     test_mpz_mul_div();
     test_mpz_pow();
+    test_mpz_powm();
+    test_mpz_small();
+    test_mpz_rvalue();
+    test_mpz_executor();
+    test_mpz_random();
+    test_mpz_prime();
+    test_mpz_montgomery();
+    test_batch_gcd();
+    test_mpz_range();
+    test_mpz_io();
+    test_mpz_io_input();
+    test_mpz_serial();
+    test_mpz_view();
+    test_mpz_vector();
+    test_mpz_map();
+    test_mpz_stats();
+    test_mpz_parallel_mul();
+    test_mpz_ntt();
+    test_mpz_special();
+    test_mpz_memo();
+    test_mpz_recurrence();
+    test_factorise();
+    test_mpz_expr();
 
-
-    {
-        const auto start{std::chrono::steady_clock::now()};
-        const Mpz f = fib(4'192'540);
-        const auto end{std::chrono::steady_clock::now()};
-        const std::chrono::duration<double> duration{end - start};
-        cout << f << endl;
-        cout << "Took " << duration.count() << " s." << endl;
-    }
+    MpzScratch::release();
+    release_radix_powers();
     report_unfreed_memory();
 
+    test_mpz_alloc();
+
     return 0;
 }
@@ -1,16 +1,115 @@
 #include "mpz.h"
+#include "mpz_io.h"
+#include "mpz_memo.h"
+#include "mpz_mul.h"
+#include "mpz_random.h"
+#include "mpz_special.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <typeinfo>
+#include <numeric>
+#include <utility>
+
+
+
+//Small value optimisation relies on GMP's lazy allocation (_mp_alloc == 0)
+#if __GNU_MP_RELEASE < 60200
+#error "Mpz requires GMP 6.2 or newer"
+#endif
+static_assert(GMP_NUMB_BITS == 64 && sizeof(mp_limb_t) == sizeof(unsigned long), "Mpz requires 64 bit limbs without nails");
+
+using i128 = __int128;
+using u128 = unsigned __int128;
+
+
+//Borrowed values of an MpzView have no allocation either, but more limbs
+bool Mpz::is_small() const {
+    return x->_mp_alloc == 0 && x->_mp_size >= -1 && x->_mp_size <= 1;
+}
+
+//GMP may leave a zero without limbs (or pointing to its own dummy limb)
+//in a small Mpz, so the inline limb only counts if the size is non zero
+mp_limb_t Mpz::small_limb() const {
+    return x->_mp_size ? limb : 0;
+}
+
+__int128 Mpz::small_value() const {
+    return x->_mp_size < 0 ? -static_cast<i128>(limb) : static_cast<i128>(small_limb());
+}
+
+void Mpz::init_small(const mp_limb_t m, const int s) {
+    limb = m;
+    x->_mp_alloc = 0;
+    x->_mp_size = m ? s : 0;
+    x->_mp_d = &limb;
+}
+
+void Mpz::set_small(const mp_limb_t m, const int s) {
+    if(is_small()) {
+        limb = m;
+        x->_mp_d = &limb;
+    } else {
+        x->_mp_d[0] = m; //a heap buffer always holds at least one limb
+    }
+    x->_mp_size = m ? s : 0;
+}
+
+void Mpz::set_wide(const u128 m, const int s) {
+    if(!(m >> GMP_NUMB_BITS)) {
+        set_small(static_cast<mp_limb_t>(m), s);
+        return;
+    }
+    if(x->_mp_alloc < 2) {
+        mpz_realloc2(x, 2*GMP_NUMB_BITS);
+    }
+    x->_mp_d[0] = static_cast<mp_limb_t>(m);
+    x->_mp_d[1] = static_cast<mp_limb_t>(m >> GMP_NUMB_BITS);
+    x->_mp_size = 2*s;
+}
+
+void Mpz::set_wide(const i128 v) {
+    if(v < 0) {
+        set_wide(-static_cast<u128>(v), -1);
+    } else {
+        set_wide(static_cast<u128>(v), +1);
+    }
+}
+
+void Mpz::promote() {
+    if(is_small()) {
+        const int s = x->_mp_size;
+        mpz_init2(x, 2*GMP_NUMB_BITS);
+        x->_mp_d[0] = limb;
+        x->_mp_size = s;
+    }
+}
+
+static mp_limb_t abs_ul(const long n) {
+    return n < 0 ? -static_cast<unsigned long>(n) : n;
+}
+
+static int sgn_ul(const long n) {
+    return (n > 0) - (n < 0);
+}
+
+static int cmp(const i128 a, const i128 b) {
+    return (a > b) - (a < b);
+}
 
 
 
 Mpz::Mpz() {
-    mpz_init(x);
+    init_small(0, 0);
 }
 
 Mpz::Mpz(const long n) {
-    mpz_init_set_si(x, n);
+    init_small(abs_ul(n), sgn_ul(n));
 }
 Mpz::Mpz(const unsigned long n) {
-    mpz_init_set_ui(x, n);
+    init_small(n, 1);
 }
 
 Mpz::Mpz(const std::string& s) {
@@ -25,11 +124,19 @@ Mpz::Mpz(const mpz_t& x) {
 }
 
 Mpz::Mpz(const Mpz& other) {
-    mpz_init_set(x, other.x);
+    if(other.is_small()) {
+        init_small(other.small_limb(), other.x->_mp_size);
+    } else {
+        mpz_init_set(x, other.x);
+    }
 }
-Mpz::Mpz(Mpz&& other) {
-    mpz_init(x);
-    mpz_swap(x, other.x);
+Mpz::Mpz(Mpz&& other) noexcept {
+    if(other.is_small()) {
+        init_small(other.small_limb(), other.x->_mp_size);
+    } else {
+        *x = *other.x;
+        other.init_small(0, 0);
+    }
 }
 
 Mpz::~Mpz() {
@@ -38,41 +145,41 @@ Mpz::~Mpz() {
 
 
 void Mpz::realloc() const {
+    if(x->_mp_alloc == 0) {
+        return;
+    }
     mpz_realloc2((mpz_ptr)&x, size_in_base());
 }
 
 
 Mpz& Mpz::operator=(const Mpz& other) {
     if(this != &other) {
-        mpz_set(x, other.x);
+        if(other.is_small()) {
+            set_small(other.small_limb(), other.x->_mp_size);
+        } else {
+            mpz_set(x, other.x);
+        }
     }
     return *this;
 }
-Mpz& Mpz::operator=(Mpz&& other) {
+Mpz& Mpz::operator=(Mpz&& other) noexcept {
     if(this != &other) {
-        mpz_swap(x, other.x);
+        if(other.is_small()) {
+            set_small(other.small_limb(), other.x->_mp_size);
+        } else if(is_small()) {
+            *x = *other.x;
+            other.init_small(0, 0);
+        } else {
+            std::swap(*x, *other.x);
+        }
     }
     return *this;
 }
 
 
 
-gmp_randstate_t Mpz::randState;
-bool Mpz::isRandStateInitialized = false;
-
 Mpz Mpz::rand(const Mpz& n) {
-    if(sgn(n) < 0) {
-        throw std::invalid_argument("Upper bound must be positive");
-    }
-    if(!isRandStateInitialized) {
-        gmp_randinit_default(randState);
-        gmp_randseed_ui(randState, static_cast<unsigned long>(std::time(nullptr)));
-        isRandStateInitialized = true;
-    }
-
-    Mpz x;
-    mpz_urandomm(x.x, randState, n.x);
-    return x;
+    return MpzRandom::local().below(n);
 }
 
 
@@ -126,13 +233,31 @@ Mpz::operator double() const {
 }
 
 std::string Mpz::to_string(const int base) const {
-    std::string s;
-    s.resize(size_in_base(base)+2);
-    mpz_get_str(&s[0], base, x);
-    s.resize(strlen(s.c_str()));
+    //mpz_get_str's bases, negative ones for upper case digits
+    if(!(2 <= base && base <= 62) && !(-36 <= base && base <= -2)) {
+        throw std::invalid_argument("Mpz::to_string: base must be in [2, 62] or [-36, -2]");
+    }
+    //room for the sign & mpz_get_str's terminating zero,
+    //size_in_base might be one too big
+    const std::size_t n = size_in_base(std::abs(base)) + (sgn(*this) < 0);
+    std::string s(n + 1, '\0');
+    if(base >= 2 && n > std::size_t{1} << 16) {
+        s.resize(to_chars(s.data(), s.data() + s.size(), *this, base).ptr - s.data());
+        return s;
+    }
+    mpz_get_str(s.data(), base, x);
+    s.resize(s[n-1] ? n : n-1);
     return s;
 }
 
+mpz_srcptr Mpz::get_mpz_t() const {
+    return x;
+}
+mpz_ptr Mpz::get_mpz_t() {
+    promote();
+    return x;
+}
+
 
 
 Mpz::operator bool() const {
@@ -167,13 +292,22 @@ int operator<=>(const unsigned long lhs, const Mpz& rhs) {
 }
 
 int operator<=>(const Mpz& lhs, const long rhs) {
+    if(lhs.is_small()) {
+        return cmp(lhs.small_value(), rhs);
+    }
     return mpz_cmp_si(lhs.x, rhs);
 }
 int operator<=>(const Mpz& lhs, const unsigned long rhs) {
+    if(lhs.is_small()) {
+        return cmp(lhs.small_value(), rhs);
+    }
     return mpz_cmp_ui(lhs.x, rhs);
 }
 
 int operator<=>(const Mpz& lhs, const Mpz& rhs) {
+    if(lhs.is_small() && rhs.is_small()) {
+        return cmp(lhs.small_value(), rhs.small_value());
+    }
     return mpz_cmp(lhs.x, rhs.x);
 }
 
@@ -187,10 +321,18 @@ int sgn(const Mpz& s) {
 //Arithmetic
 Mpz operator-(const Mpz& x) {
     Mpz r;
-    mpz_neg(r.x, x.x);
+    if(x.is_small()) {
+        r.set_small(x.small_limb(), -x.x->_mp_size);
+    } else {
+        mpz_neg(r.x, x.x);
+    }
     return r;
 }
 
+Mpz operator-(Mpz&& x) {
+    x.negate();
+    return std::move(x);
+}
 
 //+
 //https://en.cppreference.com/w/cpp/language/operators
@@ -205,22 +347,46 @@ Mpz operator+(const unsigned long lhs, const Mpz& rhs) {
 
 Mpz operator+(const Mpz& lhs, const unsigned long rhs) {
     Mpz r;
-    mpz_add_ui(r.x, lhs.x, rhs);
+    r.set_add(lhs, rhs);
     return r;
 }
 Mpz operator+(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_add(r.x, lhs.x, rhs.x);
+    r.set_add(lhs, rhs);
     return r;
 }
 
+Mpz operator+(const unsigned long lhs, Mpz&& rhs) {
+    rhs += lhs;
+    return std::move(rhs);
+}
+Mpz operator+(Mpz&& lhs, const unsigned long rhs) {
+    lhs += rhs;
+    return std::move(lhs);
+}
+Mpz operator+(Mpz&& lhs, const Mpz& rhs) {
+    lhs += rhs;
+    return std::move(lhs);
+}
+Mpz operator+(const Mpz& lhs, Mpz&& rhs) {
+    rhs += lhs;
+    return std::move(rhs);
+}
+//both expire, keep the larger buffer
+Mpz operator+(Mpz&& lhs, Mpz&& rhs) {
+    if(rhs.x->_mp_alloc > lhs.x->_mp_alloc) {
+        rhs += lhs;
+        return std::move(rhs);
+    }
+    lhs += rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator+=(const unsigned long other) {
-    mpz_add_ui(x, x, other);
-    return *this;
+    return set_add(*this, other);
 }
 Mpz& Mpz::operator+=(const Mpz& other) {
-    mpz_add(x, x, other.x);
-    return *this;
+    return set_add(*this, other);
 }
 
 Mpz& Mpz::operator++() {
@@ -236,27 +402,55 @@ Mpz Mpz::operator++(const int n) {
 
 Mpz operator-(const unsigned long lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_ui_sub(r.x, lhs, rhs.x);
+    if(rhs.is_small()) {
+        r.set_wide(static_cast<i128>(lhs) - rhs.small_value());
+    } else {
+        mpz_ui_sub(r.x, lhs, rhs.x);
+    }
     return r;
 }
 Mpz operator-(const Mpz& lhs, const unsigned long rhs) {
     Mpz r;
-    mpz_sub_ui(r.x, lhs.x, rhs);
+    r.set_sub(lhs, rhs);
     return r;
 }
 Mpz operator-(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_sub(r.x, lhs.x, rhs.x);
+    r.set_sub(lhs, rhs);
     return r;
 }
 
+Mpz operator-(const unsigned long lhs, Mpz&& rhs) {
+    rhs -= lhs;
+    rhs.negate();
+    return std::move(rhs);
+}
+Mpz operator-(Mpz&& lhs, const unsigned long rhs) {
+    lhs -= rhs;
+    return std::move(lhs);
+}
+Mpz operator-(Mpz&& lhs, const Mpz& rhs) {
+    lhs -= rhs;
+    return std::move(lhs);
+}
+Mpz operator-(const Mpz& lhs, Mpz&& rhs) {
+    rhs.set_sub(lhs, rhs);
+    return std::move(rhs);
+}
+Mpz operator-(Mpz&& lhs, Mpz&& rhs) {
+    if(rhs.x->_mp_alloc > lhs.x->_mp_alloc) {
+        rhs.set_sub(lhs, rhs);
+        return std::move(rhs);
+    }
+    lhs -= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator-=(const unsigned long other) {
-    mpz_sub_ui(x, x, other);
-    return *this;
+    return set_sub(*this, other);
 }
 Mpz& Mpz::operator-=(const Mpz& other) {
-    mpz_sub(x, x, other.x);
-    return *this;
+    return set_sub(*this, other);
 }
 
 Mpz& Mpz::operator--() {
@@ -279,72 +473,305 @@ Mpz operator*(const unsigned long lhs, const Mpz& rhs) {
 
 Mpz operator*(const Mpz& lhs, const long rhs) {
     Mpz r;
-    mpz_mul_si(r.x, lhs.x, rhs);
+    if(lhs.is_small()) {
+        r.set_wide(static_cast<u128>(lhs.small_limb())*abs_ul(rhs), lhs.x->_mp_size*sgn_ul(rhs));
+    } else {
+        mpz_mul_si(r.x, lhs.x, rhs);
+    }
     return r;
 }
 Mpz operator*(const Mpz& lhs, const unsigned long rhs) {
     Mpz r;
-    mpz_mul_ui(r.x, lhs.x, rhs);
+    r.set_mul(lhs, rhs);
     return r;
 }
 Mpz operator*(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_mul(r.x, lhs.x, rhs.x);
+    r.set_mul(lhs, rhs);
     return r;
 }
 
+Mpz operator*(const long lhs, Mpz&& rhs) {
+    rhs *= lhs;
+    return std::move(rhs);
+}
+Mpz operator*(const unsigned long lhs, Mpz&& rhs) {
+    rhs *= lhs;
+    return std::move(rhs);
+}
+Mpz operator*(Mpz&& lhs, const long rhs) {
+    lhs *= rhs;
+    return std::move(lhs);
+}
+Mpz operator*(Mpz&& lhs, const unsigned long rhs) {
+    lhs *= rhs;
+    return std::move(lhs);
+}
+Mpz operator*(Mpz&& lhs, const Mpz& rhs) {
+    lhs *= rhs;
+    return std::move(lhs);
+}
+Mpz operator*(const Mpz& lhs, Mpz&& rhs) {
+    rhs *= lhs;
+    return std::move(rhs);
+}
+Mpz operator*(Mpz&& lhs, Mpz&& rhs) {
+    if(rhs.x->_mp_alloc > lhs.x->_mp_alloc) {
+        rhs *= lhs;
+        return std::move(rhs);
+    }
+    lhs *= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator*=(const long other) {
-    mpz_mul_si(x, x, other);
+    if(is_small()) {
+        set_wide(static_cast<u128>(small_limb())*abs_ul(other), x->_mp_size*sgn_ul(other));
+    } else {
+        mpz_mul_si(x, x, other);
+    }
     return *this;
 }
 Mpz& Mpz::operator*=(const unsigned long other) {
-    mpz_mul_ui(x, x, other);
-    return *this;
+    return set_mul(*this, other);
 }
 Mpz& Mpz::operator*=(const Mpz& other) {
-    mpz_mul(x, x, other.x);
-    return *this;
+    return set_mul(*this, other);
 }
 
 
+//truncating division: quotient sign lhs*rhs, remainder sign lhs
 Mpz operator/(const Mpz& lhs, const unsigned long rhs) {
     Mpz r;
-    mpz_tdiv_q_ui(r.x, lhs.x, rhs);
+    if(lhs.is_small()) {
+        r.set_small(lhs.small_limb() / rhs, lhs.x->_mp_size);
+    } else {
+        mpz_tdiv_q_ui(r.x, lhs.x, rhs);
+    }
     return r;
 }
 Mpz operator/(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_tdiv_q(r.x, lhs.x, rhs.x);
+    if(lhs.is_small() && rhs.is_small()) {
+        r.set_small(lhs.small_limb() / rhs.small_limb(), lhs.x->_mp_size*rhs.x->_mp_size);
+    } else {
+        mpz_tdiv_q(r.x, lhs.x, rhs.x);
+    }
     return r;
 }
 
+Mpz operator/(Mpz&& lhs, const unsigned long rhs) {
+    lhs /= rhs;
+    return std::move(lhs);
+}
+Mpz operator/(Mpz&& lhs, const Mpz& rhs) {
+    lhs /= rhs;
+    return std::move(lhs);
+}
+Mpz operator/(const Mpz& lhs, Mpz&& rhs) {
+    if(lhs.is_small() && rhs.is_small()) {
+        rhs.set_small(lhs.small_limb() / rhs.small_limb(), lhs.x->_mp_size*rhs.x->_mp_size);
+    } else {
+        rhs.promote();
+        mpz_tdiv_q(rhs.x, lhs.x, rhs.x);
+    }
+    return std::move(rhs);
+}
+Mpz operator/(Mpz&& lhs, Mpz&& rhs) {
+    lhs /= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator/=(const unsigned long other) {
-    mpz_tdiv_q_ui(x, x, other);
+    if(is_small()) {
+        set_small(small_limb() / other, x->_mp_size);
+    } else {
+        mpz_tdiv_q_ui(x, x, other);
+    }
     return *this;
 }
 Mpz& Mpz::operator/=(const Mpz& other) {
-    mpz_tdiv_q(x, x, other.x);
+    if(is_small() && other.is_small()) {
+        set_small(small_limb() / other.small_limb(), x->_mp_size*other.x->_mp_size);
+    } else {
+        promote();
+        mpz_tdiv_q(x, x, other.x);
+    }
     return *this;
 }
 
 
+//a remainder by a single small_limb() is itself small, mpz_tdiv_ui doesn't allocate
 Mpz operator%(const Mpz& lhs, const unsigned long rhs) {
     Mpz r;
-    mpz_tdiv_r_ui(r.x, lhs.x, rhs);
+    r.set_small(lhs.is_small() ? lhs.small_limb() % rhs : mpz_tdiv_ui(lhs.x, rhs), sgn(lhs));
     return r;
 }
 Mpz operator%(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_tdiv_r(r.x, lhs.x, rhs.x);
+    if(rhs.is_small()) {
+        r.set_small(lhs.is_small() ? lhs.small_limb() % rhs.small_limb() : mpz_tdiv_ui(lhs.x, rhs.small_limb()), sgn(lhs));
+    } else {
+        mpz_tdiv_r(r.x, lhs.x, rhs.x);
+    }
     return r;
 }
 
+Mpz operator%(Mpz&& lhs, const unsigned long rhs) {
+    lhs %= rhs;
+    return std::move(lhs);
+}
+Mpz operator%(Mpz&& lhs, const Mpz& rhs) {
+    lhs %= rhs;
+    return std::move(lhs);
+}
+Mpz operator%(const Mpz& lhs, Mpz&& rhs) {
+    if(rhs.is_small()) {
+        rhs.set_small(lhs.is_small() ? lhs.small_limb() % rhs.small_limb() : mpz_tdiv_ui(lhs.x, rhs.small_limb()), sgn(lhs));
+    } else {
+        mpz_tdiv_r(rhs.x, lhs.x, rhs.x);
+    }
+    return std::move(rhs);
+}
+Mpz operator%(Mpz&& lhs, Mpz&& rhs) {
+    lhs %= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator%=(const unsigned long other) {
-    mpz_tdiv_r_ui(x, x, other);
+    set_small(is_small() ? small_limb() % other : mpz_tdiv_ui(x, other), sgn(*this));
     return *this;
 }
 Mpz& Mpz::operator%=(const Mpz& other) {
-    mpz_tdiv_r(x, x, other.x);
+    if(other.is_small()) {
+        set_small(is_small() ? small_limb() % other.small_limb() : mpz_tdiv_ui(x, other.small_limb()), sgn(*this));
+    } else {
+        promote();
+        mpz_tdiv_r(x, x, other.x);
+    }
+    return *this;
+}
+
+
+//small operands are combined natively in 128 bits,
+//GMP's in place writes need *this promoted if it's also an operand
+Mpz& Mpz::set_add(const Mpz& a, const Mpz& b) {
+    if(a.is_small() && b.is_small()) {
+        set_wide(a.small_value() + b.small_value());
+    } else {
+        if(this == &a || this == &b) {
+            promote();
+        }
+        mpz_add(x, a.x, b.x);
+    }
+    return *this;
+}
+Mpz& Mpz::set_add(const Mpz& a, const unsigned long b) {
+    if(a.is_small()) {
+        set_wide(a.small_value() + b);
+    } else {
+        mpz_add_ui(x, a.x, b);
+    }
+    return *this;
+}
+
+Mpz& Mpz::set_sub(const Mpz& a, const Mpz& b) {
+    if(a.is_small() && b.is_small()) {
+        set_wide(a.small_value() - b.small_value());
+    } else {
+        if(this == &a || this == &b) {
+            promote();
+        }
+        mpz_sub(x, a.x, b.x);
+    }
+    return *this;
+}
+Mpz& Mpz::set_sub(const Mpz& a, const unsigned long b) {
+    if(a.is_small()) {
+        set_wide(a.small_value() - b);
+    } else {
+        mpz_sub_ui(x, a.x, b);
+    }
+    return *this;
+}
+
+Mpz& Mpz::set_mul(const Mpz& a, const Mpz& b) {
+    if(a.is_small() && b.is_small()) {
+        set_wide(static_cast<u128>(a.small_limb())*b.small_limb(), a.x->_mp_size*b.x->_mp_size);
+    } else {
+        if(this == &a || this == &b) {
+            promote();
+        }
+        multiply(x, a.x, b.x);
+    }
+    return *this;
+}
+Mpz& Mpz::set_mul(const Mpz& a, const unsigned long b) {
+    if(a.is_small()) {
+        set_wide(static_cast<u128>(a.small_limb())*b, a.x->_mp_size);
+    } else {
+        mpz_mul_ui(x, a.x, b);
+    }
+    return *this;
+}
+
+//|a*b| < 2^126 leaves room for the accumulator in a signed 128 bit sum
+Mpz& Mpz::addmul(const Mpz& a, const Mpz& b) {
+    if(is_small() && a.is_small() && b.is_small()) {
+        const u128 p = static_cast<u128>(a.small_limb())*b.small_limb();
+        if(!(p >> 126)) {
+            const i128 v = a.x->_mp_size*b.x->_mp_size < 0 ? -static_cast<i128>(p) : static_cast<i128>(p);
+            set_wide(small_value() + v);
+            return *this;
+        }
+    }
+    promote();
+    mpz_addmul(x, a.x, b.x);
+    return *this;
+}
+Mpz& Mpz::addmul(const Mpz& a, const unsigned long b) {
+    if(is_small() && a.is_small()) {
+        const u128 p = static_cast<u128>(a.small_limb())*b;
+        if(!(p >> 126)) {
+            const i128 v = a.x->_mp_size < 0 ? -static_cast<i128>(p) : static_cast<i128>(p);
+            set_wide(small_value() + v);
+            return *this;
+        }
+    }
+    promote();
+    mpz_addmul_ui(x, a.x, b);
+    return *this;
+}
+
+Mpz& Mpz::submul(const Mpz& a, const Mpz& b) {
+    if(is_small() && a.is_small() && b.is_small()) {
+        const u128 p = static_cast<u128>(a.small_limb())*b.small_limb();
+        if(!(p >> 126)) {
+            const i128 v = a.x->_mp_size*b.x->_mp_size < 0 ? -static_cast<i128>(p) : static_cast<i128>(p);
+            set_wide(small_value() - v);
+            return *this;
+        }
+    }
+    promote();
+    mpz_submul(x, a.x, b.x);
+    return *this;
+}
+Mpz& Mpz::submul(const Mpz& a, const unsigned long b) {
+    if(is_small() && a.is_small()) {
+        const u128 p = static_cast<u128>(a.small_limb())*b;
+        if(!(p >> 126)) {
+            const i128 v = a.x->_mp_size < 0 ? -static_cast<i128>(p) : static_cast<i128>(p);
+            set_wide(small_value() - v);
+            return *this;
+        }
+    }
+    promote();
+    mpz_submul_ui(x, a.x, b);
+    return *this;
+}
+
+Mpz& Mpz::negate() {
+    mpz_neg(x, x); //only flips the sign in place, fine for small values too
     return *this;
 }
 
@@ -353,60 +780,173 @@ Mpz& Mpz::operator%=(const Mpz& other) {
 
 Mpz operator&(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_and(r.x, lhs.x, rhs.x);
+    if(lhs.is_small() && rhs.is_small()) {
+        r.set_wide(lhs.small_value() & rhs.small_value());
+    } else {
+        mpz_and(r.x, lhs.x, rhs.x);
+    }
     return r;
 }
 
+Mpz operator&(Mpz&& lhs, const Mpz& rhs) {
+    lhs &= rhs;
+    return std::move(lhs);
+}
+Mpz operator&(const Mpz& lhs, Mpz&& rhs) {
+    rhs &= lhs;
+    return std::move(rhs);
+}
+Mpz operator&(Mpz&& lhs, Mpz&& rhs) {
+    if(rhs.x->_mp_alloc > lhs.x->_mp_alloc) {
+        rhs &= lhs;
+        return std::move(rhs);
+    }
+    lhs &= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator&=(const Mpz& other) {
-    mpz_and(x, x, other.x);
+    if(is_small() && other.is_small()) {
+        set_wide(small_value() & other.small_value());
+    } else {
+        promote();
+        mpz_and(x, x, other.x);
+    }
     return *this;
 }
 
 
 Mpz operator|(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_ior(r.x, lhs.x, rhs.x);
+    if(lhs.is_small() && rhs.is_small()) {
+        r.set_wide(lhs.small_value() | rhs.small_value());
+    } else {
+        mpz_ior(r.x, lhs.x, rhs.x);
+    }
     return r;
 }
 
+Mpz operator|(Mpz&& lhs, const Mpz& rhs) {
+    lhs |= rhs;
+    return std::move(lhs);
+}
+Mpz operator|(const Mpz& lhs, Mpz&& rhs) {
+    rhs |= lhs;
+    return std::move(rhs);
+}
+Mpz operator|(Mpz&& lhs, Mpz&& rhs) {
+    if(rhs.x->_mp_alloc > lhs.x->_mp_alloc) {
+        rhs |= lhs;
+        return std::move(rhs);
+    }
+    lhs |= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator|=(const Mpz& other) {
-    mpz_ior(x, x, other.x);
+    if(is_small() && other.is_small()) {
+        set_wide(small_value() | other.small_value());
+    } else {
+        promote();
+        mpz_ior(x, x, other.x);
+    }
     return *this;
 }
 
 
 Mpz operator^(const Mpz& lhs, const Mpz& rhs) {
     Mpz r;
-    mpz_xor(r.x, lhs.x, rhs.x);
+    if(lhs.is_small() && rhs.is_small()) {
+        r.set_wide(lhs.small_value() ^ rhs.small_value());
+    } else {
+        mpz_xor(r.x, lhs.x, rhs.x);
+    }
     return r;
 }
 
+Mpz operator^(Mpz&& lhs, const Mpz& rhs) {
+    lhs ^= rhs;
+    return std::move(lhs);
+}
+Mpz operator^(const Mpz& lhs, Mpz&& rhs) {
+    rhs ^= lhs;
+    return std::move(rhs);
+}
+Mpz operator^(Mpz&& lhs, Mpz&& rhs) {
+    if(rhs.x->_mp_alloc > lhs.x->_mp_alloc) {
+        rhs ^= lhs;
+        return std::move(rhs);
+    }
+    lhs ^= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator^=(const Mpz& other) {
-    mpz_xor(x, x, other.x);
+    if(is_small() && other.is_small()) {
+        set_wide(small_value() ^ other.small_value());
+    } else {
+        promote();
+        mpz_xor(x, x, other.x);
+    }
     return *this;
 }
 
 
 Mpz operator<<(const Mpz& lhs, const unsigned long rhs) {
     Mpz r;
-    mpz_mul_2exp(r.x, lhs.x, rhs);
+    if(lhs.is_small() && rhs < GMP_NUMB_BITS) {
+        r.set_wide(static_cast<u128>(lhs.small_limb()) << rhs, lhs.x->_mp_size);
+    } else {
+        mpz_mul_2exp(r.x, lhs.x, rhs);
+    }
     return r;
 }
 
+Mpz operator<<(Mpz&& lhs, const unsigned long rhs) {
+    lhs <<= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator<<=(const unsigned long rhs) {
-    mpz_mul_2exp(x, x, rhs);
+    if(is_small() && rhs < GMP_NUMB_BITS) {
+        set_wide(static_cast<u128>(small_limb()) << rhs, x->_mp_size);
+    } else {
+        promote();
+        mpz_mul_2exp(x, x, rhs);
+    }
     return *this;
 }
 
 
+//floor division, negative values round towards -inf
+static mp_limb_t fdiv_2exp(const mp_limb_t m, const int s, const unsigned long n) {
+    if(n >= GMP_NUMB_BITS) {
+        return s < 0;
+    }
+    return (m >> n) + (s < 0 && (m & ((mp_limb_t{1} << n) - 1)));
+}
+
 Mpz operator>>(const Mpz& lhs, const unsigned long rhs) {
     Mpz r;
-    mpz_fdiv_q_2exp(r.x, lhs.x, rhs);
+    if(lhs.is_small()) {
+        r.set_small(fdiv_2exp(lhs.small_limb(), lhs.x->_mp_size, rhs), lhs.x->_mp_size);
+    } else {
+        mpz_fdiv_q_2exp(r.x, lhs.x, rhs);
+    }
     return r;
 }
 
+Mpz operator>>(Mpz&& lhs, const unsigned long rhs) {
+    lhs >>= rhs;
+    return std::move(lhs);
+}
+
 Mpz& Mpz::operator>>=(const unsigned long rhs) {
-    mpz_fdiv_q_2exp(x, x, rhs);
+    if(is_small()) {
+        set_small(fdiv_2exp(small_limb(), x->_mp_size, rhs), x->_mp_size);
+    } else {
+        mpz_fdiv_q_2exp(x, x, rhs);
+    }
     return *this;
 }
 
@@ -415,34 +955,79 @@ Mpz& Mpz::operator>>=(const unsigned long rhs) {
 //Functions
 Mpz abs(const Mpz& x) {
     Mpz r;
-    mpz_abs(r.x, x.x);
+    if(x.is_small()) {
+        r.set_small(x.small_limb(), 1);
+    } else {
+        mpz_abs(r.x, x.x);
+    }
     return r;
 }
+Mpz abs(Mpz&& x) {
+    if(x.is_small()) {
+        x.set_small(x.small_limb(), 1);
+    } else {
+        mpz_abs(x.x, x.x);
+    }
+    return std::move(x);
+}
 
 
 Mpz pow(const Mpz& b, const unsigned long e) {
     Mpz r;
-    mpz_pow_ui(r.x, b.x, e);
+    power(r.x, b.x, e);
     return r;
 }
+Mpz pow(Mpz&& b, const unsigned long e) {
+    b.promote();
+    power(b.x, b.x, e);
+    return std::move(b);
+}
 
-Mpz pow(Mpz b, Mpz e) {
+Mpz pow(Mpz b, const Mpz& e) {
     if(sgn(e) < 0) {
         throw std::invalid_argument("Mpz::pow: negative power");
     }
-    if(b==0l && e!=0l) {
-        return Mpz{};
+    if(e.fits_ul()) {
+        return pow(std::move(b), static_cast<unsigned long>(e));
+    }
+    //any other base overflows memory
+    if(b == 0l || b == 1l) {
+        return b;
     }
+    if(b == -1l) {
+        return e.is_odd() ? b : Mpz{1l};
+    }
+    throw std::overflow_error("Mpz::pow: result too large");
+}
 
-    Mpz result{1l};
-    while(e > 0l) {
-        if(e % 2) {
-            result *= b;
-        }
-        b *= b;
-        e /= 2;
+Mpz powm(const Mpz& b, const Mpz& e, const Mpz& m) {
+    if(!m) {
+        throw std::invalid_argument("Mpz::powm: zero modulus");
     }
-    return result;
+    Mpz r;
+    if(sgn(e) < 0 && !mpz_invert(r.x, b.x, m.x)) {
+        throw std::invalid_argument("Mpz::powm: base not invertible");
+    }
+    mpz_powm(r.x, b.x, e.x, m.x);
+    return r;
+}
+
+Mpz powm(const Mpz& b, const unsigned long e, const Mpz& m) {
+    if(!m) {
+        throw std::invalid_argument("Mpz::powm: zero modulus");
+    }
+    Mpz r;
+    mpz_powm_ui(r.x, b.x, e, m.x);
+    return r;
+}
+
+Mpz powm_sec(const Mpz& b, const Mpz& e, const Mpz& m) {
+    if(sgn(e) <= 0 || m.is_even()) {
+        throw std::invalid_argument("Mpz::powm_sec: needs a positive power and an odd modulus");
+    }
+    Mpz r;
+    mpz_powm_sec(r.x, b.x, e.x, m.x);
+    return r;
 }
 
 Mpz powul(const unsigned long b, const unsigned long e) {
@@ -457,26 +1042,69 @@ Mpz root(const Mpz& x, const unsigned long n) {
     mpz_root(r.x, x.x, n);
     return r;
 }
+Mpz root(Mpz&& x, const unsigned long n) {
+    x.promote();
+    mpz_root(x.x, x.x, n);
+    return std::move(x);
+}
 
 Mpz sqrt(const Mpz& x) {
     Mpz r;
     mpz_sqrt(r.x, x.x);
     return r;
 }
+Mpz sqrt(Mpz&& x) {
+    x.promote();
+    mpz_sqrt(x.x, x.x);
+    return std::move(x);
+}
 
 
 Mpz gcd(const Mpz& a, const Mpz& b) {
     Mpz r;
-    mpz_gcd(r.x, a.x, b.x);
+    if(a.is_small() && b.is_small()) {
+        r.set_small(std::gcd(a.small_limb(), b.small_limb()), 1);
+    } else {
+        mpz_gcd(r.x, a.x, b.x);
+    }
     return r;
 }
 
 Mpz gcd(const Mpz& a, const unsigned long b) {
     Mpz r;
-    mpz_gcd_ui(r.x, a.x, b);
+    if(a.is_small()) {
+        r.set_small(std::gcd(a.small_limb(), b), 1);
+    } else {
+        mpz_gcd_ui(r.x, a.x, b);
+    }
     return r;
 }
 
+Mpz gcd(Mpz&& a, const Mpz& b) {
+    if(a.is_small() && b.is_small()) {
+        a.set_small(std::gcd(a.small_limb(), b.small_limb()), 1);
+    } else {
+        a.promote();
+        mpz_gcd(a.x, a.x, b.x);
+    }
+    return std::move(a);
+}
+Mpz gcd(const Mpz& a, Mpz&& b) {
+    return gcd(std::move(b), a);
+}
+Mpz gcd(Mpz&& a, Mpz&& b) {
+    return gcd(std::move(a), std::as_const(b));
+}
+
+Mpz gcd(Mpz&& a, const unsigned long b) {
+    if(a.is_small()) {
+        a.set_small(std::gcd(a.small_limb(), b), 1);
+    } else {
+        mpz_gcd_ui(a.x, a.x, b);
+    }
+    return std::move(a);
+}
+
 
 Mpz lcm(const Mpz& a, const Mpz& b) {
     Mpz r;
@@ -490,16 +1118,236 @@ Mpz lcm(const Mpz& a, const unsigned long b) {
     return r;
 }
 
+Mpz lcm(Mpz&& a, const Mpz& b) {
+    a.promote();
+    mpz_lcm(a.x, a.x, b.x);
+    return std::move(a);
+}
+Mpz lcm(const Mpz& a, Mpz&& b) {
+    return lcm(std::move(b), a);
+}
+Mpz lcm(Mpz&& a, Mpz&& b) {
+    return lcm(std::move(a), std::as_const(b));
+}
+
+Mpz lcm(Mpz&& a, const unsigned long b) {
+    a.promote();
+    mpz_lcm_ui(a.x, a.x, b);
+    return std::move(a);
+}
+
+
+//Primality
+//https://en.wikipedia.org/wiki/Baillie%E2%80%93PSW_primality_test
+static mp_limb_t mulmod(const mp_limb_t a, const mp_limb_t b, const mp_limb_t n) {
+    return static_cast<mp_limb_t>(static_cast<u128>(a) * b % n);
+}
+
+static mp_limb_t powmod(mp_limb_t b, mp_limb_t e, const mp_limb_t n) {
+    mp_limb_t r = 1;
+    for(; e; e>>=1) {
+        if(e & 1) {
+            r = mulmod(r, b, n);
+        }
+        b = mulmod(b, b, n);
+    }
+    return r;
+}
+
+//Strong probable prime test of an odd n > 3 to base a, bases that are
+//multiples of n pass
+static bool is_sprp(const mp_limb_t n, const mp_limb_t a) {
+    if(a % n == 0) {
+        return true;
+    }
+    const int s = std::countr_zero(n - 1);
+    mp_limb_t y = powmod(a % n, (n - 1) >> s, n);
+    if(y == 1 || y == n - 1) {
+        return true;
+    }
+    for(int r=1; r<s; ++r) {
+        y = mulmod(y, y, n);
+        if(y == n - 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_sprp(const mpz_srcptr n, const mpz_srcptr a) {
+    Mpz D, Y;
+    const mpz_ptr d = D.get_mpz_t(), y = Y.get_mpz_t();
+    mpz_sub_ui(d, n, 1);
+    const mp_bitcnt_t s = mpz_scan1(d, 0);
+    mpz_tdiv_q_2exp(d, d, s);
+    mpz_powm(y, a, d, n);
+    mpz_add_ui(d, y, 1);
+    if(mpz_cmp_ui(y, 1) == 0 || mpz_cmp(d, n) == 0) {
+        return true;
+    }
+    for(mp_bitcnt_t r=1; r<s; ++r) {
+        mpz_mul(d, y, y);
+        mpz_mod(y, d, n);
+        mpz_add_ui(d, y, 1);
+        if(mpz_cmp(d, n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Strong Lucas probable prime test with Selfridge's parameters: the first D
+//in 5, -7, 9, -11, ... with (D/n) = -1, P = 1, Q = (1-D)/4
+static bool is_slprp(const mpz_srcptr n) {
+    long D = 5;
+    for(int j; (j = mpz_si_kronecker(D, n)) != -1; D = D > 0 ? -D-2 : -D+2) {
+        if(j == 0 && mpz_cmpabs_ui(n, std::abs(D)) != 0) {
+            return false;
+        }
+        //no such D exists for squares
+        if(D == 13 && mpz_perfect_square_p(n)) {
+            return false;
+        }
+    }
+    const long Q = (1 - D) / 4;
+
+    //n+1 = d 2^s
+    Mpz Dd, U{1ul}, V{1ul}, Qk, T;
+    const mpz_ptr d = Dd.get_mpz_t(), u = U.get_mpz_t(), v = V.get_mpz_t(), qk = Qk.get_mpz_t(), t = T.get_mpz_t();
+    mpz_add_ui(d, n, 1);
+    const mp_bitcnt_t s = mpz_scan1(d, 0);
+    mpz_tdiv_q_2exp(d, d, s);
+    mpz_set_si(qk, Q);
+    mpz_mod(qk, qk, n);
+    //(a+b)/2 mod n for a, b < n
+    const auto half_sum = [n](const mpz_ptr x, const mpz_srcptr b) {
+        mpz_add(x, x, b);
+        if(mpz_cmp(x, n) >= 0) {
+            mpz_sub(x, x, n);
+        }
+        if(mpz_odd_p(x)) {
+            mpz_add(x, x, n);
+        }
+        mpz_tdiv_q_2exp(x, x, 1);
+    };
+    //U_k, V_k, Q^k from the top bit of d down:
+    //U_2k = U_k V_k, V_2k = V_k^2 - 2Q^k, U_k+1 = (U_k+V_k)/2, V_k+1 = (D U_k+V_k)/2
+    for(mp_bitcnt_t i=mpz_sizeinbase(d, 2)-1; i-->0;) {
+        mpz_mul(t, u, v);
+        mpz_mod(u, t, n);
+        mpz_mul(t, v, v);
+        mpz_submul_ui(t, qk, 2);
+        mpz_mod(v, t, n);
+        mpz_mul(t, qk, qk);
+        mpz_mod(qk, t, n);
+        if(mpz_tstbit(d, i)) {
+            mpz_mul_si(t, u, D);
+            mpz_mod(t, t, n);
+            half_sum(u, v);
+            half_sum(v, t);
+            mpz_mul_si(qk, qk, Q);
+            mpz_mod(qk, qk, n);
+        }
+    }
+    if(mpz_sgn(u) == 0 || mpz_sgn(v) == 0) {
+        return true;
+    }
+    //V_d2^r = 0 for some 0 < r < s
+    for(mp_bitcnt_t r=1; r<s; ++r) {
+        mpz_mul(t, v, v);
+        mpz_submul_ui(t, qk, 2);
+        mpz_mod(v, t, n);
+        if(mpz_sgn(v) == 0) {
+            return true;
+        }
+        mpz_mul(t, qk, qk);
+        mpz_mod(qk, t, n);
+    }
+    return false;
+}
+
+//Products of the odd primes below 256, each fits into a limb
+static const std::vector<mp_limb_t>& small_prime_products() {
+    static const std::vector<mp_limb_t> products = []() {
+        std::vector<mp_limb_t> r{1};
+        for(mp_limb_t p=3; p<256; p+=2) {
+            bool prime = true;
+            for(mp_limb_t q=3; q*q<=p; q+=2) {
+                prime = prime && p % q;
+            }
+            if(!prime) {
+                continue;
+            }
+            if(r.back() > ~mp_limb_t{0} / p) {
+                r.push_back(1);
+            }
+            r.back() *= p;
+        }
+        return r;
+    }();
+    return products;
+}
+
+bool Mpz::is_probable_prime(const unsigned int rounds) const {
+    if(sgn(*this) <= 0) {
+        return false;
+    }
+    if(mpz_size(x) <= 1) {
+        //deterministic below 2^64 with Jim Sinclair's bases, by value, small
+        //ones may have limbs on the heap as well (parsed, quotients, ...)
+        //https://miller-rabin.appspot.com/
+        const mp_limb_t n = mpz_getlimbn(x, 0);
+        if(n < 4 || n % 2 == 0) {
+            return n == 2 || n == 3;
+        }
+        for(const mp_limb_t a : {2ul, 325ul, 9375ul, 28178ul, 450775ul, 9780504ul, 1795265022ul}) {
+            if(!is_sprp(n, a)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //no factor below 256, found through the gcd with limb sized products
+    if(is_even()) {
+        return false;
+    }
+    for(const mp_limb_t p : small_prime_products()) {
+        if(std::gcd(mpz_fdiv_ui(x, p), p) != 1) {
+            return false;
+        }
+    }
+
+    if(!rounds) {
+        const Mpz two{2ul};
+        return is_sprp(x, two.x) && is_slprp(x);
+    }
+    //bases from a generator seeded by n itself, so results are reproducible
+    MpzRandom rng{mpz_getlimbn(x, 0)};
+    const Mpz n3 = *this - 3ul;
+    for(unsigned int i=0; i<rounds; ++i) {
+        const Mpz a = rng.below(n3) + 2ul; //in [2, n-2]
+        if(!is_sprp(x, a.x)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 
 Mpz fac(const unsigned long n) {
+    if(MpzMemo* const memo = MpzMemo::installed()) {
+        return memo->fac(n);
+    }
     Mpz r;
-    mpz_fac_ui(r.x, n);
+    factorial(r.x, n);
     return r;
 }
 
 Mpz fac2(const unsigned long n) {
     Mpz r;
-    mpz_2fac_ui(r.x, n);
+    double_factorial(r.x, n);
     return r;
 }
 
@@ -509,50 +1357,61 @@ Mpz bin(const Mpz& n, const unsigned long k) {
     mpz_bin_ui(r.x, n.x, k);
     return r;
 }
+Mpz bin(Mpz&& n, const unsigned long k) {
+    n.promote();
+    mpz_bin_ui(n.x, n.x, k);
+    return std::move(n);
+}
 
 Mpz bin(const unsigned long n, const unsigned long k) {
+    if(MpzMemo* const memo = MpzMemo::installed()) {
+        return memo->bin(n, k);
+    }
     Mpz r;
-    mpz_bin_uiui(r.x, n, k);
+    binomial(r.x, n, k);
     return r;
 }
 
 
 Mpz fib(const unsigned long n) {
+    if(MpzMemo* const memo = MpzMemo::installed()) {
+        return memo->fib(n);
+    }
     Mpz r;
-    mpz_fib_ui(r.x, n);
+    fibonacci(r.x, n);
     return r;
 }
 
 
 
-std::map<Mpz, unsigned long> factorise(Mpz n) {
-    if(n == 0l) {
-        return {{Mpz(), 1}};
-    }
+//Hashing
+//Upper & lower half of the 128 bit product xor'ed (wyhash's mum)
+static std::uint64_t mum(const std::uint64_t a, const std::uint64_t b) {
+    const u128 p = static_cast<u128>(a) * b;
+    return static_cast<std::uint64_t>(p) ^ static_cast<std::uint64_t>(p >> 64);
+}
 
-    std::map<Mpz, unsigned long> f;
-    if(n < 0l) {
-        f[Mpz{-1l}] = 1;
-        n = abs(n);
-    }
-    const Mpz isqrt = sqrt(n);
-    for(Mpz i{2l}; i<=isqrt; ++i) {
-        while(n%i == 0l) {
-            n /= i;
-            ++f[i];
-        }
-    }
-    if(n > 1l) {
-        ++f[n];
+std::size_t std::hash<Mpz>::operator()(const Mpz& x) const noexcept {
+    const mpz_srcptr X = x.get_mpz_t();
+    const mp_limb_t* const d = X->_mp_d;
+    std::uint64_t h = mum(static_cast<std::uint64_t>(X->_mp_size) ^ 0xa0761d6478bd642f, 0xe7037ed1a0b428db);
+    for(std::size_t i=0; i<mpz_size(X); ++i) {
+        h = mum(h ^ d[i], 0x8ebc6af09c88c6e3);
     }
-
-    return f;
+    return mum(h, 0x589965cc75374cc3);
 }
 
 
 
 //IO
 std::ostream& operator<<(std::ostream& os, const Mpz& x) {
-    //implemented in libgmpxx.dylib
+    //huge values in plain decimal are streamed in chunks (mpz_io.h),
+    //everything else incl. formatting flags is implemented in libgmpxx.dylib
+    const std::ios::fmtflags base = os.flags() & std::ios::basefield;
+    if(x.size_in_base(10) > std::size_t{1} << 16 && base != std::ios::hex && base != std::ios::oct
+            && !(os.flags() & std::ios::showpos) && os.width() == 0) {
+        write_digits(os, x);
+        return os;
+    }
     return os << x.x;
 }
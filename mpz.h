@@ -4,18 +4,43 @@
 
 
 #include <gmp.h>
-#include <map>
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <ostream>
+#include <utility>
+#include <vector>
+
+
+
+template<typename E> class MpzExpr;
 
 
 
 class Mpz {
 private:
+    //Values with |x| < 2^64 are stored inline: x->_mp_alloc == 0 and
+    //x->_mp_d points to limb. Since GMP 6.2 such an mpz_t is valid read-only
+    //(like mpz_roinit_n) and GMP allocates a fresh buffer on the first write
+    //to it. So small values can be passed to GMP as source operands as they
+    //are, only in place writes need promote() first.
+    //https://gmplib.org/manual/Integer-Special-Functions
+    //MpzView's Mpz borrows larger values the same way: _mp_alloc == 0 with
+    //more than one limb, never written to.
     mpz_t x;
-    //https://gmplib.org/manual/Random-State-Initialization
-    static gmp_randstate_t randState;
-    static bool isRandStateInitialized;
+    mp_limb_t limb;
+
+    //Small value optimisation
+    [[nodiscard]] bool is_small() const;
+    [[nodiscard]] mp_limb_t small_limb() const;
+    [[nodiscard]] __int128 small_value() const;
+    void init_small(const mp_limb_t m, const int s);
+    void set_small(const mp_limb_t m, const int s);
+    void set_wide(const unsigned __int128 m, const int s);
+    void set_wide(const __int128 v);
+    void promote();
+
+    friend class MpzView;
 
 public:
     //Construction
@@ -27,17 +52,17 @@ public:
     explicit Mpz(const std::string& s);
     explicit Mpz(const mpz_t& x);
     Mpz(const Mpz& other); //copy
-    Mpz(Mpz&& other); //move
+    Mpz(Mpz&& other) noexcept; //move
     ~Mpz();
 
     void realloc() const;
 
     Mpz& operator=(const Mpz& other); //copy
-    Mpz& operator=(Mpz&& other); //move
+    Mpz& operator=(Mpz&& other) noexcept; //move
 
 
 
-    //https://gmplib.org/manual/Integer-Random-Numbers
+    //Uniform in [0, n) from the calling thread's generator, see mpz_random.h
     static Mpz rand(const Mpz& n);
 
 
@@ -59,6 +84,10 @@ public:
     explicit operator long() const;
     explicit operator double() const;
     [[nodiscard]] std::string to_string(const int base=10) const;
+    //Raw GMP access, the const version is read-only. The mutable version
+    //moves small values to the heap first so GMP can write to it in place.
+    [[nodiscard]] mpz_srcptr get_mpz_t() const;
+    [[nodiscard]] mpz_ptr get_mpz_t();
 
 
 
@@ -84,11 +113,18 @@ public:
 
     //Arithmetic
     //https://gmplib.org/manual/Integer-Arithmetic
+    //Overloads taking an expiring Mpz&& compute in its limbs and move it out
     friend Mpz operator-(const Mpz& x);
+    friend Mpz operator-(Mpz&& x);
 
     friend Mpz operator+(const unsigned long lhs, const Mpz& rhs);
     friend Mpz operator+(const Mpz& lhs, const unsigned long rhs);
     friend Mpz operator+(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator+(const unsigned long lhs, Mpz&& rhs);
+    friend Mpz operator+(Mpz&& lhs, const unsigned long rhs);
+    friend Mpz operator+(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator+(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator+(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator+=(const unsigned long other);
     Mpz& operator+=(const Mpz& other);
     Mpz& operator++(); //prefix
@@ -97,6 +133,11 @@ public:
     friend Mpz operator-(const unsigned long lhs, const Mpz& rhs);
     friend Mpz operator-(const Mpz& lhs, const unsigned long rhs);
     friend Mpz operator-(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator-(const unsigned long lhs, Mpz&& rhs);
+    friend Mpz operator-(Mpz&& lhs, const unsigned long rhs);
+    friend Mpz operator-(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator-(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator-(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator-=(const unsigned long other);
     Mpz& operator-=(const Mpz& other);
     Mpz& operator--(); //prefix
@@ -107,6 +148,13 @@ public:
     friend Mpz operator*(const Mpz& lhs, const long rhs);
     friend Mpz operator*(const Mpz& lhs, const unsigned long rhs);
     friend Mpz operator*(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator*(const long lhs, Mpz&& rhs);
+    friend Mpz operator*(const unsigned long lhs, Mpz&& rhs);
+    friend Mpz operator*(Mpz&& lhs, const long rhs);
+    friend Mpz operator*(Mpz&& lhs, const unsigned long rhs);
+    friend Mpz operator*(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator*(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator*(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator*=(const long other);
     Mpz& operator*=(const unsigned long other);
     Mpz& operator*=(const Mpz& other);
@@ -114,32 +162,71 @@ public:
     //https://gmplib.org/manual/Integer-Division
     friend Mpz operator/(const Mpz& lhs, const unsigned long rhs); //Signedness issues!!!
     friend Mpz operator/(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator/(Mpz&& lhs, const unsigned long rhs);
+    friend Mpz operator/(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator/(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator/(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator/=(const unsigned long other);
     Mpz& operator/=(const Mpz& other);
 
     //TODO: mpz_mod?, mpz_mod_ui?
     friend Mpz operator%(const Mpz& lhs, const unsigned long rhs); //Signedness issues!!!
     friend Mpz operator%(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator%(Mpz&& lhs, const unsigned long rhs);
+    friend Mpz operator%(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator%(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator%(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator%=(const unsigned long other);
     Mpz& operator%=(const Mpz& other);
 
+    //Destination & fused arithmetic, *this is overwritten/updated in place
+    //https://gmplib.org/manual/Integer-Arithmetic
+    Mpz& set_add(const Mpz& a, const Mpz& b); //*this = a+b
+    Mpz& set_add(const Mpz& a, const unsigned long b);
+    Mpz& set_sub(const Mpz& a, const Mpz& b); //*this = a-b
+    Mpz& set_sub(const Mpz& a, const unsigned long b);
+    Mpz& set_mul(const Mpz& a, const Mpz& b); //*this = a*b
+    Mpz& set_mul(const Mpz& a, const unsigned long b);
+    Mpz& addmul(const Mpz& a, const Mpz& b); //*this += a*b
+    Mpz& addmul(const Mpz& a, const unsigned long b);
+    Mpz& submul(const Mpz& a, const Mpz& b); //*this -= a*b
+    Mpz& submul(const Mpz& a, const unsigned long b);
+    Mpz& negate(); //*this = -*this
+
+    //Lazy expressions, see mpz_expr.h
+    template<typename E> Mpz(const MpzExpr<E>& e);
+    template<typename E> Mpz& operator=(const MpzExpr<E>& e);
+    template<typename E> Mpz& operator+=(const MpzExpr<E>& e);
+    template<typename E> Mpz& operator-=(const MpzExpr<E>& e);
+
 
 
     //bitwise
     //https://gmplib.org/manual/Integer-Logic-and-Bit-Fiddling
     friend Mpz operator&(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator&(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator&(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator&(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator&=(const Mpz& other);
 
     friend Mpz operator|(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator|(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator|(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator|(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator|=(const Mpz& other);
 
     friend Mpz operator^(const Mpz& lhs, const Mpz& rhs);
+    friend Mpz operator^(Mpz&& lhs, const Mpz& rhs);
+    friend Mpz operator^(const Mpz& lhs, Mpz&& rhs);
+    friend Mpz operator^(Mpz&& lhs, Mpz&& rhs);
     Mpz& operator^=(const Mpz& other);
 
     friend Mpz operator<<(const Mpz& lhs, const unsigned long rhs);
+    friend Mpz operator<<(Mpz&& lhs, const unsigned long rhs);
     Mpz& operator<<=(const unsigned long other);
 
     friend Mpz operator>>(const Mpz& lhs, const unsigned long rhs);
+    friend Mpz operator>>(Mpz&& lhs, const unsigned long rhs);
     Mpz& operator>>=(const unsigned long other);
 
 
@@ -147,24 +234,50 @@ public:
     //Functions
     //https://gmplib.org/manual/Integer-Arithmetic
     friend Mpz abs(const Mpz& x);
+    friend Mpz abs(Mpz&& x);
 
     //https://gmplib.org/manual/Integer-Exponentiation
     friend Mpz pow(const Mpz& b, const unsigned long e);
+    friend Mpz pow(Mpz&& b, const unsigned long e);
     friend Mpz powul(const unsigned long b, const unsigned long e);
+    //b^e mod m in [0, |m|), sliding window over the bits of e. Negative
+    //exponents need b to be invertible. Fixed bases: MpzFixedBase in
+    //mpz_montgomery.h
+    friend Mpz powm(const Mpz& b, const Mpz& e, const Mpz& m);
+    friend Mpz powm(const Mpz& b, const unsigned long e, const Mpz& m);
+    //Time & memory access pattern only depend on the operand sizes, for
+    //secret exponents. Requires e > 0 and an odd m.
+    friend Mpz powm_sec(const Mpz& b, const Mpz& e, const Mpz& m);
     //https://gmplib.org/manual/Integer-Roots
     friend Mpz root(const Mpz& x, const unsigned long n);
+    friend Mpz root(Mpz&& x, const unsigned long n);
     friend Mpz sqrt(const Mpz& x);
+    friend Mpz sqrt(Mpz&& x);
     //https://gmplib.org/manual/Number-Theoretic-Functions
     friend Mpz gcd(const Mpz& a, const Mpz& b);
     friend Mpz gcd(const Mpz& a, const unsigned long b);
+    friend Mpz gcd(Mpz&& a, const Mpz& b);
+    friend Mpz gcd(const Mpz& a, Mpz&& b);
+    friend Mpz gcd(Mpz&& a, Mpz&& b);
+    friend Mpz gcd(Mpz&& a, const unsigned long b);
 
     friend Mpz lcm(const Mpz& a, const Mpz& b);
     friend Mpz lcm(const Mpz& a, const unsigned long b);
+    friend Mpz lcm(Mpz&& a, const Mpz& b);
+    friend Mpz lcm(const Mpz& a, Mpz&& b);
+    friend Mpz lcm(Mpz&& a, Mpz&& b);
+    friend Mpz lcm(Mpz&& a, const unsigned long b);
+
+    //Baillie-PSW by default, no known counterexample. rounds > 0 runs that
+    //many Miller-Rabin rounds instead (error < 4^-rounds). Exact below 2^64.
+    //Batches: probable_primes() in mpz_prime.h
+    [[nodiscard]] bool is_probable_prime(const unsigned int rounds=0) const;
 
     friend Mpz fac(const unsigned long n);
     friend Mpz fac2(const unsigned long n);
 
     friend Mpz bin(const Mpz& n, const unsigned long k);
+    friend Mpz bin(Mpz&& n, const unsigned long k);
     friend Mpz bin(const unsigned long n, unsigned long k);
 
     friend Mpz fib(const unsigned long n);
@@ -176,13 +289,73 @@ public:
 };
 
 
-Mpz pow(Mpz b, Mpz e);
+//The friends above again, so they're found for arguments converting to
+//const Mpz& too (MpzView)
+bool operator==(const long lhs, const Mpz& rhs);
+bool operator==(const unsigned long lhs, const Mpz& rhs);
+bool operator==(const Mpz& lhs, const long rhs);
+bool operator==(const Mpz& lhs, const unsigned long rhs);
+bool operator==(const Mpz& lhs, const Mpz& rhs);
+int operator<=>(const long lhs, const Mpz& rhs);
+int operator<=>(const unsigned long lhs, const Mpz& rhs);
+int operator<=>(const Mpz& lhs, const long rhs);
+int operator<=>(const Mpz& lhs, const unsigned long rhs);
+int operator<=>(const Mpz& lhs, const Mpz& rhs);
+int sgn(const Mpz& s);
+Mpz operator-(const Mpz& x);
+Mpz operator+(const unsigned long lhs, const Mpz& rhs);
+Mpz operator+(const Mpz& lhs, const unsigned long rhs);
+Mpz operator+(const Mpz& lhs, const Mpz& rhs);
+Mpz operator-(const unsigned long lhs, const Mpz& rhs);
+Mpz operator-(const Mpz& lhs, const unsigned long rhs);
+Mpz operator-(const Mpz& lhs, const Mpz& rhs);
+Mpz operator*(const long lhs, const Mpz& rhs);
+Mpz operator*(const unsigned long lhs, const Mpz& rhs);
+Mpz operator*(const Mpz& lhs, const long rhs);
+Mpz operator*(const Mpz& lhs, const unsigned long rhs);
+Mpz operator*(const Mpz& lhs, const Mpz& rhs);
+Mpz operator/(const Mpz& lhs, const unsigned long rhs);
+Mpz operator/(const Mpz& lhs, const Mpz& rhs);
+Mpz operator%(const Mpz& lhs, const unsigned long rhs);
+Mpz operator%(const Mpz& lhs, const Mpz& rhs);
+Mpz operator&(const Mpz& lhs, const Mpz& rhs);
+Mpz operator|(const Mpz& lhs, const Mpz& rhs);
+Mpz operator^(const Mpz& lhs, const Mpz& rhs);
+Mpz operator<<(const Mpz& lhs, const unsigned long rhs);
+Mpz operator>>(const Mpz& lhs, const unsigned long rhs);
+Mpz abs(const Mpz& x);
+Mpz pow(const Mpz& b, const unsigned long e);
+Mpz powm(const Mpz& b, const Mpz& e, const Mpz& m);
+Mpz powm(const Mpz& b, const unsigned long e, const Mpz& m);
+Mpz powm_sec(const Mpz& b, const Mpz& e, const Mpz& m);
+Mpz root(const Mpz& x, const unsigned long n);
+Mpz sqrt(const Mpz& x);
+Mpz gcd(const Mpz& a, const Mpz& b);
+Mpz gcd(const Mpz& a, const unsigned long b);
+Mpz lcm(const Mpz& a, const Mpz& b);
+Mpz lcm(const Mpz& a, const unsigned long b);
+Mpz bin(const Mpz& n, const unsigned long k);
+std::ostream& operator<<(std::ostream& os, const Mpz& x);
+
+//Exponents beyond an unsigned long only work for b in {-1, 0, 1}
+Mpz pow(Mpz b, const Mpz& e);
 Mpz powul(const unsigned long b, const unsigned long e);
 Mpz fac(const unsigned long n);
 Mpz fac2(const unsigned long n);
 Mpz bin(const unsigned long n, const unsigned long k);
 Mpz fib(const unsigned long n);
-std::map<Mpz, unsigned long> factorise(Mpz n);
+//Prime factors and their multiplicities, sorted (see mpz_factor.h)
+std::vector<std::pair<Mpz, unsigned long>> factorise(Mpz n);
+
+
+
+//Multiply & fold over the limbs and the signed size, so equal values hash
+//equal however they're stored (inline, heap, MpzView). Flat tables for
+//Mpz keys: mpz_map.h
+template<>
+struct std::hash<Mpz> {
+    [[nodiscard]] std::size_t operator()(const Mpz& x) const noexcept;
+};
 
 
 
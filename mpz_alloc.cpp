@@ -0,0 +1,397 @@
+#include "mpz_alloc.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <gmp.h>
+
+
+
+static constexpr std::size_t minShift = std::countr_zero(MpzPool::minPooled);
+static constexpr std::size_t classCount = std::countr_zero(MpzPool::maxPooled) - minShift + 1;
+static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+
+[[noreturn]] static void out_of_memory() {
+    std::fputs("MpzPool: cannot allocate memory\n", stderr);
+    std::abort();
+}
+
+static void* checked(void* ptr) {
+    if(!ptr) {
+        out_of_memory();
+    }
+    return ptr;
+}
+
+
+static std::size_t size_class(const std::size_t size) {
+    return size <= MpzPool::minPooled ? 0 : std::bit_width(size - 1) - minShift;
+}
+
+static std::size_t class_size(const std::size_t c) {
+    return MpzPool::minPooled << c;
+}
+
+
+
+//Free lists
+//Trivially destructible so blocks freed by later thread local destructors
+//can still check `dead` and go to free() directly.
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct PoolState {
+    FreeBlock* heads[classCount];
+    std::size_t cached[classCount];
+    bool dead;
+};
+
+static thread_local PoolState state{};
+static thread_local MpzArena* arena = nullptr;
+
+struct PoolDrain {
+    ~PoolDrain() {
+        MpzPool::trim();
+        state.dead = true;
+    }
+};
+
+static thread_local PoolDrain drain;
+
+
+static void* pool_alloc(const std::size_t size) {
+    if(size > MpzPool::maxPooled || state.dead) {
+        return checked(std::malloc(size));
+    }
+    (void)&drain; //registers the thread exit drain
+    const std::size_t c = size_class(size);
+    if(FreeBlock* b = state.heads[c]) {
+        state.heads[c] = b->next;
+        state.cached[c] -= class_size(c);
+        return b;
+    }
+    return checked(std::malloc(class_size(c)));
+}
+
+static void pool_free(void* ptr, const std::size_t size) {
+    if(size > MpzPool::maxPooled || state.dead) {
+        std::free(ptr);
+        return;
+    }
+    const std::size_t c = size_class(size);
+    if(state.cached[c] + class_size(c) > MpzPool::maxCachedBytes) {
+        std::free(ptr);
+        return;
+    }
+    FreeBlock* const b = static_cast<FreeBlock*>(ptr);
+    b->next = state.heads[c];
+    state.heads[c] = b;
+    state.cached[c] += class_size(c);
+}
+
+static void* pool_realloc(void* ptr, const std::size_t oldSize, const std::size_t newSize) {
+    if(oldSize > MpzPool::maxPooled && newSize > MpzPool::maxPooled) {
+        return checked(std::realloc(ptr, newSize));
+    }
+    if(oldSize <= MpzPool::maxPooled && newSize <= MpzPool::maxPooled
+            && size_class(oldSize) == size_class(newSize)) {
+        return ptr;
+    }
+    void* const p = pool_alloc(newSize);
+    std::memcpy(p, ptr, std::min(oldSize, newSize));
+    pool_free(ptr, oldSize);
+    return p;
+}
+
+
+//GMP entry points, arena blocks are recognised by address
+//Header of an arena chunk
+struct MpzArena::Chunk {
+    MpzArena* arena;
+    Chunk* prev; //older
+    Chunk* next; //newer
+    std::size_t used; //incl. this header
+    std::size_t live; //blocks not freed yet
+};
+
+void* mpz_pool_alloc(const std::size_t size) {
+    if(arena && !arena->suspended) {
+        return arena->allocate(size);
+    }
+    return pool_alloc(size);
+}
+
+void* mpz_pool_realloc(void* ptr, const std::size_t oldSize, const std::size_t newSize) {
+    if(MpzArena::Chunk* const c = MpzArena::chunk_of(ptr)) {
+        MpzArena* const a = c->arena;
+        if(!a->suspended) {
+            return a->reallocate(c, ptr, oldSize, newSize);
+        }
+        void* const p = pool_alloc(newSize);
+        std::memcpy(p, ptr, std::min(oldSize, newSize));
+        a->deallocate(c, ptr);
+        return p;
+    }
+    return pool_realloc(ptr, oldSize, newSize);
+}
+
+void mpz_pool_free(void* ptr, const std::size_t size) {
+    if(MpzArena::Chunk* const c = MpzArena::chunk_of(ptr)) {
+        c->arena->deallocate(c, ptr);
+    } else {
+        pool_free(ptr, size);
+    }
+}
+
+
+
+//Pool
+void MpzPool::install() {
+    mp_set_memory_functions(mpz_pool_alloc, mpz_pool_realloc, mpz_pool_free);
+}
+
+void MpzPool::uninstall() {
+    mp_set_memory_functions(nullptr, nullptr, nullptr);
+}
+
+void MpzPool::trim() {
+    for(std::size_t c=0; c<classCount; ++c) {
+        while(FreeBlock* b = state.heads[c]) {
+            state.heads[c] = b->next;
+            std::free(b);
+        }
+        state.cached[c] = 0;
+    }
+}
+
+
+
+//Arena
+//Chunks are aligned to granules, each of their granules is registered in a
+//thread local open addressing table (the key 0 marks empty slots, no chunk
+//starts at address 0)
+static constexpr std::size_t granule = std::size_t{1} << 16;
+
+struct GranuleSlot {
+    std::uintptr_t key;
+    void* chunk;
+};
+
+struct GranuleTable {
+    GranuleSlot* slots;
+    std::size_t count;
+    unsigned int bits; //of the capacity
+};
+
+static thread_local GranuleTable granules{};
+
+static std::size_t round_up(const std::size_t size) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static std::uintptr_t granule_of(const void* ptr) {
+    return reinterpret_cast<std::uintptr_t>(ptr) / granule;
+}
+
+static std::size_t home(const std::uintptr_t key) {
+    return static_cast<std::size_t>((key * 0x9e3779b97f4a7c15) >> (64 - granules.bits));
+}
+
+static void* find_granule(const std::uintptr_t key) {
+    if(!granules.count) {
+        return nullptr;
+    }
+    const std::size_t mask = (std::size_t{1} << granules.bits) - 1;
+    for(std::size_t i=home(key); granules.slots[i].key; i=(i+1)&mask) {
+        if(granules.slots[i].key == key) {
+            return granules.slots[i].chunk;
+        }
+    }
+    return nullptr;
+}
+
+static void insert_granule(const std::uintptr_t key, void* chunk) {
+    if(2 * (granules.count + 1) > (std::size_t{1} << granules.bits)) {
+        //at most half full
+        const GranuleTable old = granules;
+        granules.bits = std::max(old.bits + 1, 6u);
+        granules.slots = static_cast<GranuleSlot*>(checked(std::calloc(std::size_t{1} << granules.bits, sizeof(GranuleSlot))));
+        granules.count = 0;
+        for(std::size_t i=0; old.slots && i<(std::size_t{1} << old.bits); ++i) {
+            if(old.slots[i].key) {
+                insert_granule(old.slots[i].key, old.slots[i].chunk);
+            }
+        }
+        std::free(old.slots);
+    }
+    const std::size_t mask = (std::size_t{1} << granules.bits) - 1;
+    std::size_t i = home(key);
+    while(granules.slots[i].key) {
+        i = (i+1) & mask;
+    }
+    granules.slots[i] = {key, chunk};
+    ++granules.count;
+}
+
+//backward shift deletion, later entries of the probe sequence move up
+static void erase_granule(const std::uintptr_t key) {
+    const std::size_t mask = (std::size_t{1} << granules.bits) - 1;
+    std::size_t i = home(key);
+    while(granules.slots[i].key != key) {
+        i = (i+1) & mask;
+    }
+    for(std::size_t j=(i+1)&mask; granules.slots[j].key; j=(j+1)&mask) {
+        const std::size_t k = home(granules.slots[j].key);
+        if(i < j ? (k <= i || k > j) : (k <= i && k > j)) {
+            granules.slots[i] = granules.slots[j];
+            i = j;
+        }
+    }
+    granules.slots[i] = {0, nullptr};
+    if(!--granules.count) {
+        std::free(granules.slots);
+        granules = {};
+    }
+}
+
+static void free_chunk(void* chunk, const std::size_t size) {
+    for(std::size_t g=0; g<size/granule; ++g) {
+        erase_granule(granule_of(chunk) + g);
+    }
+    std::free(chunk);
+}
+
+
+MpzArena::MpzArena(const std::size_t chunkSize)
+        : outer(arena), chunkSize((std::max(chunkSize, granule) + granule - 1) & ~(granule - 1)) {
+    arena = this;
+}
+
+MpzArena::~MpzArena() {
+    while(chunk) {
+        Chunk* const prev = chunk->prev;
+        free_chunk(chunk, chunkSize);
+        chunk = prev;
+    }
+    if(spare) {
+        free_chunk(spare, chunkSize);
+    }
+    arena = outer;
+}
+
+std::size_t MpzArena::bytes_used() const {
+    return bytesUsed;
+}
+
+bool MpzArena::active() {
+    return arena && !arena->suspended;
+}
+
+
+MpzArena::Chunk* MpzArena::chunk_of(const void* ptr) {
+    return static_cast<Chunk*>(find_granule(granule_of(ptr)));
+}
+
+void MpzArena::add_chunk() {
+    Chunk* c = std::exchange(spare, nullptr);
+    if(!c) {
+        c = static_cast<Chunk*>(checked(std::aligned_alloc(granule, chunkSize)));
+        for(std::size_t g=0; g<chunkSize/granule; ++g) {
+            insert_granule(granule_of(c) + g, c);
+        }
+    }
+    *c = {this, chunk, nullptr, round_up(sizeof(Chunk)), 0};
+    if(chunk) {
+        chunk->next = c;
+    }
+    chunk = c;
+}
+
+//c's last block is gone, the current chunk starts over, older ones are
+//kept as the spare or freed
+void MpzArena::release(Chunk* const c) {
+    if(c == chunk) {
+        c->used = round_up(sizeof(Chunk));
+        last = nullptr;
+        return;
+    }
+    c->next->prev = c->prev;
+    if(c->prev) {
+        c->prev->next = c->next;
+    }
+    if(!spare) {
+        spare = c;
+    } else {
+        free_chunk(c, chunkSize);
+    }
+}
+
+
+//The pool's size classes, so growing blocks that aren't the most recent
+//aren't copied every time either
+static std::size_t arena_size(const std::size_t size) {
+    return size <= MpzPool::maxPooled ? class_size(size_class(size)) : round_up(size);
+}
+
+void* MpzArena::allocate(const std::size_t size) {
+    const std::size_t n = arena_size(size);
+    if(n > chunkSize / 4) {
+        return pool_alloc(size);
+    }
+    if(!chunk || chunk->used + n > chunkSize) {
+        add_chunk();
+    }
+    void* const p = reinterpret_cast<std::byte*>(chunk) + chunk->used;
+    chunk->used += n;
+    ++chunk->live;
+    bytesUsed += n;
+    last = p;
+    lastSize = n;
+    return p;
+}
+
+void* MpzArena::reallocate(Chunk* const c, void* ptr, const std::size_t oldSize, const std::size_t newSize) {
+    const std::size_t n = arena_size(newSize);
+    if(ptr != last && n == arena_size(oldSize)) {
+        return ptr;
+    }
+    if(ptr == last && n <= chunkSize / 4 && c->used - lastSize + n <= chunkSize) {
+        c->used += n - lastSize;
+        bytesUsed += n - lastSize;
+        lastSize = n;
+        return ptr;
+    }
+    void* const p = allocate(newSize);
+    std::memcpy(p, ptr, std::min(oldSize, newSize));
+    deallocate(c, ptr);
+    return p;
+}
+
+void MpzArena::deallocate(Chunk* const c, void* ptr) {
+    if(ptr == last) {
+        c->used -= lastSize;
+        last = nullptr;
+    }
+    if(!--c->live) {
+        release(c);
+    }
+}
+
+
+MpzArena::Suspend::Suspend() : arena(::arena), wasSuspended(arena && arena->suspended) {
+    if(arena) {
+        arena->suspended = true;
+    }
+}
+
+MpzArena::Suspend::~Suspend() {
+    if(arena) {
+        arena->suspended = wasSuspended;
+    }
+}
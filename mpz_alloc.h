@@ -0,0 +1,113 @@
+#ifndef MPZ_ALLOC_H
+#define MPZ_ALLOC_H
+
+
+
+#include <cstddef>
+
+
+
+//Pooled GMP memory functions
+//https://gmplib.org/manual/Custom-Allocation
+//
+//Limb buffers up to MpzPool::maxPooled bytes are rounded up to power of two
+//size classes and recycled through thread local free lists, larger ones go
+//straight to malloc. GMP passes the block size to realloc & free, so blocks
+//carry no header. Like all custom memory functions they have to be installed
+//before GMP allocates anything.
+//
+//Blocks freed on another thread than they were allocated on just end up in
+//that thread's free lists, all blocks come from malloc in the end.
+class MpzPool {
+public:
+    static constexpr std::size_t minPooled = 16;
+    static constexpr std::size_t maxPooled = 32*1024;
+    //per thread & size class, the rest is returned to malloc
+    static constexpr std::size_t maxCachedBytes = 1024*1024;
+
+    static void install();
+    static void uninstall(); //back to malloc, realloc & free
+
+    //Returns the calling thread's cached blocks to malloc
+    static void trim();
+};
+
+
+
+//Scoped arena
+//
+//While an arena is alive GMP allocations on its thread are bump allocated
+//from large chunks. A free only counts down the blocks of its chunk (the
+//most recent block is given back in place), a chunk without blocks left is
+//reused or released, so temporaries of a computation cost next to nothing
+//and long loops stay in bounded memory. Blocks over a quarter of a chunk go
+//to the pool. Chunks are aligned to 64 KB granules found through a hash
+//table, which tells in O(1) whether a freed pointer is an arena's at all.
+//Requires MpzPool to be installed.
+//
+//Every integer that got its limbs inside the arena must be destroyed before
+//the arena and must stay on its thread. Buffers allocated before the arena
+//keep growing outside of it. Results that should survive the arena have to be
+//stored while it is suspended:
+//  Mpz result;
+//  {
+//      MpzArena arena;
+//      const Mpz t = work();
+//      const MpzArena::Suspend s;
+//      result = t;
+//  }
+//The same goes for caches that outlive a computation: MpzMemo entries, the
+//radix powers of mpz_io.h & the scratch integers of mpz_expr.h are copied,
+//computed or dropped outside of any arena, so they can be used inside one.
+class MpzArena {
+private:
+    struct Chunk; //header at the start of every chunk
+
+    Chunk* chunk = nullptr; //current one, the newest of a linked list
+    Chunk* spare = nullptr; //an emptied one kept for the next
+    MpzArena* const outer;
+    const std::size_t chunkSize;
+    std::size_t bytesUsed = 0;
+    void* last = nullptr; //most recent block, can grow or shrink in place
+    std::size_t lastSize = 0;
+    bool suspended = false;
+
+    void* allocate(const std::size_t size);
+    void* reallocate(Chunk* c, void* ptr, const std::size_t oldSize, const std::size_t newSize);
+    void deallocate(Chunk* c, void* ptr);
+    void add_chunk();
+    void release(Chunk* c);
+    [[nodiscard]] static Chunk* chunk_of(const void* ptr); //of any arena of the thread, or null
+
+    friend void* mpz_pool_alloc(const std::size_t size);
+    friend void* mpz_pool_realloc(void* ptr, const std::size_t oldSize, const std::size_t newSize);
+    friend void mpz_pool_free(void* ptr, const std::size_t size);
+
+public:
+    //chunkSize is rounded up to whole granules
+    explicit MpzArena(const std::size_t chunkSize=1024*1024);
+    ~MpzArena();
+    MpzArena(const MpzArena&) = delete;
+    MpzArena& operator=(const MpzArena&) = delete;
+
+    //Bytes handed out so far
+    [[nodiscard]] std::size_t bytes_used() const;
+    //Whether GMP allocations of the calling thread go to an arena right now
+    [[nodiscard]] static bool active();
+
+    //Routes allocations of the innermost arena back to the pool while alive
+    class Suspend {
+    private:
+        MpzArena* const arena;
+        const bool wasSuspended; //nested ones restore the outer state
+    public:
+        Suspend();
+        ~Suspend();
+        Suspend(const Suspend&) = delete;
+        Suspend& operator=(const Suspend&) = delete;
+    };
+};
+
+
+
+#endif //MPZ_ALLOC_H
@@ -0,0 +1,98 @@
+#include "mpz_batch_gcd.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+
+//tree[0] are the leaves, tree.back() holds their product alone
+static std::vector<std::vector<Mpz>> product_tree(std::vector<Mpz> leaves, MpzExecutor& executor) {
+    std::vector<std::vector<Mpz>> tree;
+    tree.push_back(std::move(leaves));
+    while(tree.back().size() > 1) {
+        const std::vector<Mpz>& below = tree.back();
+        std::vector<Mpz> level((below.size() + 1) / 2);
+        parallel_for(executor, level.size(), [&below, &level](const std::size_t i) {
+            if(2*i + 1 < below.size()) {
+                level[i].set_mul(below[2*i], below[2*i + 1]);
+            } else {
+                level[i] = below[2*i];
+            }
+        });
+        tree.push_back(std::move(level));
+    }
+    return tree;
+}
+
+//r mod leaf^2 for every leaf, given r mod product^2. Levels are freed on
+//the way down.
+static std::vector<Mpz> remainder_tree(std::vector<std::vector<Mpz>>& tree, Mpz r, MpzExecutor& executor) {
+    std::vector<Mpz> above;
+    above.push_back(std::move(r));
+    while(!tree.empty()) {
+        const std::vector<Mpz>& level = tree.back();
+        std::vector<Mpz> rem(level.size());
+        parallel_for(executor, level.size(), [&above, &level, &rem](const std::size_t i) {
+            Mpz square;
+            square.set_mul(level[i], level[i]);
+            mpz_tdiv_r(rem[i].get_mpz_t(), above[i/2].get_mpz_t(), square.get_mpz_t());
+        });
+        above = std::move(rem);
+        if(tree.size() > 1) {
+            tree.pop_back();
+        } else {
+            break;
+        }
+    }
+    return above;
+}
+
+
+std::vector<Mpz> batch_gcd(const std::span<const Mpz> x, MpzExecutor& executor, const std::size_t chunkSize) {
+    if(std::any_of(x.begin(), x.end(), [](const Mpz& v) { return !v; })) {
+        throw std::invalid_argument("batch_gcd: zero input");
+    }
+    if(x.empty()) {
+        return {};
+    }
+    const std::size_t chunk = std::max<std::size_t>(chunkSize, 1);
+    const std::size_t chunks = (x.size() + chunk - 1) / chunk;
+    const auto leaves = [&x, chunk](const std::size_t c) {
+        std::vector<Mpz> l;
+        for(std::size_t i=c*chunk; i<std::min(x.size(), (c+1)*chunk); ++i) {
+            l.push_back(abs(x[i]));
+        }
+        return l;
+    };
+
+    //P mod Q_c^2 for every chunk product Q_c, the trees are rebuilt later
+    //unless there is only one
+    std::vector<Mpz> top(chunks);
+    std::vector<std::vector<Mpz>> first;
+    for(std::size_t c=0; c<chunks; ++c) {
+        std::vector<std::vector<Mpz>> tree = product_tree(leaves(c), executor);
+        top[c] = tree.back()[0];
+        if(chunks == 1) {
+            first = std::move(tree);
+        }
+    }
+    std::vector<std::vector<Mpz>> topTree = product_tree(std::move(top), executor);
+    Mpz product = topTree.back()[0];
+    const std::vector<Mpz> chunkRemainders = remainder_tree(topTree, std::move(product), executor);
+    topTree.clear();
+
+    std::vector<Mpz> g(x.size());
+    for(std::size_t c=0; c<chunks; ++c) {
+        std::vector<std::vector<Mpz>> tree = chunks == 1 ? std::move(first) : product_tree(leaves(c), executor);
+        const std::vector<Mpz>& l = tree.front();
+        const std::size_t offset = c*chunk;
+        //remainder_tree frees all levels but the leaves
+        const std::vector<Mpz> rem = remainder_tree(tree, chunkRemainders[c], executor);
+        parallel_for(executor, l.size(), [&](const std::size_t i) {
+            Mpz& r = g[offset + i];
+            mpz_divexact(r.get_mpz_t(), rem[i].get_mpz_t(), l[i].get_mpz_t());
+            r = gcd(std::move(r), l[i]);
+        });
+    }
+    return g;
+}
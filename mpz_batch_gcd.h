@@ -0,0 +1,33 @@
+#ifndef MPZ_BATCH_GCD_H
+#define MPZ_BATCH_GCD_H
+
+
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Batch gcd
+//https://cr.yp.to/papers.html#scaledmod (Bernstein, "How to find smooth
+//parts of integers", section 20)
+//
+//Returns gcd(x_i, product of all x_j with j != i) for every nonzero x_i,
+//in quasi linear time instead of n^2 separate gcds. A product tree over
+//the inputs is reduced back down as a remainder tree, P mod x^2 at each
+//node, and the leaves give (P mod x_i^2)/x_i = P/x_i mod x_i.
+//
+//Trees only span chunkSize inputs at once: chunk products go through one
+//small top level tree and each chunk's own tree is rebuilt & dropped in
+//turn, so memory beyond the in- & output stays bounded by the chunk size.
+//Every tree level is computed in parallel on the executor.
+std::vector<Mpz> batch_gcd(std::span<const Mpz> x, MpzExecutor& executor=MpzExecutor::shared(),
+        const std::size_t chunkSize=std::size_t{1} << 16);
+
+
+
+#endif //MPZ_BATCH_GCD_H
@@ -0,0 +1,171 @@
+#include "mpz_executor.h"
+
+#include <algorithm>
+#include <utility>
+
+
+
+//Worker identity, lets submit() & run_one() prefer the worker's own deque
+static thread_local const MpzExecutor* currentExecutor = nullptr;
+static thread_local std::size_t currentIndex = 0;
+
+
+
+//Executor
+MpzExecutor::MpzExecutor(const unsigned int threads) {
+    queues.reserve(std::max(threads, 1u));
+    for(unsigned int i=0; i<std::max(threads, 1u); ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    this->threads.reserve(threads);
+    for(unsigned int i=0; i<threads; ++i) {
+        this->threads.emplace_back(&MpzExecutor::work, this, i);
+    }
+}
+
+MpzExecutor::~MpzExecutor() {
+    {
+        const std::lock_guard lock{sleepMutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& t : threads) {
+        t.join();
+    }
+    //without workers whatever is left runs here
+    while(run_one()) {}
+}
+
+MpzExecutor& MpzExecutor::shared() {
+    static MpzExecutor executor;
+    return executor;
+}
+
+unsigned int MpzExecutor::size() const {
+    return threads.size();
+}
+
+
+void MpzExecutor::submit(std::function<void()> task) {
+    const std::size_t i = currentExecutor == this ? currentIndex : next++ % queues.size();
+    ++pending;
+    {
+        const std::lock_guard lock{queues[i]->mutex};
+        queues[i]->tasks.push_back(std::move(task));
+    }
+    {
+        const std::lock_guard lock{sleepMutex};
+    }
+    wake.notify_one();
+}
+
+bool MpzExecutor::run_one() {
+    std::function<void()> task;
+    const bool own = currentExecutor == this;
+    if(own) {
+        const std::lock_guard lock{queues[currentIndex]->mutex};
+        if(!queues[currentIndex]->tasks.empty()) {
+            task = std::move(queues[currentIndex]->tasks.back());
+            queues[currentIndex]->tasks.pop_back();
+        }
+    }
+    //steal, starting after our own queue so thieves spread out
+    for(std::size_t k=0; !task && k<queues.size(); ++k) {
+        const std::size_t i = (currentIndex + 1 + k) % queues.size();
+        if(own && i == currentIndex) {
+            continue;
+        }
+        const std::lock_guard lock{queues[i]->mutex};
+        if(!queues[i]->tasks.empty()) {
+            task = std::move(queues[i]->tasks.front());
+            queues[i]->tasks.pop_front();
+        }
+    }
+    if(!task) {
+        return false;
+    }
+    --pending;
+    task();
+    return true;
+}
+
+
+void MpzExecutor::work(const std::size_t index) {
+    currentExecutor = this;
+    currentIndex = index;
+    while(true) {
+        if(run_one()) {
+            continue;
+        }
+        std::unique_lock lock{sleepMutex};
+        wake.wait(lock, [this]() { return stopping || pending > 0; });
+        if(stopping && pending == 0) {
+            return;
+        }
+    }
+}
+
+void MpzExecutor::notify_all() {
+    {
+        const std::lock_guard lock{sleepMutex};
+    }
+    wake.notify_all();
+}
+
+
+
+//Task group
+MpzTaskGroup::MpzTaskGroup(MpzExecutor& executor) : executor(executor) {}
+
+MpzTaskGroup::~MpzTaskGroup() {
+    try {
+        wait();
+    } catch(...) {}
+}
+
+
+void MpzTaskGroup::run(std::function<void()> task) {
+    ++active;
+    //the group may be gone as soon as active drops to zero
+    executor.submit([this, &executor=executor, task=std::move(task)]() {
+        try {
+            task();
+        } catch(...) {
+            const std::lock_guard lock{errorMutex};
+            if(!error) {
+                error = std::current_exception();
+            }
+        }
+        if(--active == 0) {
+            executor.notify_all();
+        }
+    });
+}
+
+void MpzTaskGroup::wait() {
+    while(active > 0) {
+        if(executor.run_one()) {
+            continue;
+        }
+        std::unique_lock lock{executor.sleepMutex};
+        executor.wake.wait(lock, [this]() { return active == 0 || executor.pending > 0; });
+    }
+    if(error) {
+        std::rethrow_exception(std::exchange(error, nullptr));
+    }
+}
+
+
+
+void parallel_for(MpzExecutor& executor, const std::size_t count, const std::function<void(std::size_t)>& f) {
+    const std::size_t block = std::max<std::size_t>(count / (4 * (executor.size() + 1)), 1);
+    MpzTaskGroup group{executor};
+    for(std::size_t begin=0; begin<count; begin+=block) {
+        group.run([&f, begin, end=std::min(count, begin + block)]() {
+            for(std::size_t i=begin; i<end; ++i) {
+                f(i);
+            }
+        });
+    }
+    group.wait();
+}
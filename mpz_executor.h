@@ -0,0 +1,102 @@
+#ifndef MPZ_EXECUTOR_H
+#define MPZ_EXECUTOR_H
+
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+//Work stealing thread pool
+//
+//Every worker owns a deque of tasks. Tasks submitted from a worker go to the
+//back of its own deque and it pops from there (newest first, good locality
+//for recursive splitting), idle workers steal from the front of the others
+//(oldest first, usually the biggest chunks). Tasks submitted from outside
+//are spread round robin.
+//
+//Threads waiting on an MpzTaskGroup help running tasks instead of blocking,
+//so tasks may wait on nested groups without starving the pool and a pool
+//with zero workers runs everything on the waiting thread.
+class MpzExecutor {
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; //one per worker, at least one
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> pending = 0;
+    std::atomic<std::size_t> next = 0;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void work(const std::size_t index);
+    void notify_all();
+
+    friend class MpzTaskGroup;
+
+public:
+    explicit MpzExecutor(const unsigned int threads=std::thread::hardware_concurrency());
+    ~MpzExecutor(); //finishes all pending tasks
+    MpzExecutor(const MpzExecutor&) = delete;
+    MpzExecutor& operator=(const MpzExecutor&) = delete;
+
+    //Process wide pool with one worker per hardware thread
+    static MpzExecutor& shared();
+
+    [[nodiscard]] unsigned int size() const; //number of workers
+
+    void submit(std::function<void()> task);
+    //Runs one pending task on the calling thread, false if there was none
+    bool run_one();
+};
+
+
+
+//Set of tasks that can be waited for
+//
+//  MpzTaskGroup g{executor};
+//  g.run([&]() { a = f(x); });
+//  g.run([&]() { b = f(y); });
+//  g.wait(); //helps running tasks until both are done
+//
+//The first exception thrown by a task is rethrown by wait(). The destructor
+//waits too, but swallows exceptions.
+class MpzTaskGroup {
+private:
+    MpzExecutor& executor;
+    std::atomic<std::size_t> active = 0;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+public:
+    explicit MpzTaskGroup(MpzExecutor& executor=MpzExecutor::shared());
+    ~MpzTaskGroup();
+    MpzTaskGroup(const MpzTaskGroup&) = delete;
+    MpzTaskGroup& operator=(const MpzTaskGroup&) = delete;
+
+    void run(std::function<void()> task);
+    void wait();
+};
+
+
+
+//Runs f(i) for every i in [0, count) in blocks spread over the executor,
+//returns when all are done
+void parallel_for(MpzExecutor& executor, const std::size_t count, const std::function<void(std::size_t)>& f);
+
+
+
+#endif //MPZ_EXECUTOR_H
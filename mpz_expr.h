@@ -0,0 +1,460 @@
+#ifndef MPZ_EXPR_H
+#define MPZ_EXPR_H
+
+
+
+#include <cstddef>
+#include <deque>
+#include <type_traits>
+
+#include "mpz.h"
+#include "mpz_alloc.h"
+
+
+
+//Lazy expression templates over Mpz.
+//
+//lazy(a) starts an expression; combined with Mpz operands, +, -, * and
+//unsigned long scalars nothing is computed until it is assigned to an Mpz.
+//The tree is then evaluated directly into the destination, fusing products
+//into mpz_addmul/mpz_submul where possible:
+//  x = lazy(a)*b + lazy(c)*d - e; //x=a*b, x+=c*d, x-=e
+//  x += lazy(a)*b;                //mpz_addmul
+//  x -= lazy(a)*3ul;              //mpz_submul_ui
+//Subexpressions that can't be fused are evaluated into thread local scratch
+//integers which keep their limbs between evaluations.
+//
+//Expressions reference their operands, so don't store them (auto e = ...).
+
+
+
+//Scratch
+class MpzScratch {
+private:
+    static inline thread_local std::deque<Mpz> pool; //deque: stable references
+    static inline thread_local std::size_t depth = 0;
+    Mpz* s;
+
+public:
+    MpzScratch() {
+        if(depth == pool.size()) {
+            pool.emplace_back();
+        }
+        s = &pool[depth++];
+    }
+    //limbs from an arena would dangle after it, they're dropped right away
+    ~MpzScratch() {
+        if(MpzArena::active()) {
+            *s = Mpz{};
+        }
+        --depth;
+    }
+    MpzScratch(const MpzScratch&) = delete;
+    MpzScratch& operator=(const MpzScratch&) = delete;
+
+    Mpz& get() const {
+        return *s;
+    }
+
+    //Frees the calling thread's idle scratch integers
+    static void release() {
+        pool.resize(depth);
+    }
+};
+
+
+
+//Base
+template<typename E>
+class MpzExpr {
+public:
+    const E& self() const {
+        return static_cast<const E&>(*this);
+    }
+
+    //Defaults for non-fusable nodes, go through a scratch integer
+    void add_to(Mpz& r) const {
+        const MpzScratch s;
+        self().eval_to(s.get());
+        r += s.get();
+    }
+    void sub_from(Mpz& r) const {
+        const MpzScratch s;
+        self().eval_to(s.get());
+        r -= s.get();
+    }
+    void mul_into(Mpz& r) const {
+        const MpzScratch s;
+        self().eval_to(s.get());
+        r *= s.get();
+    }
+};
+
+
+
+//Nodes
+class MpzTerm : public MpzExpr<MpzTerm> {
+public:
+    const Mpz& a;
+
+    explicit MpzTerm(const Mpz& a) : a(a) {}
+
+    void eval_to(Mpz& r) const {
+        if(&r != &a) {
+            r = a;
+        }
+    }
+    bool aliases(const Mpz& r) const {
+        return &r == &a;
+    }
+
+    void add_to(Mpz& r) const {
+        r += a;
+    }
+    void sub_from(Mpz& r) const {
+        r -= a;
+    }
+    void mul_into(Mpz& r) const {
+        r *= a;
+    }
+};
+
+template<typename E>
+constexpr bool isMpzTerm = std::is_same_v<E, MpzTerm>;
+
+
+//l + r, l - r
+template<typename L, typename R, bool Sub>
+class MpzSum : public MpzExpr<MpzSum<L, R, Sub>> {
+public:
+    const L l;
+    const R r;
+
+    MpzSum(const L& l, const R& r) : l(l), r(r) {}
+
+    void eval_to(Mpz& d) const {
+        if(!r.aliases(d)) {
+            l.eval_to(d);
+            if constexpr(Sub) {
+                r.sub_from(d);
+            } else {
+                r.add_to(d);
+            }
+        } else if(!l.aliases(d)) {
+            r.eval_to(d);
+            if constexpr(Sub) {
+                d.negate();
+            }
+            l.add_to(d);
+        } else {
+            const MpzScratch s;
+            eval_to(s.get());
+            d = s.get();
+        }
+    }
+    bool aliases(const Mpz& d) const {
+        return l.aliases(d) || r.aliases(d);
+    }
+
+    //r would see d already changed by l, then through a scratch
+    void add_to(Mpz& d) const {
+        if(r.aliases(d)) {
+            const MpzScratch s;
+            eval_to(s.get());
+            d += s.get();
+            return;
+        }
+        l.add_to(d);
+        if constexpr(Sub) {
+            r.sub_from(d);
+        } else {
+            r.add_to(d);
+        }
+    }
+    void sub_from(Mpz& d) const {
+        if(r.aliases(d)) {
+            const MpzScratch s;
+            eval_to(s.get());
+            d -= s.get();
+            return;
+        }
+        l.sub_from(d);
+        if constexpr(Sub) {
+            r.add_to(d);
+        } else {
+            r.sub_from(d);
+        }
+    }
+};
+
+
+//l * r
+template<typename L, typename R>
+class MpzProduct : public MpzExpr<MpzProduct<L, R>> {
+public:
+    const L l;
+    const R r;
+
+    MpzProduct(const L& l, const R& r) : l(l), r(r) {}
+
+    void eval_to(Mpz& d) const {
+        if constexpr(isMpzTerm<L> && isMpzTerm<R>) {
+            d.set_mul(l.a, r.a);
+        } else if(isMpzTerm<L> && !l.aliases(d) && !r.aliases(d)) {
+            r.eval_to(d);
+            l.mul_into(d);
+        } else if(!r.aliases(d)) {
+            l.eval_to(d);
+            r.mul_into(d);
+        } else if(!l.aliases(d)) {
+            r.eval_to(d);
+            l.mul_into(d);
+        } else {
+            const MpzScratch s;
+            eval_to(s.get());
+            d = s.get();
+        }
+    }
+    bool aliases(const Mpz& d) const {
+        return l.aliases(d) || r.aliases(d);
+    }
+
+    void add_to(Mpz& d) const {
+        fused<false>(d);
+    }
+    void sub_from(Mpz& d) const {
+        fused<true>(d);
+    }
+
+private:
+    //d +-= l*r with at most one scratch for the non-term factor
+    template<bool Sub>
+    void fused(Mpz& d) const {
+        if constexpr(isMpzTerm<L> && isMpzTerm<R>) {
+            Sub ? d.submul(l.a, r.a) : d.addmul(l.a, r.a);
+        } else if constexpr(isMpzTerm<L>) {
+            const MpzScratch s;
+            r.eval_to(s.get());
+            Sub ? d.submul(l.a, s.get()) : d.addmul(l.a, s.get());
+        } else if constexpr(isMpzTerm<R>) {
+            const MpzScratch s;
+            l.eval_to(s.get());
+            Sub ? d.submul(s.get(), r.a) : d.addmul(s.get(), r.a);
+        } else {
+            const MpzScratch s;
+            eval_to(s.get());
+            Sub ? d -= s.get() : d += s.get();
+        }
+    }
+};
+
+
+//e * k
+template<typename E>
+class MpzScaled : public MpzExpr<MpzScaled<E>> {
+public:
+    const E e;
+    const unsigned long k;
+
+    MpzScaled(const E& e, const unsigned long k) : e(e), k(k) {}
+
+    void eval_to(Mpz& d) const {
+        if constexpr(isMpzTerm<E>) {
+            d.set_mul(e.a, k);
+        } else {
+            e.eval_to(d);
+            d *= k;
+        }
+    }
+    bool aliases(const Mpz& d) const {
+        return e.aliases(d);
+    }
+
+    void add_to(Mpz& d) const {
+        fused<false>(d);
+    }
+    void sub_from(Mpz& d) const {
+        fused<true>(d);
+    }
+
+private:
+    template<bool Sub>
+    void fused(Mpz& d) const {
+        if constexpr(isMpzTerm<E>) {
+            Sub ? d.submul(e.a, k) : d.addmul(e.a, k);
+        } else {
+            const MpzScratch s;
+            e.eval_to(s.get());
+            Sub ? d.submul(s.get(), k) : d.addmul(s.get(), k);
+        }
+    }
+};
+
+
+//e + k, e - k, k - e
+template<typename E>
+class MpzOffset : public MpzExpr<MpzOffset<E>> {
+public:
+    enum Kind {ADD, SUB, RSUB};
+
+    const E e;
+    const unsigned long k;
+    const Kind kind;
+
+    MpzOffset(const E& e, const unsigned long k, const Kind kind) : e(e), k(k), kind(kind) {}
+
+    void eval_to(Mpz& d) const {
+        e.eval_to(d);
+        switch(kind) {
+            case ADD:
+                d += k;
+                break;
+            case SUB:
+                d -= k;
+                break;
+            case RSUB:
+                d.negate();
+                d += k;
+                break;
+        }
+    }
+    bool aliases(const Mpz& d) const {
+        return e.aliases(d);
+    }
+};
+
+
+//-e
+template<typename E>
+class MpzNegation : public MpzExpr<MpzNegation<E>> {
+public:
+    const E e;
+
+    explicit MpzNegation(const E& e) : e(e) {}
+
+    void eval_to(Mpz& d) const {
+        e.eval_to(d);
+        d.negate();
+    }
+    bool aliases(const Mpz& d) const {
+        return e.aliases(d);
+    }
+
+    void add_to(Mpz& d) const {
+        e.sub_from(d);
+    }
+    void sub_from(Mpz& d) const {
+        e.add_to(d);
+    }
+};
+
+
+
+//Construction
+inline MpzTerm lazy(const Mpz& a) {
+    return MpzTerm{a};
+}
+
+
+
+//Operators
+template<typename E>
+MpzNegation<E> operator-(const MpzExpr<E>& e) {
+    return MpzNegation<E>{e.self()};
+}
+
+
+template<typename L, typename R>
+MpzSum<L, R, false> operator+(const MpzExpr<L>& l, const MpzExpr<R>& r) {
+    return {l.self(), r.self()};
+}
+template<typename L>
+MpzSum<L, MpzTerm, false> operator+(const MpzExpr<L>& l, const Mpz& r) {
+    return {l.self(), MpzTerm{r}};
+}
+template<typename R>
+MpzSum<MpzTerm, R, false> operator+(const Mpz& l, const MpzExpr<R>& r) {
+    return {MpzTerm{l}, r.self()};
+}
+template<typename E>
+MpzOffset<E> operator+(const MpzExpr<E>& e, const unsigned long k) {
+    return {e.self(), k, MpzOffset<E>::ADD};
+}
+template<typename E>
+MpzOffset<E> operator+(const unsigned long k, const MpzExpr<E>& e) {
+    return {e.self(), k, MpzOffset<E>::ADD};
+}
+
+
+template<typename L, typename R>
+MpzSum<L, R, true> operator-(const MpzExpr<L>& l, const MpzExpr<R>& r) {
+    return {l.self(), r.self()};
+}
+template<typename L>
+MpzSum<L, MpzTerm, true> operator-(const MpzExpr<L>& l, const Mpz& r) {
+    return {l.self(), MpzTerm{r}};
+}
+template<typename R>
+MpzSum<MpzTerm, R, true> operator-(const Mpz& l, const MpzExpr<R>& r) {
+    return {MpzTerm{l}, r.self()};
+}
+template<typename E>
+MpzOffset<E> operator-(const MpzExpr<E>& e, const unsigned long k) {
+    return {e.self(), k, MpzOffset<E>::SUB};
+}
+template<typename E>
+MpzOffset<E> operator-(const unsigned long k, const MpzExpr<E>& e) {
+    return {e.self(), k, MpzOffset<E>::RSUB};
+}
+
+
+template<typename L, typename R>
+MpzProduct<L, R> operator*(const MpzExpr<L>& l, const MpzExpr<R>& r) {
+    return {l.self(), r.self()};
+}
+template<typename L>
+MpzProduct<L, MpzTerm> operator*(const MpzExpr<L>& l, const Mpz& r) {
+    return {l.self(), MpzTerm{r}};
+}
+template<typename R>
+MpzProduct<MpzTerm, R> operator*(const Mpz& l, const MpzExpr<R>& r) {
+    return {MpzTerm{l}, r.self()};
+}
+template<typename E>
+MpzScaled<E> operator*(const MpzExpr<E>& e, const unsigned long k) {
+    return {e.self(), k};
+}
+template<typename E>
+MpzScaled<E> operator*(const unsigned long k, const MpzExpr<E>& e) {
+    return {e.self(), k};
+}
+
+
+
+//Mpz members
+template<typename E>
+Mpz::Mpz(const MpzExpr<E>& e) : Mpz() {
+    e.self().eval_to(*this);
+}
+
+template<typename E>
+Mpz& Mpz::operator=(const MpzExpr<E>& e) {
+    e.self().eval_to(*this);
+    return *this;
+}
+
+template<typename E>
+Mpz& Mpz::operator+=(const MpzExpr<E>& e) {
+    e.self().add_to(*this);
+    return *this;
+}
+
+template<typename E>
+Mpz& Mpz::operator-=(const MpzExpr<E>& e) {
+    e.self().sub_from(*this);
+    return *this;
+}
+
+
+
+#endif //MPZ_EXPR_H
@@ -0,0 +1,479 @@
+#include "mpz_factor.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <mutex>
+
+
+
+//Primes
+//Sieve of Eratosthenes, prime_table(limit)[i] tells if i is prime for
+//i <= limit. Per thread and grown on demand for the stage 2 bounds.
+static const std::vector<bool>& prime_table(const unsigned long limit) {
+    static thread_local std::vector<bool> table;
+    if(table.size() <= limit) {
+        table.assign(limit+1, true);
+        table[0] = false;
+        table[1] = false;
+        for(unsigned long p=2; p*p<=limit; ++p) {
+            if(table[p]) {
+                for(unsigned long q=p*p; q<=limit; q+=p) {
+                    table[q] = false;
+                }
+            }
+        }
+    }
+    return table;
+}
+
+const std::vector<unsigned long>& small_primes() {
+    static const std::vector<unsigned long> primes = []() {
+        constexpr unsigned long limit = 1ul << 16;
+        std::vector<bool> isPrime(limit, true);
+        std::vector<unsigned long> p;
+        for(unsigned long i=2; i<limit; ++i) {
+            if(isPrime[i]) {
+                p.push_back(i);
+                for(unsigned long j=i*i; j<limit; j+=i) {
+                    isPrime[j] = false;
+                }
+            }
+        }
+        return p;
+    }();
+    return primes;
+}
+
+//Largest power of p not exceeding bound
+static unsigned long prime_power(const unsigned long p, const unsigned long bound) {
+    unsigned long q = p;
+    while(q <= bound/p) {
+        q *= p;
+    }
+    return q;
+}
+
+
+
+//Pollard rho
+//https://maths-people.anu.edu.au/~brent/pub/pub051.html
+Mpz pollard_rho(const Mpz& N, const unsigned long c, const unsigned long maxIterations, const std::stop_token stop) {
+    constexpr unsigned long m = 128; //steps per gcd
+    const mpz_srcptr n = N.get_mpz_t();
+    Mpz X, Y{2ul}, Ys, Q{1ul}, G{1ul}, T, U;
+    const mpz_ptr x = X.get_mpz_t(), y = Y.get_mpz_t(), ys = Ys.get_mpz_t();
+    const mpz_ptr q = Q.get_mpz_t(), g = G.get_mpz_t(), t = T.get_mpz_t(), u = U.get_mpz_t();
+
+    const auto step = [n, c, t](const mpz_ptr z) {
+        mpz_mul(t, z, z);
+        mpz_add_ui(t, t, c);
+        mpz_mod(z, t, n);
+    };
+
+    unsigned long r = 1, iterations = 0;
+    do {
+        mpz_set(x, y);
+        for(unsigned long i=0; i<r; ++i) {
+            step(y);
+        }
+        for(unsigned long k=0; k<r && mpz_cmp_ui(g, 1) == 0 && !stop.stop_requested(); k+=m) {
+            mpz_set(ys, y);
+            for(unsigned long i=0; i<std::min(m, r-k); ++i) {
+                step(y);
+                mpz_sub(u, x, y);
+                mpz_mul(t, q, u);
+                mpz_mod(q, t, n);
+            }
+            mpz_gcd(g, q, n);
+        }
+        iterations += r;
+        r *= 2;
+    } while(mpz_cmp_ui(g, 1) == 0 && iterations < maxIterations && !stop.stop_requested());
+
+    if(mpz_cmp(g, n) == 0) {
+        //the batch overshot, redo it one gcd at a time
+        for(unsigned long i=0; i<m && (i == 0 || mpz_cmp_ui(g, 1) == 0); ++i) {
+            step(ys);
+            mpz_sub(u, x, ys);
+            mpz_gcd(g, u, n);
+        }
+    }
+    if(mpz_cmp_ui(g, 1) == 0 || mpz_cmp(g, n) == 0) {
+        return Mpz{};
+    }
+    return G;
+}
+
+
+
+//Pollard p-1
+Mpz pollard_pm1(const Mpz& N, const unsigned long B1, const unsigned long B2, const std::stop_token stop) {
+    const mpz_srcptr n = N.get_mpz_t();
+    const std::vector<bool>& isPrime = prime_table(B2);
+    Mpz A{2ul}, G, T;
+    const mpz_ptr a = A.get_mpz_t(), g = G.get_mpz_t(), t = T.get_mpz_t();
+
+    //stage 1: a = 2^(lcm(1..B1))
+    for(unsigned long p=2; p<=B1; ++p) {
+        if(isPrime[p]) {
+            if(stop.stop_requested()) {
+                return Mpz{};
+            }
+            mpz_powm_ui(a, a, prime_power(p, B1), n);
+        }
+    }
+    mpz_sub_ui(t, a, 1);
+    mpz_gcd(g, t, n);
+    if(mpz_cmp_ui(g, 1) != 0) {
+        return mpz_cmp(g, n) ? G : Mpz{};
+    }
+
+    //stage 2: accumulate a^q-1 for primes q in (B1, B2], stepping through
+    //the prime gaps with a table of a^(2k)
+    std::vector<Mpz> gaps(1);
+    Mpz X, Acc{1ul};
+    const mpz_ptr x = X.get_mpz_t(), acc = Acc.get_mpz_t();
+    unsigned long prev = 0;
+    for(unsigned long q=B1+1; q<=B2; ++q) {
+        if(!isPrime[q]) {
+            continue;
+        }
+        if(stop.stop_requested()) {
+            return Mpz{};
+        }
+        if(!prev) {
+            mpz_powm_ui(x, a, q, n);
+        } else {
+            const unsigned long k = (q - prev) / 2;
+            while(gaps.size() <= k) {
+                Mpz& e = gaps.emplace_back();
+                if(gaps.size() == 2) {
+                    mpz_powm_ui(e.get_mpz_t(), a, 2, n);
+                } else {
+                    mpz_mul(t, gaps[gaps.size()-2].get_mpz_t(), gaps[1].get_mpz_t());
+                    mpz_mod(e.get_mpz_t(), t, n);
+                }
+            }
+            mpz_mul(t, x, gaps[k].get_mpz_t());
+            mpz_mod(x, t, n);
+        }
+        prev = q;
+        mpz_sub_ui(g, x, 1);
+        mpz_mul(t, acc, g);
+        mpz_mod(acc, t, n);
+    }
+    mpz_gcd(g, acc, n);
+    if(mpz_cmp_ui(g, 1) == 0 || mpz_cmp(g, n) == 0) {
+        return Mpz{};
+    }
+    return G;
+}
+
+
+
+//ECM
+//https://members.loria.fr/PZimmermann/papers/ecm-submitted.pdf
+//Points are kept projectively as (X:Z), only X-coordinate arithmetic.
+struct EcmPoint {
+    Mpz x, z;
+};
+
+class EcmCurve {
+private:
+    const mpz_srcptr n;
+    Mpz A24, T1, T2, T3, T4;
+    const mpz_ptr a24, t1, t2, t3, t4;
+
+    void mulmod(const mpz_ptr r, const mpz_srcptr a, const mpz_srcptr b) {
+        mpz_mul(t4, a, b);
+        mpz_mod(r, t4, n);
+    }
+
+public:
+    EcmCurve(const mpz_srcptr n, const Mpz& a24) : n(n), A24(a24),
+            a24(A24.get_mpz_t()), t1(T1.get_mpz_t()), t2(T2.get_mpz_t()), t3(T3.get_mpz_t()), t4(T4.get_mpz_t()) {}
+
+    //r = 2p, r may be p
+    void dbl(EcmPoint& r, EcmPoint& p) {
+        mpz_add(t1, p.x.get_mpz_t(), p.z.get_mpz_t());
+        mulmod(t1, t1, t1);
+        mpz_sub(t2, p.x.get_mpz_t(), p.z.get_mpz_t());
+        mulmod(t2, t2, t2);
+        mpz_sub(t3, t1, t2);
+        mulmod(r.x.get_mpz_t(), t1, t2);
+        mulmod(t1, a24, t3);
+        mpz_add(t1, t1, t2);
+        mulmod(r.z.get_mpz_t(), t3, t1);
+    }
+
+    //r = p+q with d = p-q, r may be p or q but not d
+    void add(EcmPoint& r, EcmPoint& p, EcmPoint& q, EcmPoint& d) {
+        mpz_sub(t1, p.x.get_mpz_t(), p.z.get_mpz_t());
+        mpz_add(t2, q.x.get_mpz_t(), q.z.get_mpz_t());
+        mulmod(t1, t1, t2);
+        mpz_add(t2, p.x.get_mpz_t(), p.z.get_mpz_t());
+        mpz_sub(t3, q.x.get_mpz_t(), q.z.get_mpz_t());
+        mulmod(t2, t2, t3);
+        mpz_add(t3, t1, t2);
+        mulmod(t3, t3, t3);
+        mpz_sub(t1, t1, t2);
+        mulmod(t1, t1, t1);
+        mulmod(r.x.get_mpz_t(), d.z.get_mpz_t(), t3);
+        mulmod(r.z.get_mpz_t(), d.x.get_mpz_t(), t1);
+    }
+
+    //p = kp, Montgomery ladder
+    void mul(EcmPoint& p, const unsigned long k) {
+        if(k < 2) {
+            return;
+        }
+        EcmPoint r0 = p, r1;
+        dbl(r1, p);
+        for(int i=std::bit_width(k)-2; i>=0; --i) {
+            if((k >> i) & 1) {
+                add(r0, r0, r1, p);
+                dbl(r1, r1);
+            } else {
+                add(r1, r0, r1, p);
+                dbl(r0, r0);
+            }
+        }
+        p = std::move(r0);
+    }
+};
+
+Mpz ecm(const Mpz& N, const unsigned long B1, const unsigned long B2, const unsigned long sigma, const std::stop_token stop) {
+    constexpr unsigned long D = 2*3*5*7; //giant step
+    const mpz_srcptr n = N.get_mpz_t();
+    Mpz U, V, T, G, A24;
+    const mpz_ptr u = U.get_mpz_t(), v = V.get_mpz_t(), t = T.get_mpz_t(), g = G.get_mpz_t(), a24 = A24.get_mpz_t();
+
+    //Suyama: u = sigma^2-5, v = 4sigma, P = (u^3 : v^3),
+    //(A+2)/4 = (v-u)^3 (3u+v) / (16 u^3 v)
+    EcmPoint P;
+    mpz_set_ui(u, sigma);
+    mpz_mul(u, u, u);
+    mpz_sub_ui(u, u, 5);
+    mpz_mod(u, u, n);
+    mpz_set_ui(v, sigma);
+    mpz_mul_ui(v, v, 4);
+    mpz_mod(v, v, n);
+    mpz_powm_ui(P.x.get_mpz_t(), u, 3, n);
+    mpz_powm_ui(P.z.get_mpz_t(), v, 3, n);
+    mpz_mul(t, P.x.get_mpz_t(), v);
+    mpz_mul_ui(t, t, 16);
+    mpz_mod(t, t, n);
+    if(!mpz_invert(t, t, n)) {
+        mpz_gcd(g, t, n);
+        return mpz_cmp_ui(g, 1) && mpz_cmp(g, n) ? G : Mpz{};
+    }
+    mpz_sub(a24, v, u);
+    mpz_powm_ui(a24, a24, 3, n);
+    mpz_mul(a24, a24, t);
+    mpz_mul_ui(t, u, 3);
+    mpz_add(t, t, v);
+    mpz_mul(a24, a24, t);
+    mpz_mod(a24, a24, n);
+    EcmCurve curve{n, A24};
+
+    //stage 1
+    const std::vector<bool>& isPrime = prime_table(B2 + D);
+    for(unsigned long p=2; p<=B1; ++p) {
+        if(isPrime[p]) {
+            if(stop.stop_requested()) {
+                return Mpz{};
+            }
+            curve.mul(P, prime_power(p, B1));
+        }
+    }
+    mpz_gcd(g, P.z.get_mpz_t(), n);
+    if(mpz_cmp_ui(g, 1) != 0) {
+        return mpz_cmp(g, n) ? G : Mpz{};
+    }
+
+    //stage 2: p = mD+-j is caught by X(mD P)Z(j P) - X(j P)Z(mD P) = 0 mod p
+    //baby steps: odd multiples jP, j < D/2
+    std::vector<EcmPoint> baby(D/2);
+    EcmPoint P2;
+    curve.dbl(P2, P);
+    baby[1] = P;
+    curve.add(baby[3], P, P2, P);
+    for(unsigned long j=5; j<D/2; j+=2) {
+        curve.add(baby[j], baby[j-2], P2, baby[j-4]);
+    }
+    //giant steps: R = mD P, walking with S = D P and difference R-S
+    const unsigned long m0 = std::max(B1/D, 2ul);
+    EcmPoint S = P, R = P, Rprev = P;
+    curve.mul(S, D);
+    curve.mul(R, m0*D);
+    curve.mul(Rprev, (m0-1)*D);
+    Mpz Acc{1ul}, W;
+    const mpz_ptr acc = Acc.get_mpz_t(), w = W.get_mpz_t();
+    for(unsigned long m=m0; m*D <= B2 + D/2; ++m) {
+        if(stop.stop_requested()) {
+            return Mpz{};
+        }
+        for(unsigned long j=1; j<D/2; j+=2) {
+            const unsigned long lo = m*D - j, hi = m*D + j;
+            if(std::gcd(j, D) != 1 || !((lo > B1 && lo <= B2 && isPrime[lo]) || (hi > B1 && hi <= B2 && isPrime[hi]))) {
+                continue;
+            }
+            mpz_mul(t, R.x.get_mpz_t(), baby[j].z.get_mpz_t());
+            mpz_submul(t, baby[j].x.get_mpz_t(), R.z.get_mpz_t());
+            mpz_mul(w, acc, t);
+            mpz_mod(acc, w, n);
+        }
+        EcmPoint next;
+        curve.add(next, R, S, Rprev);
+        Rprev = std::move(R);
+        R = std::move(next);
+    }
+    mpz_gcd(g, acc, n);
+    if(mpz_cmp_ui(g, 1) == 0 || mpz_cmp(g, n) == 0) {
+        return Mpz{};
+    }
+    return G;
+}
+
+
+
+//Driver
+//Attempts at splitting a cofactor are numbered: 0 is rho, 1 is p-1 and the
+//rest are ECM curves along GMP-ECM's recommended B1 & curves for factors of
+//15, 20, ..., 40 digits, the last level repeats forever. Curve parameters
+//only depend on the number, so results don't depend on the scheduling.
+static Mpz attempt(const Mpz& n, const unsigned long i, const std::stop_token& stop) {
+    constexpr unsigned long schedule[][2] = {
+        {2'000, 25}, {11'000, 90}, {50'000, 300}, {250'000, 700},
+        {1'000'000, 1'800}, {3'000'000, 5'100},
+    };
+    if(i == 0) {
+        return pollard_rho(n, 1, 1ul << 16, stop);
+    }
+    if(i == 1) {
+        return pollard_pm1(n, 100'000, 5'000'000, stop);
+    }
+    unsigned long c = i - 2;
+    std::size_t level = 0;
+    while(level+1 < std::size(schedule) && c >= schedule[level][1]) {
+        c -= schedule[level][1];
+        ++level;
+    }
+    //splitmix64 of the attempt number, sigma in [6, 2^62+5]
+    unsigned long z = i * 0x9e3779b97f4a7c15ul;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ul;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebul;
+    z ^= z >> 31;
+    const unsigned long B1 = schedule[level][0];
+    return ecm(n, B1, 50*B1, (z >> 2) + 6, stop);
+}
+
+//Splits an odd composite without small factors. One racer per thread pulls
+//attempts until the first factor shows up, then all of them are cancelled.
+static Mpz find_factor(const Mpz& n, MpzExecutor& executor) {
+    std::atomic<unsigned long> next = 0;
+    std::stop_source stop;
+    std::mutex mutex;
+    Mpz factor;
+    const auto racer = [&]() {
+        while(!stop.stop_requested()) {
+            Mpz f = attempt(n, next++, stop.get_token());
+            if(f) {
+                const std::lock_guard lock{mutex};
+                if(!factor) {
+                    factor = std::move(f);
+                }
+                stop.request_stop();
+            }
+        }
+    };
+    MpzTaskGroup group{executor};
+    for(unsigned int i=0; i<=executor.size(); ++i) {
+        group.run(racer);
+    }
+    group.wait();
+    return factor;
+}
+
+std::vector<std::pair<Mpz, unsigned long>> factorise(Mpz n) {
+    return factorise(std::move(n), 1);
+}
+
+std::vector<std::pair<Mpz, unsigned long>> factorise(Mpz n, const unsigned int threads) {
+    MpzExecutor executor{threads ? threads-1 : 0};
+    return factorise(std::move(n), executor);
+}
+
+std::vector<std::pair<Mpz, unsigned long>> factorise(Mpz n, MpzExecutor& executor) {
+    if(n == 0l) {
+        return {{Mpz(), 1}};
+    }
+
+    std::vector<std::pair<Mpz, unsigned long>> f;
+    if(n < 0l) {
+        f.emplace_back(Mpz{-1l}, 1);
+        n = abs(std::move(n));
+    }
+
+    //trial division
+    for(const unsigned long p : small_primes()) {
+        if(n < p*p) {
+            break;
+        }
+        if(mpz_divisible_ui_p(n.get_mpz_t(), p)) {
+            unsigned long e = 0;
+            do {
+                n /= p;
+                ++e;
+            } while(mpz_divisible_ui_p(n.get_mpz_t(), p));
+            f.emplace_back(Mpz{p}, e);
+        }
+    }
+
+    //cofactors with multiplicities, both halves of a split are worked on
+    //in parallel
+    std::mutex mutex;
+    MpzTaskGroup group{executor};
+    std::function<void(Mpz, unsigned long)> split = [&](Mpz m, unsigned long e) {
+        const unsigned long last = small_primes().back();
+        while(!(m < last*last || m.is_probable_prime())) {
+            if(mpz_perfect_power_p(m.get_mpz_t())) {
+                for(unsigned long k=m.size_in_base(2); k>=2; --k) {
+                    Mpz r = root(m, k);
+                    if(pow(r, k) == m) {
+                        m = std::move(r);
+                        e *= k;
+                        break;
+                    }
+                }
+                continue;
+            }
+            Mpz d = find_factor(m, executor);
+            m /= d;
+            group.run([&split, d=std::move(d), e]() mutable {
+                split(std::move(d), e);
+            });
+        }
+        const std::lock_guard lock{mutex};
+        f.emplace_back(std::move(m), e);
+    };
+    if(n > 1ul) {
+        split(std::move(n), 1);
+    }
+    group.wait();
+
+    //merge equal primes found via different cofactors
+    std::sort(f.begin(), f.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    std::vector<std::pair<Mpz, unsigned long>> r;
+    for(auto& [p, e] : f) {
+        if(!r.empty() && r.back().first == p) {
+            r.back().second += e;
+        } else {
+            r.emplace_back(std::move(p), e);
+        }
+    }
+    return r;
+}
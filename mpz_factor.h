@@ -0,0 +1,52 @@
+#ifndef MPZ_FACTOR_H
+#define MPZ_FACTOR_H
+
+
+
+#include <stop_token>
+#include <vector>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Factorization engine behind factorise()
+//
+//factorise(n) runs, until every cofactor is a probable prime:
+//  1. trial division by the primes below 2^16 with unsigned long divisors
+//  2. perfect power detection
+//  3. Pollard rho (Brent's variant)
+//  4. Pollard p-1
+//  5. ECM with growing bounds, standard B1/curve schedule
+//https://gmplib.org/manual/Number-Theoretic-Functions
+//
+//Independent rho, p-1 & ECM attempts run in parallel on an executor, the
+//first factor found cancels the others and both cofactors are split in
+//parallel again. The result doesn't depend on the number of threads.
+//
+//The methods below each look for one non-trivial factor of an odd composite
+//n and return it, or 0 if they didn't find one or got stopped.
+
+
+
+//threads counts the calling thread, factorise(n) is factorise(n, 1)
+std::vector<std::pair<Mpz, unsigned long>> factorise(Mpz n, const unsigned int threads);
+std::vector<std::pair<Mpz, unsigned long>> factorise(Mpz n, MpzExecutor& executor);
+
+//Primes below 2^16, ascending
+const std::vector<unsigned long>& small_primes();
+
+//Brent's rho on x -> x^2+c, gives up after about maxIterations steps
+Mpz pollard_rho(const Mpz& n, const unsigned long c, const unsigned long maxIterations, const std::stop_token stop={});
+
+//Stage 1 up to B1, stage 2 over the primes in (B1, B2]
+Mpz pollard_pm1(const Mpz& n, const unsigned long B1, const unsigned long B2, const std::stop_token stop={});
+
+//One curve on a Montgomery curve with Suyama's parametrization by sigma>5,
+//stage 1 up to B1, baby-step giant-step stage 2 over primes in (B1, B2]
+Mpz ecm(const Mpz& n, const unsigned long B1, const unsigned long B2, const unsigned long sigma, const std::stop_token stop={});
+
+
+
+#endif //MPZ_FACTOR_H
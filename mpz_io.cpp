@@ -0,0 +1,365 @@
+#include "mpz_io.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mpz_alloc.h"
+
+
+
+static constexpr std::size_t chunkDigits = std::size_t{1} << 13;
+//quotients at least this long are split on separate tasks
+static constexpr std::size_t parallelLimbs = 2048;
+
+
+static void check_base(const int base) {
+    if(base < 2 || base > 62) {
+        throw std::invalid_argument("Mpz: base must be in [2, 62]");
+    }
+}
+
+//base^(chunkDigits*2^k), computed once per process and kept, outside of any
+//arena (see mpz_alloc.h).
+//Deques don't move their elements, references stay valid while growing.
+static std::mutex powersMutex;
+static std::deque<Mpz> powers[63];
+
+static const Mpz& radix_power(const int base, const unsigned int k) {
+    const std::lock_guard lock{powersMutex};
+    const MpzArena::Suspend suspend;
+    std::deque<Mpz>& p = powers[base];
+    if(p.empty()) {
+        mpz_ui_pow_ui(p.emplace_back().get_mpz_t(), base, chunkDigits);
+    }
+    while(p.size() <= k) {
+        Mpz& next = p.emplace_back();
+        next.set_mul(p[p.size()-2], p[p.size()-2]);
+    }
+    return p[k];
+}
+
+
+void release_radix_powers() {
+    const std::lock_guard lock{powersMutex};
+    for(std::deque<Mpz>& p : powers) {
+        p.clear();
+    }
+}
+
+
+
+//Output
+//0 <= n < base^(chunkDigits*2^k) into 2^k chunks, most significant first.
+//out has to be zero already.
+static void split(const Mpz& n, const unsigned int k, Mpz* const out, const int base, MpzExecutor& executor) {
+    if(k == 0) {
+        *out = n;
+        return;
+    }
+    if(!n) {
+        return;
+    }
+    Mpz q, r;
+    mpz_tdiv_qr(q.get_mpz_t(), r.get_mpz_t(), n.get_mpz_t(), radix_power(base, k-1).get_mpz_t());
+    Mpz* const low = out + (std::size_t{1} << (k-1));
+    if(mpz_size(q.get_mpz_t()) >= parallelLimbs) {
+        MpzTaskGroup group{executor};
+        group.run([&q, k, out, base, &executor]() {
+            split(q, k-1, out, base, executor);
+        });
+        split(r, k-1, low, base, executor);
+        group.wait();
+    } else {
+        split(q, k-1, out, base, executor);
+        split(r, k-1, low, base, executor);
+    }
+}
+
+//|x| in chunks without leading zero chunks
+static std::vector<Mpz> chunks(const Mpz& x, const int base, MpzExecutor& executor) {
+    const std::size_t digits = x.size_in_base(base);
+    unsigned int k = 0;
+    while((chunkDigits << k) < digits) {
+        ++k;
+    }
+    std::vector<Mpz> c(std::size_t{1} << k);
+    split(abs(x), k, c.data(), base, executor);
+    const auto nonzero = std::find_if(c.begin(), c.end(), [](const Mpz& v) { return static_cast<bool>(v); });
+    c.erase(c.begin(), nonzero == c.end() ? c.end() - 1 : nonzero);
+    return c;
+}
+
+//Digits of c >= 0, valid until the next call on the same thread
+static std::string_view digits_of(const Mpz& c, const int base) {
+    thread_local std::string s;
+    const std::size_t n = c.size_in_base(base);
+    s.resize(n + 1);
+    mpz_get_str(s.data(), base, c.get_mpz_t());
+    return {s.data(), s[n-1] ? n : n-1}; //size_in_base may be one too big
+}
+
+//Exactly chunkDigits digits, zero padded
+static void padded_digits_of(const Mpz& c, char* const out, const int base) {
+    const std::string_view d = digits_of(c, base);
+    std::fill_n(out, chunkDigits - d.size(), '0');
+    std::copy(d.begin(), d.end(), out + chunkDigits - d.size());
+}
+
+
+std::to_chars_result to_chars(char* first, char* const last, const Mpz& x, const int base, MpzExecutor& executor) {
+    if(base < 2 || base > 62) {
+        return {last, std::errc::invalid_argument};
+    }
+    const std::vector<Mpz> c = chunks(x, base, executor);
+    const std::string head = (sgn(x) < 0 ? "-" : "") + std::string{digits_of(c[0], base)};
+    if(head.size() + (c.size()-1)*chunkDigits > static_cast<std::size_t>(last - first)) {
+        return {last, std::errc::value_too_large};
+    }
+    first = std::copy(head.begin(), head.end(), first);
+    parallel_for(executor, c.size()-1, [&c, first, base](const std::size_t i) {
+        padded_digits_of(c[i+1], first + i*chunkDigits, base);
+    });
+    return {first + (c.size()-1)*chunkDigits, std::errc{}};
+}
+
+
+//Converts batches of chunks in parallel and hands them to sink in order
+static std::size_t write_chunks(const Mpz& x, const int base, MpzExecutor& executor,
+        const std::function<void(const char*, std::size_t)>& sink) {
+    check_base(base);
+    std::vector<Mpz> c = chunks(x, base, executor);
+    const std::string head = (sgn(x) < 0 ? "-" : "") + std::string{digits_of(c[0], base)};
+    sink(head.data(), head.size());
+
+    const std::size_t batch = std::min<std::size_t>(4 * (executor.size() + 1), c.size()-1);
+    std::vector<char> buffer(batch * chunkDigits);
+    for(std::size_t begin=1; begin<c.size(); begin+=batch) {
+        const std::size_t n = std::min(batch, c.size() - begin);
+        parallel_for(executor, n, [&c, &buffer, begin, base](const std::size_t i) {
+            padded_digits_of(c[begin+i], buffer.data() + i*chunkDigits, base);
+            c[begin+i] = Mpz{};
+        });
+        sink(buffer.data(), n * chunkDigits);
+    }
+    return head.size() + (c.size()-1)*chunkDigits;
+}
+
+std::size_t write_digits(std::ostream& os, const Mpz& x, const int base, MpzExecutor& executor) {
+    return write_chunks(x, base, executor, [&os](const char* const s, const std::size_t n) {
+        os.write(s, static_cast<std::streamsize>(n));
+    });
+}
+
+std::size_t write_digits(const int fd, const Mpz& x, const int base, MpzExecutor& executor) {
+    return write_chunks(x, base, executor, [fd](const char* s, std::size_t n) {
+        while(n) {
+            const ssize_t w = ::write(fd, s, n);
+            if(w < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "write_digits");
+            }
+            s += w;
+            n -= w;
+        }
+    });
+}
+
+
+
+//Input
+//Digit values like mpz_set_str, 255 for non digits
+static unsigned char digit_value(const char c, const int base) {
+    if('0' <= c && c <= '9') {
+        return c - '0';
+    }
+    if('a' <= c && c <= 'z') {
+        return c - 'a' + (base <= 36 ? 10 : 36);
+    }
+    if('A' <= c && c <= 'Z') {
+        return c - 'A' + 10;
+    }
+    return 255;
+}
+
+//mpz_set_str of the digits [first, last), which need a terminating zero
+static void set_digits(const char* const first, const char* const last, Mpz& x, const int base) {
+    thread_local std::string s;
+    s.assign(first, last);
+    mpz_set_str(x.get_mpz_t(), s.c_str(), base);
+}
+
+//Chunks least significant first, combined as high*base^(chunkDigits*2^k) + low
+//with 2^k < count chunks in the low part
+static Mpz combine(const std::vector<Mpz>& c, const std::size_t begin, const std::size_t count,
+        const int base, MpzExecutor& executor) {
+    if(count == 1) {
+        return c[begin];
+    }
+    const unsigned int k = std::bit_width(count - 1) - 1;
+    const std::size_t lowCount = std::size_t{1} << k;
+    Mpz low, high;
+    if(lowCount * chunkDigits >= parallelLimbs * 16) {
+        MpzTaskGroup group{executor};
+        group.run([&]() {
+            low = combine(c, begin, lowCount, base, executor);
+        });
+        high = combine(c, begin + lowCount, count - lowCount, base, executor);
+        group.wait();
+    } else {
+        low = combine(c, begin, lowCount, base, executor);
+        high = combine(c, begin + lowCount, count - lowCount, base, executor);
+    }
+    high *= radix_power(base, k);
+    return std::move(high) + std::move(low);
+}
+
+//Digits [first, last) of a power of two base, every limb gathers its bits
+static void pack_bits(const char* const first, const char* const last, Mpz& x, const int base, MpzExecutor& executor) {
+    const unsigned int b = std::countr_zero(static_cast<unsigned int>(base));
+    const std::size_t digits = last - first;
+    const std::size_t limbs = (digits * b + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    const mpz_ptr X = x.get_mpz_t();
+    mp_limb_t* const d = mpz_limbs_write(X, limbs);
+    const auto gather = [=](const std::size_t i) {
+        //digit j from the right holds bits [b*j, b*j+b)
+        const std::size_t lo = i * GMP_NUMB_BITS;
+        mp_limb_t limb = 0;
+        for(std::size_t j=lo/b; j<digits && j*b<lo+GMP_NUMB_BITS; ++j) {
+            const mp_limb_t v = digit_value(last[-1 - static_cast<std::ptrdiff_t>(j)], base);
+            limb |= j*b >= lo ? v << (j*b - lo) : v >> (lo - j*b);
+        }
+        d[i] = limb;
+    };
+    if(limbs >= parallelLimbs) {
+        parallel_for(executor, limbs, gather);
+    } else {
+        for(std::size_t i=0; i<limbs; ++i) {
+            gather(i);
+        }
+    }
+    mpz_limbs_finish(X, limbs);
+}
+
+std::from_chars_result from_chars(const char* const first, const char* const last, Mpz& x, const int base,
+        MpzExecutor& executor) {
+    if(base < 2 || base > 62) {
+        return {first, std::errc::invalid_argument};
+    }
+    const bool negative = first != last && *first == '-';
+    const char* const begin = first + negative;
+    const char* end = begin;
+    while(end != last && digit_value(*end, base) < base) {
+        ++end;
+    }
+    if(end == begin) {
+        return {first, std::errc::invalid_argument};
+    }
+
+    Mpz r;
+    if(std::has_single_bit(static_cast<unsigned int>(base))) {
+        pack_bits(begin, end, r, base, executor);
+    } else {
+        //chunks aligned to the right end, the most significant one may be short
+        const std::size_t digits = end - begin;
+        std::vector<Mpz> c((digits + chunkDigits - 1) / chunkDigits);
+        if(c.size() == 1) {
+            set_digits(begin, end, r, base);
+        } else {
+            parallel_for(executor, c.size(), [&c, begin, end, base](const std::size_t i) {
+                const char* const e = end - i*chunkDigits;
+                set_digits(std::max(begin, e - static_cast<std::ptrdiff_t>(chunkDigits)), e, c[i], base);
+            });
+            r = combine(c, 0, c.size(), base, executor);
+        }
+    }
+    x = negative ? -std::move(r) : std::move(r);
+    return {end, std::errc{}};
+}
+
+std::from_chars_result from_chars(const std::string_view s, Mpz& x, const int base, MpzExecutor& executor) {
+    return from_chars(s.data(), s.data() + s.size(), x, base, executor);
+}
+
+
+Mpz load_digits(const std::string& path, const int base, MpzExecutor& executor) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat st;
+    if(::fstat(fd, &st) < 0) {
+        const int e = errno;
+        ::close(fd);
+        throw std::system_error(e, std::generic_category(), path);
+    }
+    const std::size_t size = st.st_size;
+    void* const map = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    const int e = errno;
+    ::close(fd);
+    if(map == MAP_FAILED) {
+        throw std::system_error(e, std::generic_category(), path);
+    }
+    std::string_view s{static_cast<const char*>(map), size};
+    ::madvise(map, size, MADV_SEQUENTIAL);
+
+    const auto space = [](const char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    };
+    while(!s.empty() && space(s.front())) {
+        s.remove_prefix(1);
+    }
+    while(!s.empty() && space(s.back())) {
+        s.remove_suffix(1);
+    }
+    Mpz x;
+    const auto [ptr, ec] = from_chars(s, x, base, executor);
+    if(map) {
+        ::munmap(map, size);
+    }
+    if(ec != std::errc{} || ptr != s.data() + s.size()) {
+        throw std::invalid_argument("load_digits: " + path + " isn't a number in base " + std::to_string(base));
+    }
+    return x;
+}
+
+
+std::istream& operator>>(std::istream& is, Mpz& x) {
+    const std::istream::sentry sentry{is};
+    if(!sentry) {
+        return is;
+    }
+    const std::ios::fmtflags basefield = is.flags() & std::ios::basefield;
+    const int base = basefield == std::ios::hex ? 16 : basefield == std::ios::oct ? 8 : 10;
+    std::string s;
+    if(is.peek() == '-') {
+        s.push_back(static_cast<char>(is.get()));
+    }
+    while(true) {
+        const std::istream::int_type c = is.peek();
+        if(c == std::istream::traits_type::eof() || digit_value(static_cast<char>(c), base) >= base) {
+            break;
+        }
+        s.push_back(static_cast<char>(is.get()));
+    }
+    if(s.empty() || s == "-") {
+        is.setstate(std::ios::failbit);
+        return is;
+    }
+    from_chars(s, x, base);
+    return is;
+}
@@ -0,0 +1,66 @@
+#ifndef MPZ_IO_H
+#define MPZ_IO_H
+
+
+
+#include <charconv>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Radix conversion of huge integers
+//
+//Divide & conquer: x is split by cached powers base^(8192*2^k) into chunks
+//of 8192 digits, independent halves on separate tasks, then every chunk is
+//converted by mpz_get_str on its own. Quasi linear like GMP's own
+//conversion, but parallel and the digits can go out chunk by chunk, never
+//needing a string of the whole number. Parsing runs the same steps
+//backwards.
+//
+//Bases 2 to 62 with mpz_get_str's digits (lower case up to base 36).
+
+
+
+//Writes x into [first, last) like std::to_chars, no terminating zero.
+//x.size_in_base(base)+1 chars are always enough.
+std::to_chars_result to_chars(char* first, char* last, const Mpz& x, const int base=10,
+        MpzExecutor& executor=MpzExecutor::shared());
+
+//Streams the digits of x in chunks, returns the number of chars written.
+//The file descriptor version throws std::system_error on write errors.
+std::size_t write_digits(std::ostream& os, const Mpz& x, const int base=10, MpzExecutor& executor=MpzExecutor::shared());
+std::size_t write_digits(const int fd, const Mpz& x, const int base=10, MpzExecutor& executor=MpzExecutor::shared());
+
+
+//Parsing like std::from_chars: an optional '-' and the longest run of
+//digits of base, digits are read like mpz_set_str does. Digit chunks are
+//converted in parallel and recombined as a balanced tree with the cached
+//powers. Power of two bases pack the digit bits straight into the limbs.
+//No digits give std::errc::invalid_argument and leave x unchanged.
+std::from_chars_result from_chars(const char* first, const char* last, Mpz& x, const int base=10,
+        MpzExecutor& executor=MpzExecutor::shared());
+std::from_chars_result from_chars(std::string_view s, Mpz& x, const int base=10,
+        MpzExecutor& executor=MpzExecutor::shared());
+
+//Memory maps the file and parses it, only surrounding whitespace is
+//allowed. Throws std::system_error if it can't be read and
+//std::invalid_argument if it isn't a number.
+Mpz load_digits(const std::string& path, const int base=10, MpzExecutor& executor=MpzExecutor::shared());
+
+//Reads an optional '-' and digits by the stream's basefield (dec, hex or
+//oct), sets failbit if there are none
+std::istream& operator>>(std::istream& is, Mpz& x);
+
+//Frees the cached powers, no conversion may run concurrently
+void release_radix_powers();
+
+
+
+#endif //MPZ_IO_H
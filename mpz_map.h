@@ -0,0 +1,276 @@
+#ifndef MPZ_MAP_H
+#define MPZ_MAP_H
+
+
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <variant>
+
+#include "mpz.h"
+
+
+
+//Flat hash map & set with Mpz keys
+//
+//  MpzMap<unsigned long> seen;
+//  ++seen[x];
+//  if(const unsigned long* n = seen.find(y)) { ... }
+//  seen.for_each([](const Mpz& k, unsigned long& n) { ... });
+//
+//Open addressing with linear probing in one array of slots plus one array
+//of hashes. Keys are Mpzs, so keys below 2^64 sit inline in their slot
+//without a heap buffer. The full 64 bit hash of every key is kept, probes
+//compare that first and only compare limbs when it matches, i.e. almost
+//only for the key looked for. Erasing shifts the following entries back,
+//no tombstones, so long lived tables don't degrade.
+//
+//At most 4/5 of the slots are used, the table doubles beyond that. Like
+//std::unordered_map any insertion may move entries, pointers returned by
+//find() & co. are invalidated by it and by erase().
+
+
+
+template<typename V>
+class MpzHashTable {
+private:
+    struct Slot {
+        Mpz key;
+        [[no_unique_address]] V value;
+    };
+
+    //0 marks an empty slot, hashes of keys are never 0
+    std::unique_ptr<std::uint64_t[]> hashes;
+    Slot* slots = nullptr;
+    std::size_t mask = 0; //capacity - 1, capacity is 0 or a power of two
+    std::size_t count = 0;
+
+    static std::uint64_t hash_of(const Mpz& key) {
+        const std::uint64_t h = std::hash<Mpz>{}(key);
+        return h ? h : 1;
+    }
+
+    [[nodiscard]] std::size_t capacity() const {
+        return slots ? mask + 1 : 0;
+    }
+
+    //Slot of key, or the empty slot where it would go
+    [[nodiscard]] std::size_t probe(const Mpz& key, const std::uint64_t h) const {
+        std::size_t i = h & mask;
+        while(hashes[i] && !(hashes[i] == h && slots[i].key == key)) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void deallocate() {
+        for(std::size_t i=0; i<capacity(); ++i) {
+            if(hashes[i]) {
+                std::destroy_at(&slots[i]);
+            }
+        }
+        std::allocator<Slot>{}.deallocate(slots, capacity());
+        slots = nullptr;
+        hashes.reset();
+        mask = 0;
+    }
+
+    //Moves every entry into a table of the given power of two capacity
+    void rehash(const std::size_t newCapacity) {
+        std::unique_ptr<std::uint64_t[]> newHashes{new std::uint64_t[newCapacity]()};
+        Slot* const newSlots = std::allocator<Slot>{}.allocate(newCapacity);
+        const std::size_t newMask = newCapacity - 1;
+        for(std::size_t i=0; i<capacity(); ++i) {
+            if(hashes[i]) {
+                std::size_t j = hashes[i] & newMask;
+                while(newHashes[j]) {
+                    j = (j + 1) & newMask;
+                }
+                newHashes[j] = hashes[i];
+                std::construct_at(&newSlots[j], std::move(slots[i]));
+                std::destroy_at(&slots[i]);
+            }
+        }
+        std::allocator<Slot>{}.deallocate(slots, capacity());
+        hashes = std::move(newHashes);
+        slots = newSlots;
+        mask = newMask;
+    }
+
+    void grow_for(const std::size_t n) {
+        if(5*n > 4*capacity()) {
+            rehash(std::max<std::size_t>(std::bit_ceil(5*n/4 + 1), 16));
+        }
+    }
+
+public:
+    MpzHashTable() = default;
+    ~MpzHashTable() {
+        deallocate();
+    }
+    MpzHashTable(const MpzHashTable& other) {
+        *this = other;
+    }
+    MpzHashTable(MpzHashTable&& other) noexcept
+            : hashes(std::move(other.hashes)), slots(std::exchange(other.slots, nullptr)),
+            mask(std::exchange(other.mask, 0)), count(std::exchange(other.count, 0)) {}
+    MpzHashTable& operator=(const MpzHashTable& other) {
+        if(this != &other) {
+            clear();
+            reserve(other.count);
+            other.for_each([this](const Mpz& key, const V& value) {
+                try_emplace(key, value);
+            });
+        }
+        return *this;
+    }
+    MpzHashTable& operator=(MpzHashTable&& other) noexcept {
+        std::swap(hashes, other.hashes);
+        std::swap(slots, other.slots);
+        std::swap(mask, other.mask);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return count;
+    }
+    [[nodiscard]] bool empty() const {
+        return count == 0;
+    }
+    void clear() {
+        deallocate();
+        count = 0;
+    }
+    //Room for n entries without rehashing
+    void reserve(const std::size_t n) {
+        grow_for(n);
+    }
+
+    //Inserts key with a value from args unless it's there already. Points
+    //to the entry's value, true if it was inserted.
+    template<typename K, typename... Args>
+    std::pair<V*, bool> try_emplace(K&& key, Args&&... args) {
+        const std::uint64_t h = hash_of(key);
+        if(slots) {
+            const std::size_t i = probe(key, h);
+            if(hashes[i]) {
+                return {&slots[i].value, false};
+            }
+        }
+        grow_for(count + 1);
+        const std::size_t i = probe(key, h);
+        std::construct_at(&slots[i], Slot{Mpz(std::forward<K>(key)), V(std::forward<Args>(args)...)});
+        hashes[i] = h;
+        ++count;
+        return {&slots[i].value, true};
+    }
+
+    [[nodiscard]] V* find(const Mpz& key) {
+        if(!count) {
+            return nullptr;
+        }
+        const std::size_t i = probe(key, hash_of(key));
+        return hashes[i] ? &slots[i].value : nullptr;
+    }
+    [[nodiscard]] const V* find(const Mpz& key) const {
+        return const_cast<MpzHashTable*>(this)->find(key);
+    }
+    [[nodiscard]] bool contains(const Mpz& key) const {
+        return find(key);
+    }
+
+    //Backward shift: entries after the hole that may move closer to their
+    //home slot move into it
+    bool erase(const Mpz& key) {
+        if(!count) {
+            return false;
+        }
+        std::size_t i = probe(key, hash_of(key));
+        if(!hashes[i]) {
+            return false;
+        }
+        std::destroy_at(&slots[i]);
+        for(std::size_t j=(i+1)&mask; hashes[j]; j=(j+1)&mask) {
+            const std::size_t home = hashes[j] & mask;
+            if(((j - home) & mask) >= ((j - i) & mask)) {
+                std::construct_at(&slots[i], std::move(slots[j]));
+                std::destroy_at(&slots[j]);
+                hashes[i] = hashes[j];
+                i = j;
+            }
+        }
+        hashes[i] = 0;
+        --count;
+        return true;
+    }
+
+    //f(key, value) for every entry, in no particular order
+    template<typename F>
+    void for_each(F&& f) {
+        for(std::size_t i=0; i<capacity(); ++i) {
+            if(hashes[i]) {
+                f(std::as_const(slots[i].key), slots[i].value);
+            }
+        }
+    }
+    template<typename F>
+    void for_each(F&& f) const {
+        for(std::size_t i=0; i<capacity(); ++i) {
+            if(hashes[i]) {
+                f(slots[i].key, std::as_const(slots[i].value));
+            }
+        }
+    }
+};
+
+
+
+template<typename V>
+class MpzMap : public MpzHashTable<V> {
+public:
+    V& operator[](const Mpz& key) {
+        return *this->try_emplace(key).first;
+    }
+    V& operator[](Mpz&& key) {
+        return *this->try_emplace(std::move(key)).first;
+    }
+};
+
+
+class MpzSet : private MpzHashTable<std::monostate> {
+private:
+    using Table = MpzHashTable<std::monostate>;
+
+public:
+    using Table::size;
+    using Table::empty;
+    using Table::clear;
+    using Table::reserve;
+    using Table::contains;
+    using Table::erase;
+
+    //true if key wasn't there yet
+    bool insert(const Mpz& key) {
+        return try_emplace(key).second;
+    }
+    bool insert(Mpz&& key) {
+        return try_emplace(std::move(key)).second;
+    }
+
+    //f(key) for every key, in no particular order
+    template<typename F>
+    void for_each(F&& f) const {
+        Table::for_each([&f](const Mpz& key, std::monostate) {
+            f(key);
+        });
+    }
+};
+
+
+
+#endif //MPZ_MAP_H
@@ -0,0 +1,431 @@
+#include "mpz_memo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+#include "mpz_alloc.h"
+#include "mpz_special.h"
+
+
+
+//results below this many bits are computed every time
+static constexpr double minBits = 8192;
+
+static std::atomic<MpzMemo*> current{nullptr};
+
+using u128 = unsigned __int128;
+
+
+
+//Helpers
+//log2(n!) by Stirling (lgamma isn't thread safe), log2((n choose k)), log2(F(n))
+static double fac_bits(const unsigned long n) {
+    if(n < 2) {
+        return 0;
+    }
+    const double x = static_cast<double>(n);
+    return (x * std::log(x) - x + 0.5 * std::log(2 * std::numbers::pi * x)) / std::numbers::ln2;
+}
+
+static double bin_bits(const unsigned long n, const unsigned long k) {
+    return fac_bits(n) - fac_bits(k) - fac_bits(n - k);
+}
+
+static double fib_bits(const unsigned long n) {
+    return 0.6942419136 * static_cast<double>(n);
+}
+
+//lo * (lo+1) * ... * hi, words packed into limbs first
+static Mpz range_product(const unsigned long lo, const unsigned long hi) {
+    Mpz r{1ul};
+    mp_limb_t limb = 1;
+    for(unsigned long i=lo; i<=hi; ++i) {
+        const u128 p = static_cast<u128>(limb) * i;
+        if(p >> 64) {
+            r *= static_cast<unsigned long>(limb);
+            limb = i;
+        } else {
+            limb = static_cast<mp_limb_t>(p);
+        }
+    }
+    r *= static_cast<unsigned long>(limb);
+    return r;
+}
+
+//x * num / den, den divides exactly
+static Mpz scale(const Mpz& x, const Mpz& num, const Mpz& den) {
+    Mpz r = x * num;
+    mpz_divexact(r.get_mpz_t(), r.get_mpz_t(), den.get_mpz_t());
+    return r;
+}
+
+static std::size_t bytes_of(const Mpz& x) {
+    return mpz_size(x.get_mpz_t()) * sizeof(mp_limb_t);
+}
+
+//Cached copy of x, outside of any arena (see mpz_alloc.h) so it outlives it
+static std::shared_ptr<const Mpz> entry(Mpz x) {
+    if(MpzArena::active()) {
+        const MpzArena::Suspend suspend;
+        return std::make_shared<const Mpz>(std::as_const(x));
+    }
+    return std::make_shared<const Mpz>(std::move(x));
+}
+
+static unsigned long distance(const unsigned long a, const unsigned long b) {
+    return a < b ? b - a : a - b;
+}
+
+//Cached entry of the map nearest to n, if within interval
+template<typename Map>
+static auto nearest(Map& map, const unsigned long n, const unsigned long interval) {
+    auto best = map.end();
+    const auto above = map.lower_bound(n);
+    if(above != map.end() && above->first - n <= interval) {
+        best = above;
+    }
+    if(above != map.begin() && n - std::prev(above)->first <= interval
+            && (best == map.end() || n - std::prev(above)->first < best->first - n)) {
+        best = std::prev(above);
+    }
+    return best;
+}
+
+
+
+//Bookkeeping
+MpzMemo::MpzMemo(const std::size_t budget, const unsigned long interval)
+        : maxBytes(budget), interval(std::max(interval, 1ul)) {}
+
+MpzMemo::~MpzMemo() {
+    MpzMemo* self = this;
+    current.compare_exchange_strong(self, nullptr);
+}
+
+MpzMemo::Entry& MpzMemo::touch(Entry& e) {
+    lru.splice(lru.begin(), lru, e.lru);
+    return e;
+}
+
+MpzMemo::Entry* MpzMemo::find(const Key& key) {
+    switch(key.kind) {
+        case Kind::fac: {
+            const auto it = facs.find(key.n);
+            return it != facs.end() ? &it->second : nullptr;
+        }
+        case Kind::fib: {
+            const auto it = fibs.find(key.n);
+            return it != fibs.end() ? &it->second : nullptr;
+        }
+        default: {
+            const auto it = bins.find({key.n, key.k});
+            return it != bins.end() ? &it->second : nullptr;
+        }
+    }
+}
+
+//Results too big for the whole budget aren't kept, one computed twice by
+//racing threads only once
+void MpzMemo::insert(const Key& key, std::shared_ptr<const Mpz> value, std::shared_ptr<const Mpz> previous) {
+    const std::size_t bytes = bytes_of(*value) + (previous ? bytes_of(*previous) : 0);
+    if(bytes > maxBytes) {
+        return;
+    }
+    if(Entry* const e = find(key)) {
+        touch(*e);
+        return;
+    }
+    lru.push_front(key);
+    Entry e{std::move(value), std::move(previous), bytes, lru.begin()};
+    switch(key.kind) {
+        case Kind::fac:
+            facs.emplace(key.n, std::move(e));
+            break;
+        case Kind::fib:
+            fibs.emplace(key.n, std::move(e));
+            break;
+        default:
+            bins.emplace(std::pair{key.n, key.k}, std::move(e));
+            binColumns.emplace(key.k, key.n);
+    }
+    counters.bytes += bytes;
+    evict();
+}
+
+void MpzMemo::erase(const Key key) {
+    const Entry* const e = find(key);
+    counters.bytes -= e->bytes;
+    lru.erase(e->lru);
+    switch(key.kind) {
+        case Kind::fac:
+            facs.erase(key.n);
+            break;
+        case Kind::fib:
+            fibs.erase(key.n);
+            break;
+        default:
+            bins.erase({key.n, key.k});
+            binColumns.erase({key.k, key.n});
+    }
+}
+
+void MpzMemo::evict() {
+    while(counters.bytes > maxBytes) {
+        erase(lru.back());
+        ++counters.evictions;
+    }
+}
+
+
+MpzMemoStats MpzMemo::stats() const {
+    const std::lock_guard lock{mutex};
+    MpzMemoStats s = counters;
+    s.entries = lru.size();
+    return s;
+}
+
+std::size_t MpzMemo::budget() const {
+    const std::lock_guard lock{mutex};
+    return maxBytes;
+}
+
+void MpzMemo::set_budget(const std::size_t bytes) {
+    const std::lock_guard lock{mutex};
+    maxBytes = bytes;
+    evict();
+}
+
+void MpzMemo::clear() {
+    const std::lock_guard lock{mutex};
+    lru.clear();
+    facs.clear();
+    fibs.clear();
+    bins.clear();
+    binColumns.clear();
+    counters.bytes = 0;
+}
+
+
+void MpzMemo::install() {
+    current.store(this, std::memory_order_release);
+}
+
+void MpzMemo::uninstall() {
+    current.store(nullptr, std::memory_order_release);
+}
+
+MpzMemo* MpzMemo::installed() {
+    return current.load(std::memory_order_acquire);
+}
+
+
+
+//Factorials
+Mpz MpzMemo::fac(const unsigned long n) {
+    Mpz r;
+    if(fac_bits(n) < minBits) {
+        factorial(r.get_mpz_t(), n);
+        return r;
+    }
+    std::shared_ptr<const Mpz> from;
+    unsigned long m = n;
+    {
+        const std::lock_guard lock{mutex};
+        const auto it = nearest(facs, n, interval);
+        if(it != facs.end()) {
+            from = touch(it->second).value;
+            m = it->first;
+            ++(m == n ? counters.hits : counters.extensions);
+        } else {
+            ++counters.misses;
+        }
+    }
+    if(from && m == n) {
+        return *from;
+    }
+    if(!from) {
+        m = n - n % interval;
+        if(m == n || fac_bits(m) < minBits) {
+            factorial(r.get_mpz_t(), n);
+            const std::lock_guard lock{mutex};
+            insert({Kind::fac, n, 0}, entry(r));
+            return r;
+        }
+        Mpz checkpoint;
+        factorial(checkpoint.get_mpz_t(), m);
+        from = entry(std::move(checkpoint));
+        const std::lock_guard lock{mutex};
+        insert({Kind::fac, m, 0}, from);
+    }
+    if(n > m) {
+        r = *from * range_product(m + 1, n);
+    } else {
+        mpz_divexact(r.get_mpz_t(), from->get_mpz_t(), range_product(n + 1, m).get_mpz_t());
+    }
+    const std::lock_guard lock{mutex};
+    insert({Kind::fac, n, 0}, entry(r));
+    return r;
+}
+
+
+
+//Binomials
+//Along a row (n, i) to (n, k) or a column (m, k) to (n, k), all with the
+//lower argument at most half the upper one
+static Mpz along_row(const Mpz& c, const unsigned long n, const unsigned long i, const unsigned long k) {
+    if(k > i) {
+        return scale(c, range_product(n - k + 1, n - i), range_product(i + 1, k));
+    }
+    return scale(c, range_product(k + 1, i), range_product(n - i + 1, n - k));
+}
+
+static Mpz along_column(const Mpz& c, const unsigned long m, const unsigned long n, const unsigned long k) {
+    if(n > m) {
+        return scale(c, range_product(m + 1, n), range_product(m + 1 - k, n - k));
+    }
+    return scale(c, range_product(n + 1 - k, m - k), range_product(n + 1, m));
+}
+
+Mpz MpzMemo::bin(const unsigned long n, const unsigned long k) {
+    Mpz r;
+    if(k > n) {
+        return r;
+    }
+    const unsigned long j = std::min(k, n - k);
+    if(bin_bits(n, j) < minBits) {
+        binomial(r.get_mpz_t(), n, j);
+        return r;
+    }
+    std::shared_ptr<const Mpz> from;
+    unsigned long m = n, i = j;
+    {
+        const std::lock_guard lock{mutex};
+        unsigned long best = interval + 1;
+        //the same row, then the same column
+        const auto row = bins.lower_bound({n, j});
+        if(row != bins.end() && row->first.first == n && row->first.second - j < best) {
+            best = row->first.second - j;
+            i = row->first.second;
+        }
+        if(row != bins.begin() && std::prev(row)->first.first == n && j - std::prev(row)->first.second < best) {
+            best = j - std::prev(row)->first.second;
+            i = std::prev(row)->first.second;
+        }
+        const auto column = binColumns.lower_bound({j, n});
+        if(column != binColumns.end() && column->first == j && column->second - n < best) {
+            best = column->second - n;
+            m = column->second;
+            i = j;
+        }
+        if(column != binColumns.begin() && std::prev(column)->first == j && n - std::prev(column)->second < best) {
+            best = n - std::prev(column)->second;
+            m = std::prev(column)->second;
+            i = j;
+        }
+        if(best <= interval) {
+            from = touch(bins.at({m, i})).value;
+            ++(best == 0 ? counters.hits : counters.extensions);
+        } else {
+            ++counters.misses;
+        }
+    }
+    if(from && m == n && i == j) {
+        return *from;
+    }
+    if(!from) {
+        i = j - j % interval;
+        if(i == j || bin_bits(n, i) < minBits) {
+            binomial(r.get_mpz_t(), n, j);
+            const std::lock_guard lock{mutex};
+            insert({Kind::bin, n, j}, entry(r));
+            return r;
+        }
+        Mpz checkpoint;
+        binomial(checkpoint.get_mpz_t(), n, i);
+        from = entry(std::move(checkpoint));
+        const std::lock_guard lock{mutex};
+        insert({Kind::bin, n, i}, from);
+    }
+    r = m == n ? along_row(*from, n, i, j) : along_column(*from, m, n, j);
+    const std::lock_guard lock{mutex};
+    insert({Kind::bin, n, j}, entry(r));
+    return r;
+}
+
+
+
+//Fibonacci numbers
+//(F(m), F(m-1)) = (a, b) to (F(n), F(n-1)) with d = |n-m|:
+//  F(m+d) = a*F(d+1) + b*F(d)       F(m+d-1) = a*F(d) + b*F(d-1)
+//  F(m-d) = (-1)^d (a*F(d-1) - b*F(d))   F(m-d-1) = (-1)^d (b*F(d+1) - a*F(d))
+static void step(Mpz& f, Mpz& g, const Mpz& a, const Mpz& b, const unsigned long m, const unsigned long n) {
+    const unsigned long d = distance(m, n);
+    Mpz next, current, last; //F(d+1), F(d), F(d-1)
+    mpz_fib2_ui(next.get_mpz_t(), current.get_mpz_t(), d + 1);
+    last = next - current;
+    if(n > m) {
+        f = a * next + b * current;
+        g = a * current + b * last;
+        return;
+    }
+    f = a * last - b * current;
+    g = b * next - a * current;
+    if(d & 1) {
+        f.negate();
+        g.negate();
+    }
+}
+
+void MpzMemo::fib2(Mpz& f, Mpz& g, const unsigned long n) {
+    std::shared_ptr<const Mpz> a, b;
+    unsigned long m = n;
+    {
+        const std::lock_guard lock{mutex};
+        const auto it = nearest(fibs, n, interval);
+        if(it != fibs.end()) {
+            const Entry& e = touch(it->second);
+            a = e.value;
+            b = e.previous;
+            m = it->first;
+            ++(m == n ? counters.hits : counters.extensions);
+        } else {
+            ++counters.misses;
+        }
+    }
+    if(a && m == n) {
+        f = *a;
+        g = *b;
+        return;
+    }
+    if(!a) {
+        m = n - n % interval;
+        if(m == n || fib_bits(m) < minBits) {
+            fibonacci2(f.get_mpz_t(), g.get_mpz_t(), n);
+            const std::lock_guard lock{mutex};
+            insert({Kind::fib, n, 0}, entry(f), entry(g));
+            return;
+        }
+        Mpz x, y;
+        fibonacci2(x.get_mpz_t(), y.get_mpz_t(), m);
+        a = entry(std::move(x));
+        b = entry(std::move(y));
+        const std::lock_guard lock{mutex};
+        insert({Kind::fib, m, 0}, a, b);
+    }
+    step(f, g, *a, *b, m, n);
+    const std::lock_guard lock{mutex};
+    insert({Kind::fib, n, 0}, entry(f), entry(g));
+}
+
+Mpz MpzMemo::fib(const unsigned long n) {
+    Mpz f, g;
+    if(fib_bits(n) < minBits) {
+        fibonacci(f.get_mpz_t(), n);
+        return f;
+    }
+    fib2(f, g, n);
+    return f;
+}
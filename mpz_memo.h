@@ -0,0 +1,120 @@
+#ifndef MPZ_MEMO_H
+#define MPZ_MEMO_H
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+
+#include "mpz.h"
+
+
+
+//Memoizing cache for factorials, binomials & Fibonacci numbers
+//https://gmplib.org/manual/Factorial-Algorithm
+//
+//Results are kept up to a byte budget (of limbs), the least recently used
+//ones are evicted first. A call near a cached argument extends from there
+//instead of starting over:
+//- m! to n! by the product of the numbers in between (or dividing by it)
+//- (F(m), F(m-1)) to (F(n), F(n-1)) by the addition formula
+//  F(m+d) = F(m)*F(d+1) + F(m-1)*F(d), for either sign of d
+//- (n choose k) along its row or column by the ratios of neighbours, e.g.
+//  (n choose k+1) = (n choose k) * (n-k) / (k+1)
+//if the distance is at most the interval. On a miss the checkpoint at the
+//multiple of the interval below is computed & cached first (k for
+//binomials), then extended, so later calls in between find it.
+//
+//All members are thread safe, the results are computed outside of the
+//lock. Small results (< 1 KB) bypass the cache.
+//
+//Opt in: install() routes fac, bin(ul, ul) & fib (mpz.h) through a cache
+//until uninstall() or its destruction.
+//
+//  MpzMemo memo{1 << 30};
+//  memo.install();
+//  for(unsigned long n=...) f(fac(n)); //one full factorial, then steps
+
+
+
+struct MpzMemoStats {
+    std::uint64_t hits = 0; //the argument itself was cached
+    std::uint64_t extensions = 0; //extended from a cached neighbour
+    std::uint64_t misses = 0; //computed from scratch
+    std::uint64_t evictions = 0;
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+};
+
+
+class MpzMemo {
+public:
+    static constexpr std::size_t defaultBudget = std::size_t{1} << 28;
+    static constexpr unsigned long defaultInterval = 1ul << 10;
+
+private:
+    enum class Kind {
+        fac,
+        bin,
+        fib
+    };
+    struct Key {
+        Kind kind;
+        unsigned long n, k;
+    };
+    struct Entry {
+        std::shared_ptr<const Mpz> value;
+        std::shared_ptr<const Mpz> previous; //F(n-1) of Fibonacci numbers
+        std::size_t bytes;
+        std::list<Key>::iterator lru;
+    };
+
+    mutable std::mutex mutex;
+    std::size_t maxBytes;
+    unsigned long interval;
+    std::list<Key> lru; //most recently used first
+    std::map<unsigned long, Entry> facs;
+    std::map<unsigned long, Entry> fibs;
+    std::map<std::pair<unsigned long, unsigned long>, Entry> bins; //(n, k) with k <= n/2
+    std::set<std::pair<unsigned long, unsigned long>> binColumns; //(k, n) of the above
+    MpzMemoStats counters;
+
+    Entry& touch(Entry& e);
+    Entry* find(const Key& key);
+    void insert(const Key& key, std::shared_ptr<const Mpz> value, std::shared_ptr<const Mpz> previous={});
+    void erase(const Key key); //a copy, the list node goes
+    void evict();
+
+    void fib2(Mpz& f, Mpz& g, const unsigned long n);
+
+public:
+    //interval is the farthest a result is extended from a cached one
+    explicit MpzMemo(const std::size_t budget=defaultBudget, const unsigned long interval=defaultInterval);
+    ~MpzMemo();
+    MpzMemo(const MpzMemo&) = delete;
+    MpzMemo& operator=(const MpzMemo&) = delete;
+
+    [[nodiscard]] Mpz fac(const unsigned long n);
+    [[nodiscard]] Mpz bin(const unsigned long n, const unsigned long k);
+    [[nodiscard]] Mpz fib(const unsigned long n);
+
+    [[nodiscard]] MpzMemoStats stats() const;
+    [[nodiscard]] std::size_t budget() const;
+    void set_budget(const std::size_t bytes); //evicts down to it
+    void clear(); //entries, not the statistics
+
+    //fac, bin(ul, ul) & fib of mpz.h use this cache, process wide
+    void install();
+    static void uninstall();
+    [[nodiscard]] static MpzMemo* installed();
+};
+
+
+
+#endif //MPZ_MEMO_H
@@ -0,0 +1,338 @@
+#include "mpz_montgomery.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+
+//Scratch limbs of the calling thread, at least `size` of them
+static mp_limb_t* scratch(const std::size_t size) {
+    static thread_local std::vector<mp_limb_t> buffer;
+    if(buffer.size() < size) {
+        buffer.resize(size);
+    }
+    return buffer.data();
+}
+
+
+
+//Context
+MpzMontgomery::MpzMontgomery(const Mpz& modulus) : n(modulus) {
+    if(n <= 1ul || n.is_even()) {
+        throw std::invalid_argument("Montgomery modulus must be odd and greater than 1");
+    }
+    const mpz_srcptr N = n.get_mpz_t();
+    nLimbs.assign(mpz_limbs_read(N), mpz_limbs_read(N) + mpz_size(N));
+
+    //Newton iteration, every step doubles the correct low bits (3 to begin with)
+    mp_limb_t inv = nLimbs[0];
+    for(int i=0; i<5; ++i) {
+        inv *= 2 - nLimbs[0] * inv;
+    }
+    nInv = -inv;
+
+    const unsigned long bits = GMP_NUMB_BITS * nLimbs.size();
+    mpz_setbit(r2.get_mpz_t(), 2*bits);
+    mpz_mod(r2.get_mpz_t(), r2.get_mpz_t(), N);
+    mpz_setbit(oneForm.get_mpz_t(), bits);
+    mpz_mod(oneForm.get_mpz_t(), oneForm.get_mpz_t(), N);
+}
+
+const Mpz& MpzMontgomery::modulus() const {
+    return n;
+}
+
+const Mpz& MpzMontgomery::one() const {
+    return oneForm;
+}
+
+
+
+//Limb level
+mp_size_t MpzMontgomery::size() const {
+    return nLimbs.size();
+}
+
+//a in [0, n) zero padded to size() limbs
+void MpzMontgomery::load(mp_limb_t* const d, const Mpz& a) const {
+    const mpz_srcptr A = a.get_mpz_t();
+    const mp_size_t k = mpz_size(A);
+    std::copy_n(mpz_limbs_read(A), k, d);
+    std::fill(d + k, d + size(), 0);
+}
+
+void MpzMontgomery::store(Mpz& r, const mp_limb_t* const d) const {
+    mp_size_t k = size();
+    while(k > 0 && d[k-1] == 0) {
+        --k;
+    }
+    if(k <= 1) {
+        r = Mpz{k ? d[0] : 0ul}; //stays inline
+        return;
+    }
+    const mpz_ptr R = r.get_mpz_t();
+    std::copy_n(d, k, mpz_limbs_write(R, k));
+    mpz_limbs_finish(R, k);
+}
+
+//r = t/R mod n for t < nR, t (2 size() limbs) is overwritten
+void MpzMontgomery::redc(mp_limb_t* const r, mp_limb_t* const t) const {
+    const mp_size_t s = size();
+    mp_limb_t carry = 0;
+    for(mp_size_t i=0; i<s; ++i) {
+        //adding m*n clears limb i
+        const mp_limb_t m = t[i] * nInv;
+        const mp_limb_t c = mpn_addmul_1(t + i, nLimbs.data(), s, m);
+        carry += mpn_add_1(t + i + s, t + i + s, s - i, c);
+    }
+    //t/R < 2n
+    if(carry || mpn_cmp(t + s, nLimbs.data(), s) >= 0) {
+        mpn_sub_n(r, t + s, nLimbs.data(), s);
+    } else {
+        std::copy_n(t + s, s, r);
+    }
+}
+
+void MpzMontgomery::mul(mp_limb_t* const r, const mp_limb_t* const a, const mp_limb_t* const b, mp_limb_t* const t) const {
+    mpn_mul_n(t, a, b, size());
+    redc(r, t);
+}
+
+void MpzMontgomery::sqr(mp_limb_t* const r, const mp_limb_t* const a, mp_limb_t* const t) const {
+    mpn_sqr(t, a, size());
+    redc(r, t);
+}
+
+
+
+//Conversions
+Mpz MpzMontgomery::to_montgomery(const Mpz& a) const {
+    Mpz r;
+    to_montgomery({&a, 1}, {&r, 1});
+    return r;
+}
+
+Mpz MpzMontgomery::from_montgomery(const Mpz& a) const {
+    Mpz r;
+    from_montgomery({&a, 1}, {&r, 1});
+    return r;
+}
+
+void MpzMontgomery::to_montgomery(const std::span<const Mpz> in, const std::span<Mpz> out) const {
+    const mp_size_t s = size();
+    mp_limb_t* const a = scratch(5*s);
+    mp_limb_t* const b = a + s;
+    mp_limb_t* const t = b + s;
+    load(b, r2);
+    Mpz reduced;
+    for(std::size_t i=0; i<in.size(); ++i) {
+        if(sgn(in[i]) >= 0 && in[i] < n) {
+            load(a, in[i]);
+        } else {
+            mpz_mod(reduced.get_mpz_t(), in[i].get_mpz_t(), n.get_mpz_t());
+            load(a, reduced);
+        }
+        mul(a, a, b, t);
+        store(out[i], a);
+    }
+}
+
+void MpzMontgomery::from_montgomery(const std::span<const Mpz> in, const std::span<Mpz> out) const {
+    const mp_size_t s = size();
+    mp_limb_t* const a = scratch(3*s);
+    mp_limb_t* const t = a + s;
+    for(std::size_t i=0; i<in.size(); ++i) {
+        load(t, in[i]);
+        std::fill(t + s, t + 2*s, 0);
+        redc(a, t);
+        store(out[i], a);
+    }
+}
+
+
+
+//Arithmetic
+void MpzMontgomery::mul(Mpz& r, const Mpz& a, const Mpz& b) const {
+    const mp_size_t s = size();
+    mp_limb_t* const x = scratch(4*s);
+    mp_limb_t* const y = x + s;
+    mp_limb_t* const t = y + s;
+    load(x, a);
+    load(y, b);
+    mul(x, x, y, t);
+    store(r, x);
+}
+
+void MpzMontgomery::sqr(Mpz& r, const Mpz& a) const {
+    const mp_size_t s = size();
+    mp_limb_t* const x = scratch(3*s);
+    mp_limb_t* const t = x + s;
+    load(x, a);
+    sqr(x, x, t);
+    store(r, x);
+}
+
+void MpzMontgomery::add(Mpz& r, const Mpz& a, const Mpz& b) const {
+    const mp_size_t s = size();
+    mp_limb_t* const x = scratch(2*s);
+    mp_limb_t* const y = x + s;
+    load(x, a);
+    load(y, b);
+    if(mpn_add_n(x, x, y, s) || mpn_cmp(x, nLimbs.data(), s) >= 0) {
+        mpn_sub_n(x, x, nLimbs.data(), s);
+    }
+    store(r, x);
+}
+
+void MpzMontgomery::sub(Mpz& r, const Mpz& a, const Mpz& b) const {
+    const mp_size_t s = size();
+    mp_limb_t* const x = scratch(2*s);
+    mp_limb_t* const y = x + s;
+    load(x, a);
+    load(y, b);
+    if(mpn_sub_n(x, x, y, s)) {
+        mpn_add_n(x, x, nLimbs.data(), s);
+    }
+    store(r, x);
+}
+
+Mpz MpzMontgomery::mul(const Mpz& a, const Mpz& b) const {
+    Mpz r;
+    mul(r, a, b);
+    return r;
+}
+
+Mpz MpzMontgomery::sqr(const Mpz& a) const {
+    Mpz r;
+    sqr(r, a);
+    return r;
+}
+
+Mpz MpzMontgomery::add(const Mpz& a, const Mpz& b) const {
+    Mpz r;
+    add(r, a, b);
+    return r;
+}
+
+Mpz MpzMontgomery::sub(const Mpz& a, const Mpz& b) const {
+    Mpz r;
+    sub(r, a, b);
+    return r;
+}
+
+
+//Left to right sliding window, odd powers a, a^3, ..., a^(2^k-1) are
+//precomputed and every window ends in a set bit
+Mpz MpzMontgomery::pow(const Mpz& a, const Mpz& e) const {
+    if(sgn(e) < 0) {
+        throw std::invalid_argument("MpzMontgomery::pow: negative power");
+    }
+    const mpz_srcptr E = e.get_mpz_t();
+    const unsigned long bits = mpz_sizeinbase(E, 2);
+    if(!e) {
+        return oneForm;
+    }
+    const unsigned int k = bits <= 24 ? 2 : bits <= 80 ? 3 : bits <= 240 ? 4 : bits <= 672 ? 5 : 6;
+
+    const mp_size_t s = size();
+    std::vector<mp_limb_t> table((std::size_t{1} << (k-1)) * s);
+    mp_limb_t* const x = scratch(4*s);
+    mp_limb_t* const a2 = x + s;
+    mp_limb_t* const t = a2 + s;
+    load(table.data(), a);
+    sqr(a2, table.data(), t);
+    for(std::size_t i=1; i<(std::size_t{1} << (k-1)); ++i) {
+        mul(table.data() + i*s, table.data() + (i-1)*s, a2, t);
+    }
+
+    bool started = false;
+    for(long i=bits-1; i>=0;) {
+        if(!mpz_tstbit(E, i)) {
+            sqr(x, x, t);
+            --i;
+            continue;
+        }
+        long l = std::max(i - static_cast<long>(k) + 1, 0l);
+        while(!mpz_tstbit(E, l)) {
+            ++l;
+        }
+        unsigned long window = 0;
+        for(long j=i; j>=l; --j) {
+            window = 2*window + mpz_tstbit(E, j);
+            if(started) {
+                sqr(x, x, t);
+            }
+        }
+        const mp_limb_t* const p = table.data() + (window/2)*s;
+        if(started) {
+            mul(x, x, p, t);
+        } else {
+            std::copy_n(p, s, x);
+            started = true;
+        }
+        i = l - 1;
+    }
+    Mpz r;
+    store(r, x);
+    return r;
+}
+
+
+
+//Fixed base
+MpzFixedBase::MpzFixedBase(const Mpz& base, const Mpz& modulus, const unsigned long maxBits, const unsigned int width)
+        : base(base), m(abs(modulus)), maxBits(std::max(maxBits, 1ul)),
+        width(width ? width : maxBits <= 128 ? 4 : maxBits <= 512 ? 5 : maxBits <= 2048 ? 6 : 7) {
+    if(!m) {
+        throw std::invalid_argument("MpzFixedBase: zero modulus");
+    }
+    if(m.is_odd() && m > 1ul) {
+        montgomery.emplace(m);
+    }
+    d = (this->maxBits + this->width - 1) / this->width;
+
+    //table[j] = prod g^(2^(i*d)) over the set bits i of j
+    table.resize(std::size_t{1} << this->width);
+    Mpz g = !montgomery ? powm(base, 1ul, m) : montgomery->to_montgomery(base);
+    table[0] = !montgomery ? Mpz{1ul} % m : montgomery->one();
+    for(unsigned int i=0; i<this->width; ++i) {
+        table[std::size_t{1} << i] = g;
+        for(std::size_t j=1; j<(std::size_t{1} << i); ++j) {
+            mulmod(table[(std::size_t{1} << i) + j], table[j], g);
+        }
+        for(unsigned long k=0; k<d && i+1<this->width; ++k) {
+            mulmod(g, g, g);
+        }
+    }
+}
+
+void MpzFixedBase::mulmod(Mpz& r, const Mpz& a, const Mpz& b) const {
+    if(montgomery) {
+        montgomery->mul(r, a, b);
+    } else {
+        r.set_mul(a, b);
+        mpz_mod(r.get_mpz_t(), r.get_mpz_t(), m.get_mpz_t());
+    }
+}
+
+Mpz MpzFixedBase::pow(const Mpz& e) const {
+    if(sgn(e) < 0) {
+        throw std::invalid_argument("MpzFixedBase::pow: negative power");
+    }
+    if(e.size_in_base(2) > maxBits) {
+        return powm(base, e, m);
+    }
+    const mpz_srcptr E = e.get_mpz_t();
+    Mpz r = table[0];
+    for(unsigned long c=d; c-->0;) {
+        mulmod(r, r, r);
+        std::size_t j = 0;
+        for(unsigned int i=0; i<width; ++i) {
+            j |= static_cast<std::size_t>(mpz_tstbit(E, i*d + c)) << i;
+        }
+        if(j) {
+            mulmod(r, r, table[j]);
+        }
+    }
+    return !montgomery ? r : montgomery->from_montgomery(r);
+}
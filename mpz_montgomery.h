@@ -0,0 +1,103 @@
+#ifndef MPZ_MONTGOMERY_H
+#define MPZ_MONTGOMERY_H
+
+
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "mpz.h"
+
+
+
+//Montgomery arithmetic modulo a fixed odd n > 1
+//https://en.wikipedia.org/wiki/Montgomery_modular_multiplication
+//
+//With R = 2^(64*limbs of n), a value a is represented by aR mod n. Products
+//of represented values are reduced limb by limb (REDC) instead of by a
+//general division, the constants are computed once per context.
+//
+//All values passed to mul, sqr, add, sub & pow must be in Montgomery form,
+//so reduced to [0, n). Their results are in Montgomery form too. Use
+//to_montgomery & from_montgomery to convert, conversions of arbitrary
+//integers are the only place that divides.
+//
+//The context is immutable and uses thread local scratch space, one
+//instance can be shared between threads.
+class MpzMontgomery {
+private:
+    Mpz n;
+    std::vector<mp_limb_t> nLimbs;
+    mp_limb_t nInv; //-n^-1 mod 2^64
+    Mpz r2; //R^2 mod n
+    Mpz oneForm; //R mod n
+
+    [[nodiscard]] mp_size_t size() const;
+    void load(mp_limb_t* d, const Mpz& a) const;
+    void store(Mpz& r, const mp_limb_t* d) const;
+    void redc(mp_limb_t* r, mp_limb_t* t) const;
+    void mul(mp_limb_t* r, const mp_limb_t* a, const mp_limb_t* b, mp_limb_t* t) const;
+    void sqr(mp_limb_t* r, const mp_limb_t* a, mp_limb_t* t) const;
+
+public:
+    explicit MpzMontgomery(const Mpz& modulus);
+
+    [[nodiscard]] const Mpz& modulus() const;
+    [[nodiscard]] const Mpz& one() const; //1 in Montgomery form
+
+    //Conversions, any integer goes in, results in [0, n)
+    [[nodiscard]] Mpz to_montgomery(const Mpz& a) const;
+    [[nodiscard]] Mpz from_montgomery(const Mpz& a) const;
+    void to_montgomery(std::span<const Mpz> in, std::span<Mpz> out) const;
+    void from_montgomery(std::span<const Mpz> in, std::span<Mpz> out) const;
+
+    //r = a*b/R, r = a^2/R, r = a+b, r = a-b mod n, r may alias the operands
+    void mul(Mpz& r, const Mpz& a, const Mpz& b) const;
+    void sqr(Mpz& r, const Mpz& a) const;
+    void add(Mpz& r, const Mpz& a, const Mpz& b) const;
+    void sub(Mpz& r, const Mpz& a, const Mpz& b) const;
+    [[nodiscard]] Mpz mul(const Mpz& a, const Mpz& b) const;
+    [[nodiscard]] Mpz sqr(const Mpz& a) const;
+    [[nodiscard]] Mpz add(const Mpz& a, const Mpz& b) const;
+    [[nodiscard]] Mpz sub(const Mpz& a, const Mpz& b) const;
+
+    //a^e for e >= 0, sliding window over the bits of e
+    [[nodiscard]] Mpz pow(const Mpz& a, const Mpz& e) const;
+};
+
+
+
+//Fixed base modular exponentiation
+//https://doi.org/10.1007/3-540-48658-5_11 (Lim & Lee, comb method)
+//
+//For many exponents with the same base & modulus. The exponent bits are
+//arranged in `width` rows of d = ceil(maxBits/width) columns and the
+//products of g^(2^(i*d)) over all row subsets are precomputed, then every
+//column costs one squaring and at most one multiplication: d of each per
+//power instead of maxBits squarings. The table holds 2^width values.
+//
+//Odd moduli use Montgomery arithmetic. Exponents longer than maxBits fall
+//back to powm().
+class MpzFixedBase {
+private:
+    Mpz base, m;
+    std::optional<MpzMontgomery> montgomery; //odd moduli only
+    unsigned long maxBits;
+    unsigned int width;
+    unsigned long d;
+    std::vector<Mpz> table;
+
+    void mulmod(Mpz& r, const Mpz& a, const Mpz& b) const;
+
+public:
+    //width 0 picks one by maxBits
+    MpzFixedBase(const Mpz& base, const Mpz& modulus, const unsigned long maxBits, const unsigned int width=0);
+
+    //base^e mod modulus for e >= 0
+    [[nodiscard]] Mpz pow(const Mpz& e) const;
+};
+
+
+
+#endif //MPZ_MONTGOMERY_H
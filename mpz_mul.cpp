@@ -0,0 +1,255 @@
+#include "mpz_mul.h"
+
+#include "mpz_ntt.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+
+
+//operands shorter than this aren't split any further
+static constexpr std::size_t minLimbs = 64;
+
+using u128 = unsigned __int128;
+
+static std::atomic<std::size_t> processLimbs{MpzParallelMul::defaultLimbs};
+//innermost scope of this thread, none if the executor is null
+static thread_local MpzExecutor* scopeExecutor = nullptr;
+static thread_local std::size_t scopeLimbs = 0;
+
+
+
+//Scopes
+MpzParallelMul::MpzParallelMul(MpzExecutor& executor, const std::size_t limbs)
+        : previousExecutor(std::exchange(scopeExecutor, &executor)), previousLimbs(std::exchange(scopeLimbs, limbs)) {}
+
+MpzParallelMul::~MpzParallelMul() {
+    scopeExecutor = previousExecutor;
+    scopeLimbs = previousLimbs;
+}
+
+void MpzParallelMul::set_threshold(const std::size_t limbs) {
+    processLimbs.store(limbs, std::memory_order_relaxed);
+}
+
+std::size_t MpzParallelMul::threshold() {
+    return processLimbs.load(std::memory_order_relaxed);
+}
+
+
+static std::size_t current_limbs() {
+    return scopeExecutor ? scopeLimbs : processLimbs.load(std::memory_order_relaxed);
+}
+
+//Only called once the threshold is reached, so the shared pool isn't
+//started for small products
+static MpzExecutor& current_executor() {
+    return scopeExecutor ? *scopeExecutor : MpzExecutor::shared();
+}
+
+//Karatsuba levels, 3^depth tasks for the executor's threads plus the
+//waiting one
+static unsigned int split_depth(const MpzExecutor& executor) {
+    unsigned int depth = 0;
+    for(std::size_t tasks=3; tasks<=executor.size()+std::size_t{1}; tasks*=3) {
+        ++depth;
+    }
+    return depth;
+}
+
+
+
+//Leaves
+//r = a*b by the NTT above its crossover, else by mpz_mul
+static void mul_leaf(const mpz_ptr r, const mpz_srcptr a, const mpz_srcptr b) {
+    if(ntt_preferred(mpz_size(a), mpz_size(b))) {
+        ntt_mul(r, a, b);
+    } else {
+        mpz_mul(r, a, b);
+    }
+}
+
+
+
+//Splitting
+//All of these work on non negative operands and write into r, which is
+//none of them
+
+//n limbs of x from limb i on, as a read only non negative integer
+static mpz_srcptr slice(const mpz_ptr view, const mpz_srcptr x, const std::size_t i, const std::size_t n) {
+    return mpz_roinit_n(view, mpz_limbs_read(x) + i, static_cast<mp_size_t>(n));
+}
+
+//r = z2*B^2 + (z1 - z2 - z0)*B + z0 with B = 2^(64*h)
+static void recombine(const mpz_ptr r, const mpz_srcptr z0, const mpz_ptr z1, const mpz_srcptr z2, const std::size_t h) {
+    mpz_sub(z1, z1, z0);
+    mpz_sub(z1, z1, z2);
+    mpz_mul_2exp(r, z2, GMP_NUMB_BITS * h);
+    mpz_add(r, r, z1);
+    mpz_mul_2exp(r, r, GMP_NUMB_BITS * h);
+    mpz_add(r, r, z0);
+}
+
+static void sqr_split(const mpz_ptr r, const mpz_srcptr a, const unsigned int depth, MpzExecutor& executor) {
+    const std::size_t n = mpz_size(a);
+    if(!depth || n < 2*minLimbs) {
+        mul_leaf(r, a, a);
+        return;
+    }
+    //(a1*B + a0)^2 = a1^2*B^2 + ((a0+a1)^2 - a1^2 - a0^2)*B + a0^2
+    const std::size_t h = (n + 1) / 2;
+    mpz_t a0View, a1View;
+    const mpz_srcptr a0 = slice(a0View, a, 0, h), a1 = slice(a1View, a, h, n - h);
+    Mpz z0, z1, z2, s;
+    mpz_add(s.get_mpz_t(), a0, a1);
+    MpzTaskGroup group{executor};
+    group.run([&]() {
+        sqr_split(z0.get_mpz_t(), a0, depth - 1, executor);
+    });
+    group.run([&]() {
+        sqr_split(z2.get_mpz_t(), a1, depth - 1, executor);
+    });
+    sqr_split(z1.get_mpz_t(), s.get_mpz_t(), depth - 1, executor);
+    group.wait();
+    recombine(r, z0.get_mpz_t(), z1.get_mpz_t(), z2.get_mpz_t(), h);
+}
+
+//The longer operand in count chunks, every chunk times the shorter one on
+//its own task. The chunks are at least as long as the shorter operand,
+//like GMP's own unbalanced multiplication, so this adds no work.
+static void mul_chunks(const mpz_ptr r, const mpz_srcptr a, const mpz_srcptr b, const std::size_t count,
+        MpzExecutor& executor) {
+    const std::size_t na = mpz_size(a), length = (na + count - 1) / count;
+    std::vector<Mpz> products(count);
+    MpzTaskGroup group{executor};
+    for(std::size_t i=0; i<count; ++i) {
+        group.run([&products, a, b, na, length, i]() {
+            mpz_t view;
+            const std::size_t from = std::min(i * length, na);
+            mul_leaf(products[i].get_mpz_t(), slice(view, a, from, std::min(length, na - from)), b);
+        });
+    }
+    group.wait();
+    mpz_set(r, products[count-1].get_mpz_t());
+    for(std::size_t i=count-1; i-->0;) {
+        mpz_mul_2exp(r, r, GMP_NUMB_BITS * length);
+        mpz_add(r, r, products[i].get_mpz_t());
+    }
+}
+
+static void mul_split(const mpz_ptr r, mpz_srcptr a, mpz_srcptr b, const unsigned int depth, MpzExecutor& executor) {
+    if(mpz_size(a) < mpz_size(b)) {
+        std::swap(a, b);
+    }
+    const std::size_t na = mpz_size(a), nb = mpz_size(b);
+    if(!depth || nb < minLimbs) {
+        mul_leaf(r, a, b);
+        return;
+    }
+    if(na >= 2*nb) {
+        std::size_t tasks = 1;
+        for(unsigned int i=0; i<depth; ++i) {
+            tasks *= 3;
+        }
+        mul_chunks(r, a, b, std::min(na / nb, tasks), executor);
+        return;
+    }
+    //Karatsuba, h <= nb since na < 2*nb, b1 may be zero
+    const std::size_t h = (na + 1) / 2;
+    mpz_t a0View, a1View, b0View, b1View;
+    const mpz_srcptr a0 = slice(a0View, a, 0, h), a1 = slice(a1View, a, h, na - h);
+    const mpz_srcptr b0 = slice(b0View, b, 0, h), b1 = slice(b1View, b, h, nb - h);
+    Mpz z0, z1, z2, sa, sb;
+    mpz_add(sa.get_mpz_t(), a0, a1);
+    mpz_add(sb.get_mpz_t(), b0, b1);
+    MpzTaskGroup group{executor};
+    group.run([&]() {
+        mul_split(z0.get_mpz_t(), a0, b0, depth - 1, executor);
+    });
+    group.run([&]() {
+        mul_split(z2.get_mpz_t(), a1, b1, depth - 1, executor);
+    });
+    mul_split(z1.get_mpz_t(), sa.get_mpz_t(), sb.get_mpz_t(), depth - 1, executor);
+    group.wait();
+    recombine(r, z0.get_mpz_t(), z1.get_mpz_t(), z2.get_mpz_t(), h);
+}
+
+
+//Signs are taken off and put back on, the product goes into a temporary
+//swapped into r at the end, so r may be an operand
+static void split(const mpz_ptr r, const mpz_srcptr a, const mpz_srcptr b, MpzExecutor& executor) {
+    const unsigned int depth = split_depth(executor);
+    if(!depth) {
+        mul_leaf(r, a, b);
+        return;
+    }
+    const int sign = mpz_sgn(a) * mpz_sgn(b);
+    mpz_t aView, bView, t;
+    const mpz_srcptr A = slice(aView, a, 0, mpz_size(a)), B = slice(bView, b, 0, mpz_size(b));
+    mpz_init(t);
+    if(a == b) {
+        sqr_split(t, A, depth, executor);
+    } else {
+        mul_split(t, A, B, depth, executor);
+    }
+    if(sign < 0) {
+        mpz_neg(t, t);
+    }
+    mpz_swap(r, t);
+    mpz_clear(t);
+}
+
+
+
+//Entry points
+Mpz parallel_mul(const Mpz& a, const Mpz& b, MpzExecutor& executor) {
+    Mpz r;
+    split(r.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t(), executor);
+    return r;
+}
+
+void multiply(const mpz_ptr r, const mpz_srcptr a, const mpz_srcptr b) {
+    if(std::min(mpz_size(a), mpz_size(b)) < current_limbs()) {
+        mul_leaf(r, a, b);
+    } else {
+        split(r, a, b, current_executor());
+    }
+}
+
+
+//r = b^e for odd b, halves of big enough powers are squared through
+//multiply(), r isn't b
+static void power_split(const mpz_ptr r, const mpz_srcptr b, const unsigned long e, const std::size_t limbs) {
+    if(e < 2 || static_cast<u128>(mpz_sizeinbase(b, 2)) * (e / 2) < static_cast<u128>(GMP_NUMB_BITS) * limbs) {
+        mpz_pow_ui(r, b, e);
+        return;
+    }
+    Mpz half;
+    power_split(half.get_mpz_t(), b, e / 2, limbs);
+    multiply(r, half.get_mpz_t(), half.get_mpz_t());
+    if(e & 1) {
+        multiply(r, r, b);
+    }
+}
+
+void power(const mpz_ptr r, const mpz_srcptr b, const unsigned long e) {
+    const std::size_t limbs = current_limbs();
+    //the final square has operands of about half the result's size
+    if(e < 2 || mpz_size(b) == 0
+            || static_cast<u128>(mpz_sizeinbase(b, 2)) * (e / 2) < static_cast<u128>(GMP_NUMB_BITS) * limbs) {
+        mpz_pow_ui(r, b, e);
+        return;
+    }
+    //powers of two are shifts, only the odd part is squared
+    const mp_bitcnt_t zeros = mpz_scan1(b, 0);
+    Mpz odd;
+    mpz_tdiv_q_2exp(odd.get_mpz_t(), b, zeros);
+    mpz_t t;
+    mpz_init(t);
+    power_split(t, odd.get_mpz_t(), e, limbs);
+    mpz_mul_2exp(t, t, zeros * e);
+    mpz_swap(r, t);
+    mpz_clear(t);
+}
@@ -0,0 +1,78 @@
+#ifndef MPZ_MUL_H
+#define MPZ_MUL_H
+
+
+
+#include <cstddef>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Parallel multiplication of huge integers
+//https://gmplib.org/manual/Multiplication-Algorithms
+//
+//mpz_mul runs on one core. Above a threshold products are split instead:
+//balanced operands by one Karatsuba step per level (3 half sized products
+//on separate tasks, recursively as long as there are threads for them),
+//operands of very different lengths into chunks of the longer one times
+//the shorter one. Squares split into 3 squares, which GMP computes faster
+//than general products. The pieces are recombined by shifted additions.
+//
+//Splitting costs some extra work (up to 1.5x per level in GMP's FFT
+//range), so it only pays off with at least 3 threads and operands in the
+//hundreds of thousands of bits.
+//
+//Below the threshold, and for the pieces of split products, ntt_mul (see
+//mpz_ntt.h) takes over from mpz_mul where it is faster.
+//
+//Mpz's *, *=, set_mul & pow go through multiply() & power() and use this
+//automatically:
+//
+//  MpzParallelMul::set_threshold(1 << 12); //process wide, shared executor
+//  {
+//      MpzParallelMul scope{executor, 1 << 10}; //this thread, until destroyed
+//      Mpz p = a * b;
+//  }
+
+
+
+class MpzParallelMul {
+private:
+    MpzExecutor* previousExecutor;
+    std::size_t previousLimbs;
+
+public:
+    //~1 million bits, where a product takes milliseconds
+    static constexpr std::size_t defaultLimbs = std::size_t{1} << 14;
+
+    //Products on this thread whose shorter operand has at least limbs limbs
+    //are split over executor, until the scope is destroyed. Scopes nest.
+    explicit MpzParallelMul(MpzExecutor& executor=MpzExecutor::shared(), const std::size_t limbs=defaultLimbs);
+    ~MpzParallelMul();
+    MpzParallelMul(const MpzParallelMul&) = delete;
+    MpzParallelMul& operator=(const MpzParallelMul&) = delete;
+
+    //Outside of scopes products are split over MpzExecutor::shared() from
+    //this many limbs on, SIZE_MAX turns that off
+    static void set_threshold(const std::size_t limbs);
+    [[nodiscard]] static std::size_t threshold();
+};
+
+
+
+//a*b split over the executor regardless of the threshold, squares if a
+//and b are the same object
+Mpz parallel_mul(const Mpz& a, const Mpz& b, MpzExecutor& executor=MpzExecutor::shared());
+
+//r = a*b by mpz_mul or ntt_mul, or split if the threshold (scope or process
+//wide) is reached. r may be a or b.
+void multiply(mpz_ptr r, mpz_srcptr a, mpz_srcptr b);
+//r = b^e by mpz_pow_ui, or by repeated squaring through multiply() if the
+//result is big enough for that to split. r may be b.
+void power(mpz_ptr r, mpz_srcptr b, const unsigned long e);
+
+
+
+#endif //MPZ_MUL_H
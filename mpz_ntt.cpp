@@ -0,0 +1,750 @@
+#include "mpz_ntt.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MPZ_NTT_X86
+#include <immintrin.h>
+#define MPZ_AVX2 __attribute__((target("avx2")))
+#define MPZ_AVX512 __attribute__((target("avx512f")))
+#endif
+
+//limbs are copied into the 32 bit pieces as they are
+static_assert(std::endian::native == std::endian::little, "mpz_ntt assumes little endian limbs");
+
+using u128 = unsigned __int128;
+
+
+
+//Primes
+//Montgomery arithmetic with R = 2^32 in the signed variant: a*b*R^-1 is
+//hi(a*b) - hi(m*p) with m = lo(a*b)*p^-1, in (-p, p) for a*b < p*R, so
+//p may use all 31 bits. Values are kept fully reduced in [0, p).
+struct Prime {
+    std::uint32_t p;
+    std::uint32_t inv; //p^-1 mod 2^32
+    std::uint32_t r2; //R^2 mod p
+    std::uint32_t root; //primitive root
+};
+
+static constexpr Prime make_prime(const std::uint32_t p, const std::uint32_t root) {
+    std::uint32_t inv = p; //right in 3 bits, Newton doubles them
+    for(int i=0; i<4; ++i) {
+        inv *= 2 - p*inv;
+    }
+    const std::uint64_t r = (std::uint64_t{1} << 32) % p;
+    return {p, inv, static_cast<std::uint32_t>(r * r % p), root};
+}
+
+//15*2^27+1, 63*2^25+1 & 127*2^24+1, ascending, product > 2^92
+static constexpr std::array<Prime, 3> primes{make_prime(2013265921, 31), make_prime(2113929217, 5),
+        make_prime(2130706433, 3)};
+static constexpr unsigned int maxLog = 24; //2-adicity of the last prime
+static_assert(2 * mpzNttMaxLimbs <= std::size_t{1} << maxLog, "products need transforms up to 4*limbs pieces");
+
+//transform levels with butterflies inside blocks of this many elements
+//run block by block
+static constexpr std::size_t blockSize = std::size_t{1} << 14;
+
+
+static constexpr std::uint32_t mont_mul(const std::uint32_t a, const std::uint32_t b, const Prime& q) {
+    const std::uint64_t t = std::uint64_t{a} * b;
+    const std::uint32_t m = static_cast<std::uint32_t>(t) * q.inv;
+    const std::uint32_t r = static_cast<std::uint32_t>(t >> 32) - static_cast<std::uint32_t>((std::uint64_t{m} * q.p) >> 32);
+    return std::min(r, r + q.p);
+}
+
+static constexpr std::uint32_t add_mod(const std::uint32_t a, const std::uint32_t b, const Prime& q) {
+    const std::uint32_t s = a + b;
+    return std::min(s, s - q.p);
+}
+
+static constexpr std::uint32_t sub_mod(const std::uint32_t a, const std::uint32_t b, const Prime& q) {
+    const std::uint32_t d = a - b;
+    return std::min(d, d + q.p);
+}
+
+//Montgomery form of x < 2^32
+static constexpr std::uint32_t to_mont(const std::uint32_t x, const Prime& q) {
+    return mont_mul(x, q.r2, q);
+}
+
+//b^e in Montgomery form, b in Montgomery form
+static constexpr std::uint32_t mont_pow(std::uint32_t b, std::uint64_t e, const Prime& q) {
+    std::uint32_t r = to_mont(1, q);
+    for(; e; e>>=1) {
+        if(e & 1) {
+            r = mont_mul(r, b, q);
+        }
+        b = mont_mul(b, b, q);
+    }
+    return r;
+}
+
+
+//CRT by Garner: c = r0 + v1*p0 + v2*p0*p1 with
+//  v1 = (r1 - r0) * p0^-1 mod p1
+//  v2 = ((r2 - r0) * p0^-1 - v1) * p1^-1 mod p2
+//r0 < p1 < p2 since the primes ascend. Inverses in Montgomery form.
+struct Garner {
+    std::uint32_t inv01, inv02, inv12;
+};
+
+static constexpr Garner garner{mont_pow(to_mont(primes[0].p, primes[1]), primes[1].p - 2, primes[1]),
+        mont_pow(to_mont(primes[0].p, primes[2]), primes[2].p - 2, primes[2]),
+        mont_pow(to_mont(primes[1].p, primes[2]), primes[2].p - 2, primes[2])};
+
+
+
+//Kernels
+//reduce: x = x*R^-1 mod p in place for 32 bit pieces
+//dif/dit: one radix 2 level with butterflies len apart over [x, x+n),
+//  twiddles w_2len^j at tw[len + j] in Montgomery form
+//pointwise: a = a*b*s*R^-2
+//powers: out[j] = w^j for j < n, all in Montgomery form
+//crt: v1 & v2 of Garner over residues r0, r1, r2, in place of r1 & r2
+struct Kernel {
+    void (*reduce)(std::uint32_t* x, std::size_t n, const Prime& q);
+    void (*dif)(std::uint32_t* x, std::size_t n, std::size_t len, const std::uint32_t* tw, const Prime& q);
+    void (*dit)(std::uint32_t* x, std::size_t n, std::size_t len, const std::uint32_t* tw, const Prime& q);
+    void (*pointwise)(std::uint32_t* a, const std::uint32_t* b, std::size_t n, std::uint32_t s, const Prime& q);
+    void (*powers)(std::uint32_t* out, std::size_t n, std::uint32_t w, const Prime& q);
+    void (*crt)(const std::uint32_t* r0, std::uint32_t* r1, std::uint32_t* r2, std::size_t n);
+};
+
+
+static void reduce_scalar(std::uint32_t* const x, const std::size_t n, const Prime& q) {
+    for(std::size_t i=0; i<n; ++i) {
+        x[i] = mont_mul(x[i], 1, q);
+    }
+}
+
+static void dif_scalar(std::uint32_t* const x, const std::size_t n, const std::size_t len, const std::uint32_t* const tw,
+        const Prime& q) {
+    for(std::size_t s=0; s<n; s+=2*len) {
+        for(std::size_t j=0; j<len; ++j) {
+            const std::uint32_t u = x[s+j], v = x[s+j+len];
+            x[s+j] = add_mod(u, v, q);
+            x[s+j+len] = mont_mul(sub_mod(u, v, q), tw[len+j], q);
+        }
+    }
+}
+
+static void dit_scalar(std::uint32_t* const x, const std::size_t n, const std::size_t len, const std::uint32_t* const tw,
+        const Prime& q) {
+    for(std::size_t s=0; s<n; s+=2*len) {
+        for(std::size_t j=0; j<len; ++j) {
+            const std::uint32_t u = x[s+j], v = mont_mul(x[s+j+len], tw[len+j], q);
+            x[s+j] = add_mod(u, v, q);
+            x[s+j+len] = sub_mod(u, v, q);
+        }
+    }
+}
+
+static void pointwise_scalar(std::uint32_t* const a, const std::uint32_t* const b, const std::size_t n, const std::uint32_t s,
+        const Prime& q) {
+    for(std::size_t i=0; i<n; ++i) {
+        a[i] = mont_mul(mont_mul(a[i], b[i], q), s, q);
+    }
+}
+
+//Eight independent chains, so the multiplications pipeline
+static void powers_scalar(std::uint32_t* const out, const std::size_t n, const std::uint32_t w, const Prime& q) {
+    constexpr std::size_t chains = 8;
+    std::uint32_t p = to_mont(1, q);
+    for(std::size_t j=0; j<std::min(n, chains); ++j) {
+        out[j] = p;
+        p = mont_mul(p, w, q);
+    }
+    for(std::size_t j=chains; j<n; ++j) {
+        out[j] = mont_mul(out[j-chains], p, q);
+    }
+}
+
+static void crt_scalar(const std::uint32_t* const r0, std::uint32_t* const r1, std::uint32_t* const r2, const std::size_t n) {
+    const Prime &q1 = primes[1], &q2 = primes[2];
+    for(std::size_t i=0; i<n; ++i) {
+        const std::uint32_t v1 = mont_mul(sub_mod(r1[i], r0[i], q1), garner.inv01, q1);
+        const std::uint32_t t = sub_mod(mont_mul(sub_mod(r2[i], r0[i], q2), garner.inv02, q2), v1, q2);
+        r1[i] = v1;
+        r2[i] = mont_mul(t, garner.inv12, q2);
+    }
+}
+
+static constexpr Kernel scalarKernel{reduce_scalar, dif_scalar, dit_scalar, pointwise_scalar, powers_scalar, crt_scalar};
+
+
+//Levels with len below the vector width mix lanes of one vector. Over
+//two vectors X:Y, U & V gather the butterfly pairs (the index of u,
+//u+len), X & Y put the results back from U:V. Indices from lanes on
+//select the second vector.
+template<std::size_t lanes>
+struct SmallLevel {
+    std::array<std::int32_t, lanes> u, v, x, y;
+};
+
+template<std::size_t lanes>
+static constexpr SmallLevel<lanes> small_level(const std::size_t len) {
+    SmallLevel<lanes> s{};
+    std::size_t k = 0;
+    for(std::size_t i=0; i<2*lanes; ++i) {
+        if(!(i & len)) {
+            s.u[k] = static_cast<std::int32_t>(i);
+            s.v[k] = static_cast<std::int32_t>(i + len);
+            (i < lanes ? s.x[i] : s.y[i-lanes]) = static_cast<std::int32_t>(k);
+            (i+len < lanes ? s.x[i+len] : s.y[i+len-lanes]) = static_cast<std::int32_t>(lanes + k);
+            ++k;
+        }
+    }
+    return s;
+}
+
+//twiddle of every lane of U
+template<std::size_t lanes>
+static std::array<std::uint32_t, lanes> small_twiddles(const SmallLevel<lanes>& s, const std::size_t len,
+        const std::uint32_t* const tw) {
+    std::array<std::uint32_t, lanes> w;
+    for(std::size_t k=0; k<lanes; ++k) {
+        w[k] = tw[len + (s.u[k] & (len - 1))];
+    }
+    return w;
+}
+
+
+#ifdef MPZ_NTT_X86
+//AVX2, 8 lanes
+//_mm256_mul_epu32 multiplies the even lanes into 64 bits, the odd ones go
+//through a shift. The high halves of t - m*p are the results.
+MPZ_AVX2 static inline __m256i mont_mul8(const __m256i a, const __m256i b, const __m256i p, const __m256i inv) {
+    const __m256i te = _mm256_mul_epu32(a, b);
+    const __m256i to = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    const __m256i me = _mm256_mul_epu32(_mm256_mul_epu32(te, inv), p);
+    const __m256i mo = _mm256_mul_epu32(_mm256_mul_epu32(to, inv), p);
+    const __m256i r = _mm256_blend_epi32(_mm256_srli_epi64(_mm256_sub_epi64(te, me), 32), _mm256_sub_epi64(to, mo), 0xAA);
+    return _mm256_min_epu32(r, _mm256_add_epi32(r, p));
+}
+
+MPZ_AVX2 static inline __m256i add_mod8(const __m256i a, const __m256i b, const __m256i p) {
+    const __m256i s = _mm256_add_epi32(a, b);
+    return _mm256_min_epu32(s, _mm256_sub_epi32(s, p));
+}
+
+MPZ_AVX2 static inline __m256i sub_mod8(const __m256i a, const __m256i b, const __m256i p) {
+    const __m256i d = _mm256_sub_epi32(a, b);
+    return _mm256_min_epu32(d, _mm256_add_epi32(d, p));
+}
+
+MPZ_AVX2 static inline __m256i load8(const std::uint32_t* const x) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x));
+}
+
+MPZ_AVX2 static inline void store8(std::uint32_t* const x, const __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(x), v);
+}
+
+//Lanes idx of a:b
+MPZ_AVX2 static inline __m256i select8(const __m256i a, const __m256i b, const __m256i idx) {
+    const __m256i fromB = _mm256_cmpgt_epi32(idx, _mm256_set1_epi32(7));
+    return _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(a, idx), _mm256_permutevar8x32_epi32(b, idx), fromB);
+}
+
+//Forward: u+v, (u-v)*w. Inverse: u+v*w, u-v*w.
+template<bool forward>
+MPZ_AVX2 static inline void butterfly8(__m256i& u, __m256i& v, const __m256i w, const __m256i p, const __m256i inv) {
+    if constexpr(forward) {
+        const __m256i d = sub_mod8(u, v, p);
+        u = add_mod8(u, v, p);
+        v = mont_mul8(d, w, p, inv);
+    } else {
+        const __m256i t = mont_mul8(v, w, p, inv);
+        v = sub_mod8(u, t, p);
+        u = add_mod8(u, t, p);
+    }
+}
+
+MPZ_AVX2 static void reduce_avx2(std::uint32_t* const x, const std::size_t n, const Prime& q) {
+    const __m256i p = _mm256_set1_epi32(static_cast<int>(q.p)), inv = _mm256_set1_epi32(static_cast<int>(q.inv));
+    const __m256i one = _mm256_set1_epi32(1);
+    std::size_t i = 0;
+    for(; i+8<=n; i+=8) {
+        store8(x + i, mont_mul8(load8(x + i), one, p, inv));
+    }
+    reduce_scalar(x + i, n - i, q);
+}
+
+template<bool forward>
+MPZ_AVX2 static void level_avx2(std::uint32_t* const x, const std::size_t n, const std::size_t len,
+        const std::uint32_t* const tw, const Prime& q) {
+    if(n < 16) {
+        (forward ? dif_scalar : dit_scalar)(x, n, len, tw, q);
+        return;
+    }
+    const __m256i p = _mm256_set1_epi32(static_cast<int>(q.p)), inv = _mm256_set1_epi32(static_cast<int>(q.inv));
+    if(len >= 8) {
+        for(std::size_t s=0; s<n; s+=2*len) {
+            for(std::size_t j=0; j<len; j+=8) {
+                __m256i u = load8(x + s + j), v = load8(x + s + j + len);
+                butterfly8<forward>(u, v, load8(tw + len + j), p, inv);
+                store8(x + s + j, u);
+                store8(x + s + j + len, v);
+            }
+        }
+        return;
+    }
+    static constexpr std::array<SmallLevel<8>, 3> levels{small_level<8>(1), small_level<8>(2), small_level<8>(4)};
+    const SmallLevel<8>& l = levels[std::countr_zero(len)];
+    const __m256i iu = load8(reinterpret_cast<const std::uint32_t*>(l.u.data()));
+    const __m256i iv = load8(reinterpret_cast<const std::uint32_t*>(l.v.data()));
+    const __m256i ix = load8(reinterpret_cast<const std::uint32_t*>(l.x.data()));
+    const __m256i iy = load8(reinterpret_cast<const std::uint32_t*>(l.y.data()));
+    const __m256i w = load8(small_twiddles(l, len, tw).data());
+    for(std::size_t s=0; s<n; s+=16) {
+        const __m256i a = load8(x + s), b = load8(x + s + 8);
+        __m256i u = select8(a, b, iu), v = select8(a, b, iv);
+        butterfly8<forward>(u, v, w, p, inv);
+        store8(x + s, select8(u, v, ix));
+        store8(x + s + 8, select8(u, v, iy));
+    }
+}
+
+MPZ_AVX2 static void pointwise_avx2(std::uint32_t* const a, const std::uint32_t* const b, const std::size_t n,
+        const std::uint32_t s, const Prime& q) {
+    const __m256i p = _mm256_set1_epi32(static_cast<int>(q.p)), inv = _mm256_set1_epi32(static_cast<int>(q.inv));
+    const __m256i scale = _mm256_set1_epi32(static_cast<int>(s));
+    std::size_t i = 0;
+    for(; i+8<=n; i+=8) {
+        store8(a + i, mont_mul8(mont_mul8(load8(a + i), load8(b + i), p, inv), scale, p, inv));
+    }
+    pointwise_scalar(a + i, b + i, n - i, s, q);
+}
+
+MPZ_AVX2 static void powers_avx2(std::uint32_t* const out, const std::size_t n, const std::uint32_t w, const Prime& q) {
+    if(n < 16) {
+        powers_scalar(out, n, w, q);
+        return;
+    }
+    powers_scalar(out, 8, w, q);
+    const __m256i p = _mm256_set1_epi32(static_cast<int>(q.p)), inv = _mm256_set1_epi32(static_cast<int>(q.inv));
+    const __m256i w8 = _mm256_set1_epi32(static_cast<int>(mont_mul(out[7], w, q)));
+    __m256i v = load8(out);
+    for(std::size_t j=8; j<n; j+=8) {
+        v = mont_mul8(v, w8, p, inv);
+        store8(out + j, v);
+    }
+}
+
+MPZ_AVX2 static void crt_avx2(const std::uint32_t* const r0, std::uint32_t* const r1, std::uint32_t* const r2,
+        const std::size_t n) {
+    const Prime &q1 = primes[1], &q2 = primes[2];
+    const __m256i p1 = _mm256_set1_epi32(static_cast<int>(q1.p)), inv1 = _mm256_set1_epi32(static_cast<int>(q1.inv));
+    const __m256i p2 = _mm256_set1_epi32(static_cast<int>(q2.p)), inv2 = _mm256_set1_epi32(static_cast<int>(q2.inv));
+    const __m256i inv01 = _mm256_set1_epi32(static_cast<int>(garner.inv01));
+    const __m256i inv02 = _mm256_set1_epi32(static_cast<int>(garner.inv02));
+    const __m256i inv12 = _mm256_set1_epi32(static_cast<int>(garner.inv12));
+    std::size_t i = 0;
+    for(; i+8<=n; i+=8) {
+        const __m256i a = load8(r0 + i);
+        const __m256i v1 = mont_mul8(sub_mod8(load8(r1 + i), a, p1), inv01, p1, inv1);
+        const __m256i t = sub_mod8(mont_mul8(sub_mod8(load8(r2 + i), a, p2), inv02, p2, inv2), v1, p2);
+        store8(r1 + i, v1);
+        store8(r2 + i, mont_mul8(t, inv12, p2, inv2));
+    }
+    crt_scalar(r0 + i, r1 + i, r2 + i, n - i);
+}
+
+static constexpr Kernel avx2Kernel{reduce_avx2, level_avx2<true>, level_avx2<false>, pointwise_avx2, powers_avx2, crt_avx2};
+
+
+//AVX-512, 16 lanes, the same with one permute for the small levels
+//GCC 12's AVX-512 intrinsics start from _mm512_undefined_epi32(), which
+//trips -Wmaybe-uninitialized when inlined
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+MPZ_AVX512 static inline __m512i mont_mul16(const __m512i a, const __m512i b, const __m512i p, const __m512i inv) {
+    const __m512i te = _mm512_mul_epu32(a, b);
+    const __m512i to = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+    const __m512i me = _mm512_mul_epu32(_mm512_mul_epu32(te, inv), p);
+    const __m512i mo = _mm512_mul_epu32(_mm512_mul_epu32(to, inv), p);
+    const __m512i r = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(_mm512_sub_epi64(te, me), 32), _mm512_sub_epi64(to, mo));
+    return _mm512_min_epu32(r, _mm512_add_epi32(r, p));
+}
+
+MPZ_AVX512 static inline __m512i add_mod16(const __m512i a, const __m512i b, const __m512i p) {
+    const __m512i s = _mm512_add_epi32(a, b);
+    return _mm512_min_epu32(s, _mm512_sub_epi32(s, p));
+}
+
+MPZ_AVX512 static inline __m512i sub_mod16(const __m512i a, const __m512i b, const __m512i p) {
+    const __m512i d = _mm512_sub_epi32(a, b);
+    return _mm512_min_epu32(d, _mm512_add_epi32(d, p));
+}
+
+MPZ_AVX512 static inline __m512i load16(const void* const x) {
+    return _mm512_loadu_si512(x);
+}
+
+MPZ_AVX512 static inline void store16(std::uint32_t* const x, const __m512i v) {
+    _mm512_storeu_si512(x, v);
+}
+
+//Forward: u+v, (u-v)*w. Inverse: u+v*w, u-v*w.
+template<bool forward>
+MPZ_AVX512 static inline void butterfly16(__m512i& u, __m512i& v, const __m512i w, const __m512i p, const __m512i inv) {
+    if constexpr(forward) {
+        const __m512i d = sub_mod16(u, v, p);
+        u = add_mod16(u, v, p);
+        v = mont_mul16(d, w, p, inv);
+    } else {
+        const __m512i t = mont_mul16(v, w, p, inv);
+        v = sub_mod16(u, t, p);
+        u = add_mod16(u, t, p);
+    }
+}
+
+MPZ_AVX512 static void reduce_avx512(std::uint32_t* const x, const std::size_t n, const Prime& q) {
+    const __m512i p = _mm512_set1_epi32(static_cast<int>(q.p)), inv = _mm512_set1_epi32(static_cast<int>(q.inv));
+    const __m512i one = _mm512_set1_epi32(1);
+    std::size_t i = 0;
+    for(; i+16<=n; i+=16) {
+        store16(x + i, mont_mul16(load16(x + i), one, p, inv));
+    }
+    reduce_scalar(x + i, n - i, q);
+}
+
+template<bool forward>
+MPZ_AVX512 static void level_avx512(std::uint32_t* const x, const std::size_t n, const std::size_t len,
+        const std::uint32_t* const tw, const Prime& q) {
+    if(n < 32) {
+        (forward ? dif_scalar : dit_scalar)(x, n, len, tw, q);
+        return;
+    }
+    const __m512i p = _mm512_set1_epi32(static_cast<int>(q.p)), inv = _mm512_set1_epi32(static_cast<int>(q.inv));
+    if(len >= 16) {
+        for(std::size_t s=0; s<n; s+=2*len) {
+            for(std::size_t j=0; j<len; j+=16) {
+                __m512i u = load16(x + s + j), v = load16(x + s + j + len);
+                butterfly16<forward>(u, v, load16(tw + len + j), p, inv);
+                store16(x + s + j, u);
+                store16(x + s + j + len, v);
+            }
+        }
+        return;
+    }
+    static constexpr std::array<SmallLevel<16>, 4> levels{small_level<16>(1), small_level<16>(2), small_level<16>(4),
+            small_level<16>(8)};
+    const SmallLevel<16>& l = levels[std::countr_zero(len)];
+    const __m512i iu = load16(l.u.data()), iv = load16(l.v.data()), ix = load16(l.x.data()), iy = load16(l.y.data());
+    const __m512i w = load16(small_twiddles(l, len, tw).data());
+    for(std::size_t s=0; s<n; s+=32) {
+        const __m512i a = load16(x + s), b = load16(x + s + 16);
+        __m512i u = _mm512_permutex2var_epi32(a, iu, b), v = _mm512_permutex2var_epi32(a, iv, b);
+        butterfly16<forward>(u, v, w, p, inv);
+        store16(x + s, _mm512_permutex2var_epi32(u, ix, v));
+        store16(x + s + 16, _mm512_permutex2var_epi32(u, iy, v));
+    }
+}
+
+MPZ_AVX512 static void pointwise_avx512(std::uint32_t* const a, const std::uint32_t* const b, const std::size_t n,
+        const std::uint32_t s, const Prime& q) {
+    const __m512i p = _mm512_set1_epi32(static_cast<int>(q.p)), inv = _mm512_set1_epi32(static_cast<int>(q.inv));
+    const __m512i scale = _mm512_set1_epi32(static_cast<int>(s));
+    std::size_t i = 0;
+    for(; i+16<=n; i+=16) {
+        store16(a + i, mont_mul16(mont_mul16(load16(a + i), load16(b + i), p, inv), scale, p, inv));
+    }
+    pointwise_scalar(a + i, b + i, n - i, s, q);
+}
+
+MPZ_AVX512 static void powers_avx512(std::uint32_t* const out, const std::size_t n, const std::uint32_t w, const Prime& q) {
+    if(n < 32) {
+        powers_scalar(out, n, w, q);
+        return;
+    }
+    powers_scalar(out, 16, w, q);
+    const __m512i p = _mm512_set1_epi32(static_cast<int>(q.p)), inv = _mm512_set1_epi32(static_cast<int>(q.inv));
+    const __m512i w16 = _mm512_set1_epi32(static_cast<int>(mont_mul(out[15], w, q)));
+    __m512i v = load16(out);
+    for(std::size_t j=16; j<n; j+=16) {
+        v = mont_mul16(v, w16, p, inv);
+        store16(out + j, v);
+    }
+}
+
+MPZ_AVX512 static void crt_avx512(const std::uint32_t* const r0, std::uint32_t* const r1, std::uint32_t* const r2,
+        const std::size_t n) {
+    const Prime &q1 = primes[1], &q2 = primes[2];
+    const __m512i p1 = _mm512_set1_epi32(static_cast<int>(q1.p)), inv1 = _mm512_set1_epi32(static_cast<int>(q1.inv));
+    const __m512i p2 = _mm512_set1_epi32(static_cast<int>(q2.p)), inv2 = _mm512_set1_epi32(static_cast<int>(q2.inv));
+    const __m512i inv01 = _mm512_set1_epi32(static_cast<int>(garner.inv01));
+    const __m512i inv02 = _mm512_set1_epi32(static_cast<int>(garner.inv02));
+    const __m512i inv12 = _mm512_set1_epi32(static_cast<int>(garner.inv12));
+    std::size_t i = 0;
+    for(; i+16<=n; i+=16) {
+        const __m512i a = load16(r0 + i);
+        const __m512i v1 = mont_mul16(sub_mod16(load16(r1 + i), a, p1), inv01, p1, inv1);
+        const __m512i t = sub_mod16(mont_mul16(sub_mod16(load16(r2 + i), a, p2), inv02, p2, inv2), v1, p2);
+        store16(r1 + i, v1);
+        store16(r2 + i, mont_mul16(t, inv12, p2, inv2));
+    }
+    crt_scalar(r0 + i, r1 + i, r2 + i, n - i);
+}
+
+static constexpr Kernel avx512Kernel{reduce_avx512, level_avx512<true>, level_avx512<false>, pointwise_avx512,
+        powers_avx512, crt_avx512};
+#pragma GCC diagnostic pop
+#endif
+
+
+
+//Dispatch
+static const Kernel* kernel_of(const MpzNttKernel kernel) {
+    switch(kernel) {
+        case MpzNttKernel::scalar:
+            return &scalarKernel;
+#ifdef MPZ_NTT_X86
+        case MpzNttKernel::avx2:
+            return &avx2Kernel;
+        case MpzNttKernel::avx512:
+            return &avx512Kernel;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+bool ntt_supported(const MpzNttKernel kernel) {
+#ifdef MPZ_NTT_X86
+    __builtin_cpu_init();
+    switch(kernel) {
+        case MpzNttKernel::scalar:
+            return true;
+        case MpzNttKernel::avx2:
+            return __builtin_cpu_supports("avx2");
+        case MpzNttKernel::avx512:
+            return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#else
+    return kernel == MpzNttKernel::scalar;
+#endif
+}
+
+static std::atomic<MpzNttKernel>& selected() {
+    static std::atomic<MpzNttKernel> kernel{
+        ntt_supported(MpzNttKernel::avx512) ? MpzNttKernel::avx512
+        : ntt_supported(MpzNttKernel::avx2) ? MpzNttKernel::avx2
+        : MpzNttKernel::scalar
+    };
+    return kernel;
+}
+
+MpzNttKernel ntt_kernel() {
+    return selected().load(std::memory_order_relaxed);
+}
+
+void set_ntt_kernel(const MpzNttKernel kernel) {
+    if(!ntt_supported(kernel)) {
+        throw std::invalid_argument("set_ntt_kernel: not supported on this CPU");
+    }
+    selected().store(kernel, std::memory_order_relaxed);
+}
+
+
+
+//Transforms
+//tw[len + j] = w_2len^j for every len up to n/2, the lower levels are
+//every other entry of the next higher one. Doesn't depend on n otherwise,
+//so one table serves all shorter transforms too.
+static std::vector<std::uint32_t> build_twiddles(const Kernel& k, const std::size_t n, const bool inverse, const Prime& q) {
+    std::vector<std::uint32_t> tw(n);
+    std::uint32_t w = mont_pow(to_mont(q.root, q), (q.p - 1) / n, q);
+    if(inverse) {
+        w = mont_pow(w, n - 1, q);
+    }
+    k.powers(tw.data() + n/2, n/2, w, q);
+    for(std::size_t len=n/4; len>=1; len/=2) {
+        for(std::size_t j=0; j<len; ++j) {
+            tw[len + j] = tw[2*len + 2*j];
+        }
+    }
+    return tw;
+}
+
+//Per prime & direction, grown by replacing, so transforms in flight keep
+//the table they have. Longer ones are built for each product.
+static constexpr std::size_t cachedTwiddles = std::size_t{1} << 20;
+static std::mutex twiddleMutex;
+static std::shared_ptr<const std::vector<std::uint32_t>> twiddleCache[3][2];
+
+using Twiddles = std::shared_ptr<const std::vector<std::uint32_t>>;
+
+static Twiddles twiddles(const Kernel& k, std::size_t n, const bool inverse, const std::size_t prime) {
+    n = std::max<std::size_t>(n, 2);
+    if(n > cachedTwiddles) {
+        return std::make_shared<const std::vector<std::uint32_t>>(build_twiddles(k, n, inverse, primes[prime]));
+    }
+    const std::lock_guard lock{twiddleMutex};
+    Twiddles& t = twiddleCache[prime][inverse];
+    if(!t || t->size() < n) {
+        t = std::make_shared<const std::vector<std::uint32_t>>(build_twiddles(k, std::max<std::size_t>(n, 1 << 12), inverse,
+                primes[prime]));
+    }
+    return t;
+}
+
+void release_ntt_tables() {
+    const std::lock_guard lock{twiddleMutex};
+    for(auto& prime : twiddleCache) {
+        for(Twiddles& t : prime) {
+            t.reset();
+        }
+    }
+}
+
+//Natural order in, bit reversed out
+static void forward(const Kernel& k, std::uint32_t* const x, const std::size_t n, const std::uint32_t* const tw, const Prime& q) {
+    std::size_t len = n / 2;
+    for(; len>=blockSize; len/=2) {
+        k.dif(x, n, len, tw, q);
+    }
+    const std::size_t block = std::min(n, blockSize);
+    for(std::size_t s=0; s<n; s+=block) {
+        for(std::size_t l=len; l>=1; l/=2) {
+            k.dif(x + s, block, l, tw, q);
+        }
+    }
+}
+
+//Bit reversed in, natural order out
+static void inverse(const Kernel& k, std::uint32_t* const x, const std::size_t n, const std::uint32_t* const tw, const Prime& q) {
+    const std::size_t block = std::min(n, blockSize);
+    for(std::size_t s=0; s<n; s+=block) {
+        for(std::size_t l=1; l<block; l*=2) {
+            k.dit(x + s, block, l, tw, q);
+        }
+    }
+    for(std::size_t len=block; len<n; len*=2) {
+        k.dit(x, n, len, tw, q);
+    }
+}
+
+//The 32 bit pieces of x mod q, zero padded to n
+static void load(const Kernel& k, std::uint32_t* const out, const mpz_srcptr x, const std::size_t n, const Prime& q) {
+    const std::size_t pieces = 2 * mpz_size(x);
+    std::memcpy(out, mpz_limbs_read(x), pieces * sizeof(std::uint32_t));
+    std::fill(out + pieces, out + n, 0);
+    k.reduce(out, pieces, q);
+}
+
+//Cyclic convolution of a & b (or a & a) mod q into out, times R^-4 from
+//the reductions & pointwise products undone by the scale factor
+static void convolve(const Kernel& k, std::uint32_t* const out, std::uint32_t* const scratch, const mpz_srcptr a,
+        const mpz_srcptr b, const std::size_t n, const std::size_t prime) {
+    const Prime& q = primes[prime];
+    const Twiddles tw = twiddles(k, n, false, prime);
+    load(k, out, a, n, q);
+    forward(k, out, n, tw->data(), q);
+    const std::uint32_t* other = out;
+    if(a != b) {
+        load(k, scratch, b, n, q);
+        forward(k, scratch, n, tw->data(), q);
+        other = scratch;
+    }
+    //n^-1 * R^4: from x*R^-1, y*R^-1, the product's R^-1 & the scale's R^-1
+    std::uint32_t s = mont_pow(to_mont(static_cast<std::uint32_t>(n), q), q.p - 2, q); //n^-1 * R
+    for(int i=0; i<3; ++i) {
+        s = mont_mul(s, q.r2, q);
+    }
+    k.pointwise(out, other, n, s, q);
+    inverse(k, out, n, twiddles(k, n, true, prime)->data(), q);
+}
+
+
+
+//Multiplication
+//Buffers up to this many elements are kept per thread
+static constexpr std::size_t cachedWorkspace = std::size_t{1} << 20;
+
+static std::uint32_t* workspace(const std::size_t size) {
+    static thread_local std::vector<std::uint32_t> buffer;
+    if(buffer.size() < size) {
+        buffer.resize(size);
+    }
+    return buffer.data();
+}
+
+void ntt_mul(const mpz_ptr r, const mpz_srcptr a, const mpz_srcptr b) {
+    const std::size_t na = mpz_size(a), nb = mpz_size(b);
+    if(!na || !nb || na + nb > mpzNttMaxLimbs) {
+        mpz_mul(r, a, b);
+        return;
+    }
+    const int sign = mpz_sgn(a) * mpz_sgn(b);
+    const Kernel& k = *kernel_of(ntt_kernel());
+    const std::size_t n = std::bit_ceil(2 * (na + nb) - 1);
+    //three residues & the second operand's transform
+    const std::size_t size = (a != b ? 4 : 3) * n;
+    std::vector<std::uint32_t> large;
+    std::uint32_t* const residues = size <= cachedWorkspace ? workspace(size) : (large.resize(size), large.data());
+    std::uint32_t* const r0 = residues, * const r1 = residues + n, * const r2 = residues + 2*n;
+    for(std::size_t i=0; i<3; ++i) {
+        convolve(k, residues + i*n, residues + 3*n, a, b, n, i);
+    }
+    k.crt(r0, r1, r2, n);
+
+    const u128 p0 = primes[0].p, p01 = p0 * primes[1].p;
+    const std::size_t limbs = na + nb;
+    mp_limb_t* const d = mpz_limbs_write(r, static_cast<mp_size_t>(limbs));
+    u128 carry = 0;
+    for(std::size_t i=0; i<limbs; ++i) {
+        mp_limb_t limb = 0;
+        for(std::size_t h=0; h<2; ++h) {
+            const std::size_t j = 2*i + h;
+            if(j < n) {
+                carry += r0[j] + r1[j] * p0 + r2[j] * p01;
+            }
+            limb |= static_cast<mp_limb_t>(static_cast<std::uint32_t>(carry)) << (32 * h);
+            carry >>= 32;
+        }
+        d[i] = limb;
+    }
+    mpz_limbs_finish(r, sign < 0 ? -static_cast<mp_size_t>(limbs) : static_cast<mp_size_t>(limbs));
+}
+
+Mpz ntt_mul(const Mpz& a, const Mpz& b) {
+    Mpz r;
+    ntt_mul(r.get_mpz_t(), a.get_mpz_t(), b.get_mpz_t());
+    return r;
+}
+
+
+//Measured against GMP 6.2 on one core. The transform is padded to a power
+//of two, so the shorter operand is weighed by how much of it is used: at
+//just over half full mpz_mul keeps up well into the thousands of limbs.
+//The scalar kernel is slower than mpz_mul at every size.
+static constexpr std::size_t avx512Limbs = 640, avx2Limbs = 1536;
+
+bool ntt_preferred(const std::size_t na, const std::size_t nb) {
+    if(std::min(na, nb) < avx512Limbs || na + nb > mpzNttMaxLimbs) {
+        return false;
+    }
+    const std::size_t pieces = 2 * (na + nb), n = std::bit_ceil(pieces - 1);
+    const std::size_t effective = std::min(na, nb) * pieces / n;
+    switch(ntt_kernel()) {
+        case MpzNttKernel::avx512:
+            return effective >= avx512Limbs;
+        case MpzNttKernel::avx2:
+            return effective >= avx2Limbs && 4 * pieces >= 3 * n;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef MPZ_NTT_H
+#define MPZ_NTT_H
+
+
+
+#include <cstddef>
+
+#include "mpz.h"
+
+
+
+//Number theoretic transform multiplication
+//https://gmplib.org/manual/FFT-Multiplication (GMP's Schönhage-Strassen)
+//https://en.wikipedia.org/wiki/Sch%C3%B6nhage%E2%80%93Strassen_algorithm#Convolution_theorem
+//
+//The operands are cut into 32 bit pieces and convolved modulo three primes
+//c*2^k+1 just below 2^31, the exact coefficients (< 2^88) come back by
+//CRT (Garner) and are carried into limbs. The transforms are radix 2 with
+//Montgomery arithmetic, forward in decimation in frequency and inverse in
+//decimation in time so no bit reversal is needed, the levels below 16K
+//elements run block by block in L1.
+//
+//Butterflies come in a scalar, an AVX2 (8 lanes) and an AVX-512 (16
+//lanes) kernel, the best one the CPU supports is picked at first use. The
+//result is exact, i.e. always the same as mpz_mul's.
+//
+//Mpz's products go through multiply() (see mpz_mul.h), which takes this
+//path above a crossover where it beats mpz_mul.
+
+
+
+enum class MpzNttKernel {
+    scalar,
+    avx2,
+    avx512
+};
+
+//Largest product, in limbs of both operands together (2^29 bits)
+inline constexpr std::size_t mpzNttMaxLimbs = std::size_t{1} << 23;
+
+//Whether the kernel is compiled in and the CPU runs it
+[[nodiscard]] bool ntt_supported(const MpzNttKernel kernel);
+//The kernel in use, process wide
+[[nodiscard]] MpzNttKernel ntt_kernel();
+//Throws std::invalid_argument if the kernel isn't supported
+void set_ntt_kernel(const MpzNttKernel kernel);
+
+//r = a*b, squares if a and b are the same. r may be a or b. Products
+//beyond mpzNttMaxLimbs go to mpz_mul.
+void ntt_mul(mpz_ptr r, mpz_srcptr a, mpz_srcptr b);
+Mpz ntt_mul(const Mpz& a, const Mpz& b);
+//Whether ntt_mul beats mpz_mul for operands of na & nb limbs with the
+//current kernel, the crossover multiply() uses
+[[nodiscard]] bool ntt_preferred(const std::size_t na, const std::size_t nb);
+
+//Twiddle tables of transforms up to 2^20 elements are kept, 24 MB at most.
+//Each thread also keeps a 4 MB workspace for products up to 2^16 limbs.
+void release_ntt_tables();
+
+
+
+#endif //MPZ_NTT_H
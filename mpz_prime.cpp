@@ -0,0 +1,97 @@
+#include "mpz_prime.h"
+
+#include <algorithm>
+#include <numeric>
+
+
+
+//Products of the odd primes below 2^12, each fits into an unsigned long
+static const std::vector<unsigned long>& sieve_products() {
+    static const std::vector<unsigned long> products = []() {
+        constexpr unsigned long limit = 1ul << 12;
+        std::vector<bool> composite(limit);
+        std::vector<unsigned long> r{1};
+        for(unsigned long p=3; p<limit; p+=2) {
+            if(composite[p]) {
+                continue;
+            }
+            for(unsigned long q=p*p; q<limit; q+=2*p) {
+                composite[q] = true;
+            }
+            if(r.back() > ~0ul / p) {
+                r.push_back(1);
+            }
+            r.back() *= p;
+        }
+        return r;
+    }();
+    return products;
+}
+
+//Only rules out numbers with a small factor that aren't that factor themselves
+static bool survives_sieve(const Mpz& n) {
+    if(n.fits_ul() || sgn(n) < 0) {
+        return true; //is_probable_prime is exact & cheap there
+    }
+    if(n.is_even()) {
+        return false;
+    }
+    for(const unsigned long p : sieve_products()) {
+        if(std::gcd(mpz_fdiv_ui(n.get_mpz_t(), p), p) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+std::vector<std::size_t> probable_primes(const std::span<const Mpz> candidates,
+        const unsigned int rounds, MpzExecutor& executor) {
+    const std::size_t tasks = 4 * (executor.size() + 1);
+
+    //sieve, one survivor list per chunk keeps them in order
+    const std::size_t sieveChunk = std::max<std::size_t>((candidates.size() + tasks - 1) / tasks, 64);
+    std::vector<std::vector<std::size_t>> chunks((candidates.size() + sieveChunk - 1) / sieveChunk);
+    {
+        MpzTaskGroup group{executor};
+        for(std::size_t c=0; c<chunks.size(); ++c) {
+            group.run([&, c]() {
+                const std::size_t end = std::min(candidates.size(), (c+1) * sieveChunk);
+                for(std::size_t i=c*sieveChunk; i<end; ++i) {
+                    if(survives_sieve(candidates[i])) {
+                        chunks[c].push_back(i);
+                    }
+                }
+            });
+        }
+        group.wait();
+    }
+    std::vector<std::size_t> survivors;
+    for(const std::vector<std::size_t>& c : chunks) {
+        survivors.insert(survivors.end(), c.begin(), c.end());
+    }
+
+    //expensive tests, evenly split over the survivors
+    std::vector<unsigned char> prime(survivors.size());
+    {
+        const std::size_t chunk = std::max<std::size_t>((survivors.size() + tasks - 1) / tasks, 1);
+        MpzTaskGroup group{executor};
+        for(std::size_t begin=0; begin<survivors.size(); begin+=chunk) {
+            group.run([&, begin]() {
+                const std::size_t end = std::min(survivors.size(), begin + chunk);
+                for(std::size_t i=begin; i<end; ++i) {
+                    prime[i] = candidates[survivors[i]].is_probable_prime(rounds);
+                }
+            });
+        }
+        group.wait();
+    }
+
+    std::vector<std::size_t> r;
+    for(std::size_t i=0; i<survivors.size(); ++i) {
+        if(prime[i]) {
+            r.push_back(survivors[i]);
+        }
+    }
+    return r;
+}
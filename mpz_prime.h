@@ -0,0 +1,27 @@
+#ifndef MPZ_PRIME_H
+#define MPZ_PRIME_H
+
+
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Batch primality screening
+//
+//Candidates are first sieved by the primes below 2^12 (through remainders
+//by limb sized products of primes, one pass over each number per product),
+//then the survivors are spread evenly over the executor and tested with
+//Mpz::is_probable_prime(rounds). Returns the indices of the probable primes,
+//ascending.
+std::vector<std::size_t> probable_primes(std::span<const Mpz> candidates,
+        const unsigned int rounds=0, MpzExecutor& executor=MpzExecutor::shared());
+
+
+
+#endif //MPZ_PRIME_H
@@ -0,0 +1,155 @@
+#include "mpz_random.h"
+
+#include <algorithm>
+#include <bit>
+#include <random>
+#include <stdexcept>
+
+
+
+//Generator
+//https://prng.di.unimi.it/xoshiro256starstar.c
+static unsigned long splitmix64(unsigned long& x) {
+    unsigned long z = (x += 0x9e3779b97f4a7c15ul);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ul;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebul;
+    return z ^ (z >> 31);
+}
+
+
+MpzRandom::MpzRandom(unsigned long seed) {
+    for(unsigned long& w : s) {
+        w = splitmix64(seed);
+    }
+}
+
+MpzRandom::MpzRandom(const unsigned long seed, const unsigned long stream) : MpzRandom(seed) {
+    for(unsigned long i=0; i<stream; ++i) {
+        jump();
+    }
+}
+
+MpzRandom& MpzRandom::local() {
+    static thread_local MpzRandom rng = []() {
+        std::random_device dev;
+        return MpzRandom{(static_cast<unsigned long>(dev()) << 32) ^ dev()};
+    }();
+    return rng;
+}
+
+void MpzRandom::seed_local(const unsigned long seed, const unsigned long stream) {
+    local() = MpzRandom{seed, stream};
+}
+
+
+MpzRandom::result_type MpzRandom::operator()() {
+    const unsigned long r = std::rotl(s[1] * 5, 7) * 9;
+    const unsigned long t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = std::rotl(s[3], 45);
+    return r;
+}
+
+void MpzRandom::jump(const unsigned long (&polynomial)[4]) {
+    unsigned long t[4] = {};
+    for(const unsigned long p : polynomial) {
+        for(int b=0; b<64; ++b) {
+            if((p >> b) & 1) {
+                for(int i=0; i<4; ++i) {
+                    t[i] ^= s[i];
+                }
+            }
+            (*this)();
+        }
+    }
+    std::copy(t, t+4, s);
+}
+
+void MpzRandom::jump() {
+    jump({0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c});
+}
+
+void MpzRandom::long_jump() {
+    jump({0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635});
+}
+
+
+
+//Integers
+void MpzRandom::fill_limbs(mp_limb_t* const d, const mp_size_t n) {
+    for(mp_size_t i=0; i<n; ++i) {
+        d[i] = (*this)();
+    }
+}
+
+
+//Rejection sampling on n's bit length, takes less than 2 tries on average
+Mpz MpzRandom::below(const Mpz& n) {
+    Mpz r;
+    fill_below({&r, 1}, n);
+    return r;
+}
+
+Mpz MpzRandom::bits(const unsigned long bits) {
+    Mpz r;
+    fill_bits({&r, 1}, bits);
+    return r;
+}
+
+
+void MpzRandom::fill_below(const std::span<Mpz> out, const Mpz& n) {
+    if(sgn(n) <= 0) {
+        throw std::invalid_argument("Upper bound must be positive");
+    }
+    const mpz_srcptr N = n.get_mpz_t();
+    const mp_size_t size = mpz_size(N);
+    const mp_limb_t* const nd = mpz_limbs_read(N);
+    const mp_limb_t mask = ~0ul >> std::countl_zero(nd[size-1]);
+    if(size == 1) {
+        for(Mpz& r : out) {
+            mp_limb_t m;
+            do {
+                m = (*this)() & mask;
+            } while(m >= nd[0]);
+            r = Mpz{m};
+        }
+        return;
+    }
+    for(Mpz& r : out) {
+        const mpz_ptr R = r.get_mpz_t();
+        mp_limb_t* const d = mpz_limbs_write(R, size);
+        do {
+            fill_limbs(d, size);
+            d[size-1] &= mask;
+        } while(mpn_cmp(d, nd, size) >= 0);
+        mpz_limbs_finish(R, size);
+    }
+}
+
+void MpzRandom::fill_bits(const std::span<Mpz> out, const unsigned long bits) {
+    const mp_size_t size = (bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    if(!bits) {
+        for(Mpz& r : out) {
+            r = Mpz{};
+        }
+        return;
+    }
+    const mp_limb_t top = 1ul << ((bits - 1) % GMP_NUMB_BITS);
+    if(size == 1) {
+        for(Mpz& r : out) {
+            r = Mpz{((*this)() & (top - 1)) | top};
+        }
+        return;
+    }
+    for(Mpz& r : out) {
+        const mpz_ptr R = r.get_mpz_t();
+        mp_limb_t* const d = mpz_limbs_write(R, size);
+        fill_limbs(d, size);
+        d[size-1] = (d[size-1] & (top - 1)) | top;
+        mpz_limbs_finish(R, size);
+    }
+}
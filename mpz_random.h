@@ -0,0 +1,62 @@
+#ifndef MPZ_RANDOM_H
+#define MPZ_RANDOM_H
+
+
+
+#include <span>
+
+#include "mpz.h"
+
+
+
+//Random integers
+//https://prng.di.unimi.it/
+//
+//xoshiro256** generator, 256 bit state that can be advanced by 2^128 or
+//2^192 steps at once. Parallel jobs stay reproducible by giving each its
+//own stream of one seed:
+//  MpzRandom rng{seed, job}; //job-th block of 2^128 numbers
+//Limbs are written straight into the integers, no gmp_randstate_t involved.
+//Satisfies UniformRandomBitGenerator, so it works with <random> too.
+//
+//Generators aren't synchronised, use one per thread. Mpz::rand() uses the
+//calling thread's local() generator, seeded from std::random_device unless
+//seeded explicitly.
+class MpzRandom {
+private:
+    unsigned long s[4];
+
+    void jump(const unsigned long (&polynomial)[4]);
+    void fill_limbs(mp_limb_t* d, const mp_size_t n);
+
+public:
+    using result_type = unsigned long;
+
+    explicit MpzRandom(const unsigned long seed);
+    //seed's sequence advanced by stream*2^128 steps, O(stream)
+    MpzRandom(const unsigned long seed, const unsigned long stream);
+
+    //Calling thread's generator
+    static MpzRandom& local();
+    static void seed_local(const unsigned long seed, const unsigned long stream=0);
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~0ul; }
+    result_type operator()();
+
+    void jump(); //2^128 steps ahead
+    void long_jump(); //2^192 steps ahead
+
+    //Uniform in [0, n), n > 0
+    [[nodiscard]] Mpz below(const Mpz& n);
+    //Uniform with exactly `bits` significant bits (top bit set), 0 for 0 bits
+    [[nodiscard]] Mpz bits(const unsigned long bits);
+
+    //Bulk versions, reuse the integers' buffers
+    void fill_below(std::span<Mpz> out, const Mpz& n);
+    void fill_bits(std::span<Mpz> out, const unsigned long bits);
+};
+
+
+
+#endif //MPZ_RANDOM_H
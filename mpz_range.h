@@ -0,0 +1,226 @@
+#ifndef MPZ_RANGE_H
+#define MPZ_RANGE_H
+
+
+
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <numeric>
+#include <ranges>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Reductions over ranges of Mpz or unsigned integers
+//
+//  product(v), sum(first, last), lcm(span), gcd(v, executor)
+//
+//The range is split in halves recursively (balanced binary splitting), so
+//operands of similar size get combined, a running accumulator would make
+//products & lcms quadratic. Short runs at the leaves are folded directly,
+//unsigned integers in native 64/128 bit arithmetic without creating an Mpz
+//per element. Halves of ranges above parallelThreshold elements run as
+//separate tasks on the executor.
+//
+//Empty ranges give the identities: product 1, sum 0, lcm 1, gcd 0.
+
+
+
+template<typename T>
+concept MpzReducible = std::same_as<T, Mpz> || std::unsigned_integral<T>;
+
+template<typename It>
+concept MpzReducibleIterator = std::random_access_iterator<It> && MpzReducible<std::iter_value_t<It>>;
+
+template<typename R>
+concept MpzReducibleRange = std::ranges::random_access_range<R> && std::ranges::common_range<R>
+        && MpzReducible<std::ranges::range_value_t<R>>;
+
+
+
+//Operations: leaf folds a short run, combine joins two halves
+struct MpzProductOp {
+    template<typename It>
+    static Mpz leaf(It first, const It last) {
+        Mpz r{1ul};
+        if constexpr(std::same_as<std::iter_value_t<It>, Mpz>) {
+            for(; first!=last; ++first) {
+                r *= *first;
+            }
+        } else {
+            //multiply into a limb until it overflows
+            unsigned long acc = 1;
+            for(; first!=last; ++first) {
+                const unsigned long v = *first;
+                const unsigned __int128 p = static_cast<unsigned __int128>(acc) * v;
+                if(p >> 64) {
+                    r *= acc;
+                    acc = v;
+                } else {
+                    acc = static_cast<unsigned long>(p);
+                }
+            }
+            r *= acc;
+        }
+        return r;
+    }
+    static Mpz combine(Mpz&& a, Mpz&& b) {
+        return std::move(a) * std::move(b);
+    }
+};
+
+struct MpzSumOp {
+    template<typename It>
+    static Mpz leaf(It first, const It last) {
+        if constexpr(std::same_as<std::iter_value_t<It>, Mpz>) {
+            Mpz r;
+            for(; first!=last; ++first) {
+                r += *first;
+            }
+            return r;
+        } else {
+            unsigned __int128 acc = 0;
+            for(; first!=last; ++first) {
+                acc += static_cast<unsigned long>(*first);
+            }
+            Mpz r{static_cast<unsigned long>(acc >> 64)};
+            r <<= 64;
+            r += static_cast<unsigned long>(acc);
+            return r;
+        }
+    }
+    static Mpz combine(Mpz&& a, Mpz&& b) {
+        return std::move(a) + std::move(b);
+    }
+};
+
+struct MpzGcdOp {
+    template<typename It>
+    static Mpz leaf(It first, const It last) {
+        if constexpr(std::same_as<std::iter_value_t<It>, Mpz>) {
+            Mpz r;
+            for(; first!=last && r!=1ul; ++first) {
+                r = gcd(std::move(r), *first);
+            }
+            return r;
+        } else {
+            unsigned long acc = 0;
+            for(; first!=last && acc!=1; ++first) {
+                acc = std::gcd(acc, static_cast<unsigned long>(*first));
+            }
+            return Mpz{acc};
+        }
+    }
+    static Mpz combine(Mpz&& a, Mpz&& b) {
+        return gcd(std::move(a), std::move(b));
+    }
+};
+
+struct MpzLcmOp {
+    template<typename It>
+    static Mpz leaf(It first, const It last) {
+        Mpz r{1ul};
+        if constexpr(std::same_as<std::iter_value_t<It>, Mpz>) {
+            for(; first!=last && r; ++first) {
+                r = lcm(std::move(r), *first);
+            }
+        } else {
+            //lcm within a limb until it overflows
+            unsigned long acc = 1;
+            for(; first!=last && acc; ++first) {
+                const unsigned long v = *first;
+                const unsigned __int128 l = v ? static_cast<unsigned __int128>(acc / std::gcd(acc, v)) * v : 0;
+                if(l >> 64) {
+                    r = lcm(std::move(r), acc);
+                    acc = v;
+                } else {
+                    acc = static_cast<unsigned long>(l);
+                }
+            }
+            r = lcm(std::move(r), acc);
+        }
+        return r;
+    }
+    static Mpz combine(Mpz&& a, Mpz&& b) {
+        return lcm(std::move(a), std::move(b));
+    }
+};
+
+
+
+//Balanced binary splitting
+template<typename Op, MpzReducibleIterator It>
+Mpz mpz_reduce(const It first, const It last, MpzExecutor& executor) {
+    constexpr std::size_t grain = std::same_as<std::iter_value_t<It>, Mpz> ? 8 : 32;
+    constexpr std::size_t parallelThreshold = 64 * grain;
+    const std::size_t n = last - first;
+    if(n <= grain) {
+        return Op::leaf(first, last);
+    }
+    const It mid = first + n/2;
+    Mpz a, b;
+    if(n >= parallelThreshold && executor.size()) {
+        MpzTaskGroup group{executor};
+        group.run([&a, first, mid, &executor]() {
+            a = mpz_reduce<Op>(first, mid, executor);
+        });
+        b = mpz_reduce<Op>(mid, last, executor);
+        group.wait();
+    } else {
+        a = mpz_reduce<Op>(first, mid, executor);
+        b = mpz_reduce<Op>(mid, last, executor);
+    }
+    return Op::combine(std::move(a), std::move(b));
+}
+
+
+
+//Iterator ranges
+template<MpzReducibleIterator It>
+Mpz product(const It first, const It last, MpzExecutor& executor=MpzExecutor::shared()) {
+    return mpz_reduce<MpzProductOp>(first, last, executor);
+}
+
+template<MpzReducibleIterator It>
+Mpz sum(const It first, const It last, MpzExecutor& executor=MpzExecutor::shared()) {
+    return mpz_reduce<MpzSumOp>(first, last, executor);
+}
+
+template<MpzReducibleIterator It>
+Mpz gcd(const It first, const It last, MpzExecutor& executor=MpzExecutor::shared()) {
+    return mpz_reduce<MpzGcdOp>(first, last, executor);
+}
+
+template<MpzReducibleIterator It>
+Mpz lcm(const It first, const It last, MpzExecutor& executor=MpzExecutor::shared()) {
+    return mpz_reduce<MpzLcmOp>(first, last, executor);
+}
+
+
+//Ranges (spans, vectors, ...)
+template<MpzReducibleRange R>
+Mpz product(const R& r, MpzExecutor& executor=MpzExecutor::shared()) {
+    return product(std::ranges::begin(r), std::ranges::end(r), executor);
+}
+
+template<MpzReducibleRange R>
+Mpz sum(const R& r, MpzExecutor& executor=MpzExecutor::shared()) {
+    return sum(std::ranges::begin(r), std::ranges::end(r), executor);
+}
+
+template<MpzReducibleRange R>
+Mpz gcd(const R& r, MpzExecutor& executor=MpzExecutor::shared()) {
+    return gcd(std::ranges::begin(r), std::ranges::end(r), executor);
+}
+
+template<MpzReducibleRange R>
+Mpz lcm(const R& r, MpzExecutor& executor=MpzExecutor::shared()) {
+    return lcm(std::ranges::begin(r), std::ranges::end(r), executor);
+}
+
+
+
+#endif //MPZ_RANGE_H
@@ -0,0 +1,336 @@
+#include "mpz_recurrence.h"
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "mpz_montgomery.h"
+
+
+
+using u128 = unsigned __int128;
+
+
+
+//Residues
+//Both rings have the same members, values in their own representation,
+//reduce() takes any integer in & lift() gives [0, m) back
+
+//m < 2^64, products in 128 bits
+struct WordRing {
+    using Value = unsigned long;
+    unsigned long m;
+
+    explicit WordRing(const Mpz& modulus) : m(mpz_get_ui(modulus.get_mpz_t())) {}
+
+    [[nodiscard]] Value reduce(const Mpz& x) const {
+        return mpz_fdiv_ui(x.get_mpz_t(), m);
+    }
+    [[nodiscard]] Mpz lift(const Value x) const {
+        return Mpz{x};
+    }
+    [[nodiscard]] Value zero() const {
+        return 0;
+    }
+    [[nodiscard]] Value one() const {
+        return 1 % m;
+    }
+    [[nodiscard]] Value mul(const Value a, const Value b) const {
+        return static_cast<Value>(static_cast<u128>(a) * b % m);
+    }
+    [[nodiscard]] Value add(const Value a, const Value b) const {
+        const Value s = a + b;
+        return s < a || s >= m ? s - m : s;
+    }
+    [[nodiscard]] Value sub(const Value a, const Value b) const {
+        return a >= b ? a - b : a + (m - b);
+    }
+};
+
+//m >= 2^64, Montgomery form if odd
+struct MpzRing {
+    using Value = Mpz;
+    Mpz m;
+    std::optional<MpzMontgomery> montgomery;
+
+    explicit MpzRing(const Mpz& modulus) : m(modulus) {
+        if(mpz_odd_p(m.get_mpz_t())) {
+            montgomery.emplace(m);
+        }
+    }
+
+    [[nodiscard]] Value reduce(const Mpz& x) const {
+        if(montgomery) {
+            return montgomery->to_montgomery(x);
+        }
+        Mpz r;
+        mpz_mod(r.get_mpz_t(), x.get_mpz_t(), m.get_mpz_t());
+        return r;
+    }
+    [[nodiscard]] Mpz lift(const Value& x) const {
+        return montgomery ? montgomery->from_montgomery(x) : x;
+    }
+    [[nodiscard]] Value zero() const {
+        return Mpz{};
+    }
+    [[nodiscard]] Value one() const {
+        return montgomery ? montgomery->one() : Mpz{1ul};
+    }
+    [[nodiscard]] Value mul(const Value& a, const Value& b) const {
+        if(montgomery) {
+            return montgomery->mul(a, b);
+        }
+        Mpz r = a * b;
+        mpz_mod(r.get_mpz_t(), r.get_mpz_t(), m.get_mpz_t());
+        return r;
+    }
+    [[nodiscard]] Value add(const Value& a, const Value& b) const {
+        if(montgomery) {
+            return montgomery->add(a, b);
+        }
+        Mpz r = a + b;
+        if(r >= m) {
+            r -= m;
+        }
+        return r;
+    }
+    [[nodiscard]] Value sub(const Value& a, const Value& b) const {
+        if(montgomery) {
+            return montgomery->sub(a, b);
+        }
+        Mpz r = a - b;
+        if(sgn(r) < 0) {
+            r += m;
+        }
+        return r;
+    }
+};
+
+static void check_modulus(const Mpz& m, const char* const function) {
+    if(sgn(m) < 1) {
+        throw std::invalid_argument(std::string{function} + ": modulus must be positive");
+    }
+}
+
+//f(ring) with the ring for m
+template<typename F>
+static auto with_ring(const Mpz& m, F&& f) {
+    if(mpz_fits_ulong_p(m.get_mpz_t())) {
+        return f(WordRing{m});
+    }
+    return f(MpzRing{m});
+}
+
+
+
+//Fibonacci & Lucas numbers
+//(F(n), F(n+1)) for n >= 0 from the top bit down
+template<typename Ring>
+static std::pair<typename Ring::Value, typename Ring::Value> fib_pair(const Ring& ring, const Mpz& n) {
+    using Value = typename Ring::Value;
+    Value a = ring.zero(), b = ring.one();
+    for(std::size_t bit=mpz_sizeinbase(n.get_mpz_t(), 2); bit-->0;) {
+        //F(2k) = F(k)*(2F(k+1) - F(k)), F(2k+1) = F(k)^2 + F(k+1)^2
+        Value d = ring.mul(a, ring.sub(ring.add(b, b), a));
+        Value e = ring.add(ring.mul(a, a), ring.mul(b, b));
+        if(mpz_tstbit(n.get_mpz_t(), bit)) {
+            b = ring.add(d, e);
+            a = std::move(e);
+        } else {
+            a = std::move(d);
+            b = std::move(e);
+        }
+    }
+    return {std::move(a), std::move(b)};
+}
+
+template<typename Ring>
+static Mpz fib_term(const Ring& ring, const Mpz& n) {
+    const Mpz N = abs(n);
+    auto [f, next] = fib_pair(ring, N);
+    if(sgn(n) < 0 && mpz_even_p(N.get_mpz_t())) {
+        f = ring.sub(ring.zero(), f);
+    }
+    return ring.lift(f);
+}
+
+template<typename Ring>
+static Mpz lucas_term(const Ring& ring, const Mpz& n) {
+    const Mpz N = abs(n);
+    const auto [f, next] = fib_pair(ring, N);
+    typename Ring::Value l = ring.sub(ring.add(next, next), f);
+    if(sgn(n) < 0 && mpz_odd_p(N.get_mpz_t())) {
+        l = ring.sub(ring.zero(), l);
+    }
+    return ring.lift(l);
+}
+
+
+Mpz fib_mod(const Mpz& n, const Mpz& m) {
+    check_modulus(m, "fib_mod");
+    return with_ring(m, [&](const auto& ring) { return fib_term(ring, n); });
+}
+
+Mpz fib_mod(const unsigned long n, const Mpz& m) {
+    return fib_mod(Mpz{n}, m);
+}
+
+std::vector<Mpz> fib_mod(const std::span<const Mpz> n, const Mpz& m, MpzExecutor& executor) {
+    check_modulus(m, "fib_mod");
+    return with_ring(m, [&](const auto& ring) {
+        std::vector<Mpz> r(n.size());
+        parallel_for(executor, n.size(), [&](const std::size_t i) {
+            r[i] = fib_term(ring, n[i]);
+        });
+        return r;
+    });
+}
+
+Mpz lucas_mod(const Mpz& n, const Mpz& m) {
+    check_modulus(m, "lucas_mod");
+    return with_ring(m, [&](const auto& ring) { return lucas_term(ring, n); });
+}
+
+Mpz lucas_mod(const unsigned long n, const Mpz& m) {
+    return lucas_mod(Mpz{n}, m);
+}
+
+std::vector<Mpz> lucas_mod(const std::span<const Mpz> n, const Mpz& m, MpzExecutor& executor) {
+    check_modulus(m, "lucas_mod");
+    return with_ring(m, [&](const auto& ring) {
+        std::vector<Mpz> r(n.size());
+        parallel_for(executor, n.size(), [&](const std::size_t i) {
+            r[i] = lucas_term(ring, n[i]);
+        });
+        return r;
+    });
+}
+
+
+
+//k term recurrences
+//Polynomials of degree < k, p[i] the coefficient of x^i, modulo
+//P(x) = x^k - c[0]*x^(k-1) - ... - c[k-1], where x^k = sum c[j]*x^(k-1-j)
+template<typename Ring>
+class Polynomials {
+private:
+    using Value = typename Ring::Value;
+    const Ring& ring;
+    std::vector<Value> c;
+
+public:
+    Polynomials(const Ring& ring, const std::vector<Mpz>& coefficients) : ring(ring) {
+        for(const Mpz& x : coefficients) {
+            c.push_back(ring.reduce(x));
+        }
+    }
+
+    //p*x
+    void shift(std::vector<Value>& p) const {
+        const std::size_t k = c.size();
+        const Value top = std::move(p[k-1]);
+        for(std::size_t i=k-1; i>0; --i) {
+            p[i] = std::move(p[i-1]);
+        }
+        p[0] = ring.zero();
+        for(std::size_t j=0; j<k; ++j) {
+            p[k-1-j] = ring.add(p[k-1-j], ring.mul(top, c[j]));
+        }
+    }
+
+    //p^2, the cross products once & doubled, x^k and up folded back down
+    void square(std::vector<Value>& p) const {
+        const std::size_t k = c.size();
+        std::vector<Value> q(2*k - 1, ring.zero());
+        for(std::size_t i=0; i<k; ++i) {
+            q[2*i] = ring.add(q[2*i], ring.mul(p[i], p[i]));
+            for(std::size_t j=i+1; j<k; ++j) {
+                const Value t = ring.mul(p[i], p[j]);
+                q[i+j] = ring.add(q[i+j], ring.add(t, t));
+            }
+        }
+        for(std::size_t i=2*k-1; i-->k;) {
+            for(std::size_t j=0; j<k; ++j) {
+                q[i-1-j] = ring.add(q[i-1-j], ring.mul(q[i], c[j]));
+            }
+        }
+        q.resize(k);
+        p = std::move(q);
+    }
+
+    //x^n
+    [[nodiscard]] std::vector<Value> power(const Mpz& n) const {
+        std::vector<Value> p(c.size(), ring.zero());
+        p[0] = ring.one();
+        for(std::size_t bit=mpz_sizeinbase(n.get_mpz_t(), 2); bit-->0;) {
+            square(p);
+            if(mpz_tstbit(n.get_mpz_t(), bit)) {
+                shift(p);
+            }
+        }
+        return p;
+    }
+};
+
+//a(n) = sum of the coefficients of x^n mod P times a(0), ..., a(k-1)
+template<typename Ring>
+static Mpz recurrence_term(const Polynomials<Ring>& polynomials, const Ring& ring,
+        const std::vector<typename Ring::Value>& a, const Mpz& n) {
+    if(sgn(n) < 0) {
+        throw std::invalid_argument("MpzRecurrence: negative index");
+    }
+    if(n < a.size()) {
+        return ring.lift(a[mpz_get_ui(n.get_mpz_t())]);
+    }
+    const std::vector<typename Ring::Value> p = polynomials.power(n);
+    typename Ring::Value r = ring.zero();
+    for(std::size_t i=0; i<a.size(); ++i) {
+        r = ring.add(r, ring.mul(p[i], a[i]));
+    }
+    return ring.lift(r);
+}
+
+template<typename Ring>
+static std::vector<typename Ring::Value> reduce_all(const Ring& ring, const std::vector<Mpz>& x) {
+    std::vector<typename Ring::Value> r;
+    for(const Mpz& y : x) {
+        r.push_back(ring.reduce(y));
+    }
+    return r;
+}
+
+
+MpzRecurrence::MpzRecurrence(std::vector<Mpz> coefficients, std::vector<Mpz> initial, const Mpz& modulus)
+        : coefficients(std::move(coefficients)), initial(std::move(initial)), m(modulus) {
+    check_modulus(m, "MpzRecurrence");
+    if(this->coefficients.empty() || this->coefficients.size() != this->initial.size()) {
+        throw std::invalid_argument("MpzRecurrence: needs as many initial values as coefficients, at least one");
+    }
+}
+
+const Mpz& MpzRecurrence::modulus() const {
+    return m;
+}
+
+std::size_t MpzRecurrence::order() const {
+    return coefficients.size();
+}
+
+Mpz MpzRecurrence::operator()(const Mpz& n) const {
+    return with_ring(m, [&](const auto& ring) {
+        return recurrence_term(Polynomials{ring, coefficients}, ring, reduce_all(ring, initial), n);
+    });
+}
+
+std::vector<Mpz> MpzRecurrence::operator()(const std::span<const Mpz> n, MpzExecutor& executor) const {
+    return with_ring(m, [&](const auto& ring) {
+        const Polynomials polynomials{ring, coefficients};
+        const auto a = reduce_all(ring, initial);
+        std::vector<Mpz> r(n.size());
+        parallel_for(executor, n.size(), [&](const std::size_t i) {
+            r[i] = recurrence_term(polynomials, ring, a, n[i]);
+        });
+        return r;
+    });
+}
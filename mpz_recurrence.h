@@ -0,0 +1,74 @@
+#ifndef MPZ_RECURRENCE_H
+#define MPZ_RECURRENCE_H
+
+
+
+#include <span>
+#include <vector>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Linear recurrences modulo m
+//https://gmplib.org/manual/Fibonacci-Numbers-Algorithm
+//https://gmplib.org/manual/Lucas-Numbers-Algorithm
+//https://en.wikipedia.org/wiki/Linear_recurrence_with_constant_coefficients
+//
+//Terms of astronomically large index without the full numbers: every
+//intermediate is reduced mod m, so the cost is O(log n) operations on
+//numbers of m's size.
+//- Fibonacci & Lucas numbers by fast doubling over the bits of n,
+//  F(2k) = F(k)*(2F(k+1) - F(k)), F(2k+1) = F(k)^2 + F(k+1)^2, then
+//  L(n) = 2F(n+1) - F(n). Negative indices follow F(-n) = (-1)^(n+1) F(n)
+//  & L(-n) = (-1)^n L(n).
+//- k term recurrences by x^n mod the characteristic polynomial (Fiduccia),
+//  squarings & reductions of degree < k polynomials, O(k^2 log n).
+//
+//Moduli of up to 64 bits are word arithmetic, odd larger ones Montgomery
+//(see mpz_montgomery.h), even ones mpz_mod. Batches share that context and
+//spread the indices over an executor. Results are in [0, m). Moduli < 1
+//throw std::invalid_argument.
+
+
+
+[[nodiscard]] Mpz fib_mod(const Mpz& n, const Mpz& m);
+[[nodiscard]] Mpz fib_mod(const unsigned long n, const Mpz& m);
+[[nodiscard]] std::vector<Mpz> fib_mod(std::span<const Mpz> n, const Mpz& m,
+        MpzExecutor& executor=MpzExecutor::shared());
+
+[[nodiscard]] Mpz lucas_mod(const Mpz& n, const Mpz& m);
+[[nodiscard]] Mpz lucas_mod(const unsigned long n, const Mpz& m);
+[[nodiscard]] std::vector<Mpz> lucas_mod(std::span<const Mpz> n, const Mpz& m,
+        MpzExecutor& executor=MpzExecutor::shared());
+
+
+//a(n) = c[0]*a(n-1) + c[1]*a(n-2) + ... + c[k-1]*a(n-k) mod m, given
+//a(0), ..., a(k-1)
+//
+//  const MpzRecurrence tribonacci{{Mpz{1ul}, Mpz{1ul}, Mpz{1ul}}, {Mpz{0ul}, Mpz{0ul}, Mpz{1ul}}, m};
+//  Mpz t = tribonacci(Mpz{10ul} << 100);
+class MpzRecurrence {
+private:
+    std::vector<Mpz> coefficients;
+    std::vector<Mpz> initial;
+    Mpz m;
+
+public:
+    //Throws std::invalid_argument if there are no coefficients, not as many
+    //initial values or the modulus is < 1
+    MpzRecurrence(std::vector<Mpz> coefficients, std::vector<Mpz> initial, const Mpz& modulus);
+
+    [[nodiscard]] const Mpz& modulus() const;
+    [[nodiscard]] std::size_t order() const;
+
+    //a(n) for n >= 0, throws std::invalid_argument for negative ones
+    [[nodiscard]] Mpz operator()(const Mpz& n) const;
+    [[nodiscard]] std::vector<Mpz> operator()(std::span<const Mpz> n,
+            MpzExecutor& executor=MpzExecutor::shared()) const;
+};
+
+
+
+#endif //MPZ_RECURRENCE_H
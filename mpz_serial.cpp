@@ -0,0 +1,384 @@
+#include "mpz_serial.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+//Limbs go to & from the formats by plain copies
+static_assert(std::endian::native == std::endian::little && GMP_NUMB_BITS == 64 && sizeof(mp_limb_t) == 8,
+        "mpz_serial needs 64 bit little endian limbs");
+
+static constexpr char vectorMagic[4] = {'M', 'P', 'Z', 'V'};
+static constexpr char archiveMagic[4] = {'M', 'P', 'Z', 'A'};
+static constexpr std::size_t archiveHeader = 16;
+//values encoded per task when writing vectors
+static constexpr std::size_t blockSize = 4096;
+//bytes of a value read at once, whole limbs
+static constexpr std::uint64_t readChunk = std::uint64_t{1} << 20;
+//GMP's limit, INT_MAX limbs
+static constexpr std::uint64_t maxValueBytes = std::uint64_t{INT_MAX} * sizeof(mp_limb_t);
+
+
+static void malformed(const char* what) {
+    throw std::invalid_argument(std::string("Mpz serialization: ") + what);
+}
+
+//|x| from n little endian bytes
+static void set_bytes(Mpz& x, const void* const bytes, const std::size_t n, const bool negative) {
+    if(n <= sizeof(mp_limb_t)) {
+        mp_limb_t m = 0;
+        std::memcpy(&m, bytes, n);
+        x = Mpz{m};
+    } else {
+        const mp_size_t limbs = (n + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t);
+        const mpz_ptr X = x.get_mpz_t();
+        mp_limb_t* const d = mpz_limbs_write(X, limbs);
+        d[limbs-1] = 0;
+        std::memcpy(d, bytes, n);
+        mpz_limbs_finish(X, limbs);
+    }
+    if(negative) {
+        x.negate();
+    }
+}
+
+
+
+//Varints
+static std::size_t varint_size(const std::uint64_t v) {
+    return std::max<std::size_t>((std::bit_width(v) + 6) / 7, 1);
+}
+
+static char* put_varint(std::uint64_t v, char* out) {
+    for(; v >= 0x80; v >>= 7) {
+        *out++ = static_cast<char>(v | 0x80);
+    }
+    *out++ = static_cast<char>(v);
+    return out;
+}
+
+static const char* get_varint(const char* first, const char* const last, std::uint64_t& v) {
+    v = 0;
+    for(unsigned int shift=0; shift<64; shift+=7) {
+        if(first == last) {
+            malformed("truncated varint");
+        }
+        const unsigned char c = *first++;
+        v |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+        if(!(c & 0x80)) {
+            return first;
+        }
+    }
+    malformed("varint too long");
+    return first;
+}
+
+static std::uint64_t get_varint(std::istream& is) {
+    std::uint64_t v = 0;
+    for(unsigned int shift=0; shift<64; shift+=7) {
+        const std::istream::int_type c = is.get();
+        if(c == std::istream::traits_type::eof()) {
+            malformed("truncated varint");
+        }
+        v |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+        if(!(c & 0x80)) {
+            return v;
+        }
+    }
+    malformed("varint too long");
+    return v;
+}
+
+
+
+//Single values
+//magnitude bytes without leading zeros
+static std::size_t magnitude_bytes(const Mpz& x) {
+    const mpz_srcptr X = x.get_mpz_t();
+    const std::size_t n = mpz_size(X);
+    return n ? (n-1)*sizeof(mp_limb_t) + (std::bit_width(mpz_getlimbn(X, n-1)) + 7) / 8 : 0;
+}
+
+std::size_t encoded_size(const Mpz& x) {
+    const std::size_t n = magnitude_bytes(x);
+    return varint_size(n << 1) + n;
+}
+
+char* encode(const Mpz& x, char* out) {
+    const std::size_t n = magnitude_bytes(x);
+    out = put_varint(n << 1 | (sgn(x) < 0), out);
+    if(n) {
+        std::memcpy(out, mpz_limbs_read(x.get_mpz_t()), n);
+    }
+    return out + n;
+}
+
+const char* decode(const char* first, const char* const last, Mpz& x) {
+    std::uint64_t header;
+    first = get_varint(first, last, header);
+    const std::uint64_t n = header >> 1;
+    if(n > static_cast<std::uint64_t>(last - first)) {
+        malformed("truncated value");
+    }
+    set_bytes(x, first, n, header & 1);
+    return first + n;
+}
+
+
+
+//Vectors
+void write_mpzs(std::ostream& os, const std::span<const Mpz> v, MpzExecutor& executor) {
+    char header[4 + 2*10];
+    std::memcpy(header, vectorMagic, 4);
+    char* end = put_varint(mpzSerialVersion, header + 4);
+    end = put_varint(v.size(), end);
+    os.write(header, end - header);
+
+    //a few blocks per thread at once, then they're written in order
+    const std::size_t blocks = (v.size() + blockSize - 1) / blockSize;
+    const std::size_t batch = 4 * (executor.size() + 1);
+    std::vector<std::string> encoded(std::min(blocks, batch));
+    for(std::size_t b=0; b<blocks; b+=batch) {
+        const std::size_t n = std::min(batch, blocks - b);
+        parallel_for(executor, n, [&](const std::size_t i) {
+            const std::span<const Mpz> block = v.subspan((b+i) * blockSize).first(
+                    std::min(blockSize, v.size() - (b+i) * blockSize));
+            std::size_t size = 0;
+            for(const Mpz& x : block) {
+                size += encoded_size(x);
+            }
+            std::string& s = encoded[i];
+            s.resize(size);
+            char* out = s.data();
+            for(const Mpz& x : block) {
+                out = encode(x, out);
+            }
+        });
+        for(std::size_t i=0; i<n; ++i) {
+            os.write(encoded[i].data(), static_cast<std::streamsize>(encoded[i].size()));
+        }
+    }
+}
+
+std::vector<Mpz> read_mpzs(std::istream& is) {
+    char magic[4];
+    if(!is.read(magic, 4) || std::memcmp(magic, vectorMagic, 4)) {
+        malformed("not an Mpz vector");
+    }
+    if(get_varint(is) != mpzSerialVersion) {
+        malformed("unsupported version");
+    }
+    const std::uint64_t count = get_varint(is);
+
+    std::vector<Mpz> v;
+    //the count isn't trusted with an allocation before the values are there
+    v.reserve(std::min<std::uint64_t>(count, 1 << 16));
+    for(std::uint64_t i=0; i<count; ++i) {
+        const std::uint64_t header = get_varint(is);
+        const std::uint64_t n = header >> 1;
+        Mpz& x = v.emplace_back();
+        if(n <= sizeof(mp_limb_t)) {
+            char bytes[sizeof(mp_limb_t)];
+            is.read(bytes, static_cast<std::streamsize>(n));
+            if(static_cast<std::uint64_t>(is.gcount()) != n) {
+                malformed("truncated value");
+            }
+            set_bytes(x, bytes, n, header & 1);
+        } else {
+            //read straight into the limbs, which grow with what actually
+            //arrived (at most doubling), so a bogus length fails on the data
+            if(n > maxValueBytes) {
+                malformed("value too large");
+            }
+            const mp_size_t limbs = (n + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t);
+            const mpz_ptr X = x.get_mpz_t();
+            mp_limb_t* d = nullptr;
+            mp_size_t capacity = 0;
+            for(std::uint64_t done=0; done<n;) {
+                const std::uint64_t step = std::min<std::uint64_t>(n - done, readChunk);
+                const mp_size_t needed = (done + step + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t);
+                if(needed > capacity) {
+                    capacity = std::min(limbs, std::max(needed, 2 * capacity));
+                    X->_mp_size = static_cast<int>(done / sizeof(mp_limb_t)); //kept by the reallocation
+                    d = mpz_limbs_modify(X, capacity);
+                }
+                d[needed-1] = 0; //a new limb, the chunks are whole limbs
+                is.read(reinterpret_cast<char*>(d) + done, static_cast<std::streamsize>(step));
+                if(static_cast<std::uint64_t>(is.gcount()) != step) {
+                    malformed("truncated value");
+                }
+                done += step;
+            }
+            mpz_limbs_finish(X, header & 1 ? -limbs : limbs);
+        }
+    }
+    return v;
+}
+
+
+
+//Archives
+void write_archive(const std::string& path, const std::span<const Mpz> v) {
+    std::ofstream os{path, std::ios::binary | std::ios::trunc};
+    if(!os) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    const auto put = [&os](const auto value) {
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    os.write(archiveMagic, 4);
+    put(mpzSerialVersion);
+    put(static_cast<std::uint64_t>(v.size()));
+    std::uint64_t offset = archiveHeader + (v.size() + 1) * sizeof(std::uint64_t);
+    for(const Mpz& x : v) {
+        put(offset);
+        offset += (1 + mpz_size(x.get_mpz_t())) * sizeof(std::uint64_t);
+    }
+    put(offset);
+    for(const Mpz& x : v) {
+        const mpz_srcptr X = x.get_mpz_t();
+        put(static_cast<std::int64_t>(X->_mp_size));
+        os.write(reinterpret_cast<const char*>(mpz_limbs_read(X)),
+                static_cast<std::streamsize>(mpz_size(X) * sizeof(mp_limb_t)));
+    }
+    os.flush();
+    if(!os) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+}
+
+
+MpzArchive::MpzArchive(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat st;
+    if(::fstat(fd, &st) < 0) {
+        const int e = errno;
+        ::close(fd);
+        throw std::system_error(e, std::generic_category(), path);
+    }
+    bytes = st.st_size;
+    if(bytes < archiveHeader) {
+        ::close(fd);
+        malformed("not an Mpz archive");
+    }
+    void* const map = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int e = errno;
+    ::close(fd);
+    if(map == MAP_FAILED) {
+        throw std::system_error(e, std::generic_category(), path);
+    }
+    ::madvise(map, bytes, MADV_RANDOM);
+    data = static_cast<const std::byte*>(map);
+
+    std::uint32_t version;
+    std::uint64_t n;
+    std::memcpy(&version, data + 4, sizeof(version));
+    std::memcpy(&n, data + 8, sizeof(n));
+    const char* what = std::memcmp(data, archiveMagic, 4) ? "not an Mpz archive"
+            : version != mpzSerialVersion ? "unsupported version"
+            : n >= (bytes - archiveHeader) / sizeof(std::uint64_t) ? "truncated offsets" : nullptr;
+    if(what) {
+        ::munmap(map, bytes);
+        data = nullptr;
+        malformed(what);
+    }
+    count = n;
+}
+
+MpzArchive::~MpzArchive() {
+    if(data) {
+        ::munmap(const_cast<std::byte*>(data), bytes);
+    }
+}
+
+MpzArchive::MpzArchive(MpzArchive&& other) noexcept
+        : data(std::exchange(other.data, nullptr)), bytes(std::exchange(other.bytes, 0)),
+        count(std::exchange(other.count, 0)) {}
+
+MpzArchive& MpzArchive::operator=(MpzArchive&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(bytes, other.bytes);
+    std::swap(count, other.count);
+    return *this;
+}
+
+
+std::size_t MpzArchive::size() const {
+    return count;
+}
+
+
+std::int64_t MpzArchive::record(const std::size_t i, const mp_limb_t*& limbs) const {
+    std::uint64_t offsets[2];
+    std::memcpy(offsets, data + archiveHeader + i*sizeof(std::uint64_t), sizeof(offsets));
+    const auto [begin, end] = offsets;
+    if(begin % sizeof(std::uint64_t) || begin < archiveHeader || end > bytes || end < begin + sizeof(std::int64_t)) {
+        malformed("corrupt offsets");
+    }
+    std::int64_t size;
+    std::memcpy(&size, data + begin, sizeof(size));
+    const std::uint64_t n = size < 0 ? -static_cast<std::uint64_t>(size) : size;
+    if(n != (end - begin) / sizeof(mp_limb_t) - 1 || (end - begin) % sizeof(mp_limb_t)) {
+        malformed("corrupt record");
+    }
+    limbs = reinterpret_cast<const mp_limb_t*>(data + begin + sizeof(std::int64_t));
+    return size;
+}
+
+Mpz MpzArchive::operator[](const std::size_t i) const {
+    const mp_limb_t* limbs;
+    const std::int64_t size = record(i, limbs);
+    const std::size_t n = size < 0 ? -size : size;
+    Mpz x;
+    if(n <= 1) {
+        x = Mpz{n ? *limbs : 0};
+    } else {
+        const mpz_ptr X = x.get_mpz_t();
+        std::copy_n(limbs, n, mpz_limbs_write(X, n));
+        mpz_limbs_finish(X, n);
+    }
+    if(size < 0) {
+        x.negate();
+    }
+    return x;
+}
+
+Mpz MpzArchive::at(const std::size_t i) const {
+    if(i >= count) {
+        throw std::out_of_range("MpzArchive: index out of range");
+    }
+    return (*this)[i];
+}
+
+std::span<const mp_limb_t> MpzArchive::limbs(const std::size_t i) const {
+    const mp_limb_t* limbs;
+    const std::int64_t size = record(i, limbs);
+    return {limbs, static_cast<std::size_t>(size < 0 ? -size : size)};
+}
+
+int MpzArchive::sign(const std::size_t i) const {
+    const mp_limb_t* limbs;
+    const std::int64_t size = record(i, limbs);
+    return (size > 0) - (size < 0);
+}
+
+MpzView MpzArchive::view(const std::size_t i) const {
+    const mp_limb_t* limbs;
+    const std::int64_t size = record(i, limbs);
+    return {{limbs, static_cast<std::size_t>(size < 0 ? -size : size)}, (size > 0) - (size < 0)};
+}
@@ -0,0 +1,99 @@
+#ifndef MPZ_SERIAL_H
+#define MPZ_SERIAL_H
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "mpz.h"
+#include "mpz_executor.h"
+#include "mpz_view.h"
+
+
+
+//Binary serialization
+//
+//Single values: a varint header (byte length of |x| << 1 | sign) followed
+//by the magnitude's bytes, little endian, without leading zero bytes.
+//0 is one byte, everything below 2^56 at most 8. The varint is LEB128 like,
+//7 bits per byte, lowest first.
+//
+//Vectors: "MPZV", varint version, varint count, then the values.
+//
+//Archives: a file for random access by memory mapping, little endian,
+//  "MPZA" u32 version u64 count
+//  u64 offsets[count+1]  byte offsets of the records, from the file start
+//  records               i64 signed limb count (like _mp_size), limbs
+//Everything is 8 byte aligned, so element i is found through offsets[i]
+//and its limbs can be used in place, nothing else has to be read.
+//
+//Limbs are taken with mpz_limbs_read/written with mpz_limbs_write.
+//https://gmplib.org/manual/Integer-Special-Functions
+//Malformed or truncated input throws std::invalid_argument.
+
+
+
+inline constexpr std::uint32_t mpzSerialVersion = 1;
+
+
+//Single values, encode() writes encoded_size(x) bytes and returns the end,
+//decode() returns the end of what it read
+[[nodiscard]] std::size_t encoded_size(const Mpz& x);
+char* encode(const Mpz& x, char* out);
+const char* decode(const char* first, const char* last, Mpz& x);
+
+
+//Vectors, values are encoded in parallel blocks on the executor
+void write_mpzs(std::ostream& os, std::span<const Mpz> v, MpzExecutor& executor=MpzExecutor::shared());
+[[nodiscard]] std::vector<Mpz> read_mpzs(std::istream& is);
+
+
+
+//Writes v as an archive, throws std::system_error if the file can't be written
+void write_archive(const std::string& path, std::span<const Mpz> v);
+
+
+//Read-only, memory mapped archive
+//
+//  const MpzArchive a{"primes.mpza"};
+//  Mpz p = a[1'000'000]; //touches the offsets & that record only
+//
+//Throws std::system_error if the file can't be mapped and
+//std::invalid_argument if the header isn't an archive of this version.
+//Records are checked when they're accessed.
+class MpzArchive {
+private:
+    const std::byte* data = nullptr;
+    std::size_t bytes = 0;
+    std::size_t count = 0;
+
+    [[nodiscard]] std::int64_t record(const std::size_t i, const mp_limb_t*& limbs) const;
+
+public:
+    explicit MpzArchive(const std::string& path);
+    ~MpzArchive();
+    MpzArchive(MpzArchive&& other) noexcept;
+    MpzArchive& operator=(MpzArchive&& other) noexcept;
+    MpzArchive(const MpzArchive&) = delete;
+    MpzArchive& operator=(const MpzArchive&) = delete;
+
+    [[nodiscard]] std::size_t size() const;
+
+    [[nodiscard]] Mpz operator[](const std::size_t i) const;
+    [[nodiscard]] Mpz at(const std::size_t i) const; //throws std::out_of_range
+    //The limbs of |a[i]| in the mapping, least significant first, and its sign
+    [[nodiscard]] std::span<const mp_limb_t> limbs(const std::size_t i) const;
+    [[nodiscard]] int sign(const std::size_t i) const;
+    //a[i] in place, valid as long as the archive
+    [[nodiscard]] MpzView view(const std::size_t i) const;
+};
+
+
+
+#endif //MPZ_SERIAL_H
@@ -0,0 +1,368 @@
+#include "mpz_special.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <numbers>
+#include <span>
+#include <vector>
+
+#include "mpz_mul.h"
+
+
+
+//below these GMP is faster even without the other threads
+static constexpr unsigned long facSerial = 1ul << 14;
+static constexpr unsigned long binSerial = 1ul << 16;
+static constexpr unsigned long fibSerial = 1ul << 17;
+//binomials with n beyond this many times k sieve more than they multiply
+static constexpr unsigned long binDensity = 256;
+//numbers sieved per task
+static constexpr unsigned long segmentLength = 1ul << 18;
+
+using u128 = unsigned __int128;
+
+
+
+//Products
+//x*y, split over the executor if big enough
+static Mpz mul(const Mpz& x, const Mpz& y, MpzExecutor& executor) {
+    if(std::min(mpz_size(x.get_mpz_t()), mpz_size(y.get_mpz_t())) >= MpzParallelMul::threshold()) {
+        return parallel_mul(x, y, executor);
+    }
+    return x * y;
+}
+
+//Product of words on this thread, first packed into limbs while they fit,
+//then by a balanced tree
+static Mpz tree(const std::span<const mp_limb_t> w) {
+    if(w.size() <= 4) {
+        Mpz r{1ul};
+        for(const mp_limb_t x : w) {
+            r *= static_cast<unsigned long>(x);
+        }
+        return r;
+    }
+    const std::size_t h = w.size() / 2;
+    return tree(w.first(h)) * tree(w.subspan(h));
+}
+
+static Mpz word_product(const std::span<const unsigned long> words) {
+    std::vector<mp_limb_t> limbs;
+    mp_limb_t limb = 1;
+    for(const unsigned long x : words) {
+        const u128 p = static_cast<u128>(limb) * x;
+        if(p >> 64) {
+            limbs.push_back(limb);
+            limb = x;
+        } else {
+            limb = static_cast<mp_limb_t>(p);
+        }
+    }
+    limbs.push_back(limb);
+    return tree(limbs);
+}
+
+//Balanced product tree, the products of each level in parallel
+static Mpz product(std::vector<Mpz> parts, MpzExecutor& executor) {
+    if(parts.empty()) {
+        return Mpz{1ul};
+    }
+    while(parts.size() > 1) {
+        std::vector<Mpz> next((parts.size() + 1) / 2);
+        parallel_for(executor, next.size(), [&](const std::size_t i) {
+            next[i] = 2*i + 1 < parts.size() ? mul(parts[2*i], parts[2*i + 1], executor) : std::move(parts[2*i]);
+        });
+        parts = std::move(next);
+    }
+    return std::move(parts.front());
+}
+
+
+
+//Prime products
+//Odd primes up to limit
+static std::vector<unsigned long> base_primes(const unsigned long limit) {
+    std::vector<bool> composite(limit / 2 + 1);
+    std::vector<unsigned long> primes;
+    for(unsigned long p=3; p<=limit; p+=2) {
+        if(!composite[p / 2]) {
+            primes.push_back(p);
+            for(unsigned long q=p*p; q<=limit; q+=2*p) {
+                composite[q / 2] = true;
+            }
+        }
+    }
+    return primes;
+}
+
+//Odd primes in [lo, hi) for odd lo >= 3, base has all up to sqrt(hi)
+static void sieve_segment(const unsigned long lo, const unsigned long hi, const std::vector<unsigned long>& base,
+        std::vector<unsigned long>& primes) {
+    std::vector<std::uint8_t> composite((hi - lo + 1) / 2); //lo + 2*i
+    for(const unsigned long p : base) {
+        if(p > (hi - 1) / p) {
+            break;
+        }
+        unsigned long m = std::max(p * p, (lo + p - 1) / p * p);
+        if(!(m & 1)) {
+            m += p;
+        }
+        for(; m<hi; m+=2*p) {
+            composite[(m - lo) / 2] = 1;
+        }
+    }
+    for(std::size_t i=0; i<composite.size(); ++i) {
+        if(!composite[i]) {
+            primes.push_back(lo + 2*i);
+        }
+    }
+}
+
+//Product of p^exponent(p) over the odd primes p <= limit
+static Mpz odd_prime_product(const unsigned long limit, const std::function<unsigned long(unsigned long)>& exponent,
+        MpzExecutor& executor) {
+    if(limit < 3) {
+        return Mpz{1ul};
+    }
+    const unsigned long root = static_cast<unsigned long>(std::sqrt(static_cast<double>(limit))) + 1;
+    const std::vector<unsigned long> base = base_primes(root);
+    const std::size_t segments = (limit - 3) / segmentLength + 1;
+    //per segment the products of the primes with bit b set in their exponent
+    std::vector<std::vector<Mpz>> bits(segments);
+    parallel_for(executor, segments, [&](const std::size_t s) {
+        const unsigned long lo = 3 + s * segmentLength, hi = lo + std::min(segmentLength, limit - lo + 1);
+        std::vector<unsigned long> primes;
+        sieve_segment(lo, hi, base, primes);
+        std::vector<std::vector<unsigned long>> factors;
+        for(const unsigned long p : primes) {
+            const unsigned long e = exponent(p);
+            if(static_cast<std::size_t>(std::bit_width(e)) > factors.size()) {
+                factors.resize(std::bit_width(e));
+            }
+            for(unsigned long b=0; e>>b; ++b) {
+                if((e >> b) & 1) {
+                    factors[b].push_back(p);
+                }
+            }
+        }
+        for(const std::vector<unsigned long>& f : factors) {
+            bits[s].push_back(word_product(f));
+        }
+    });
+
+    std::size_t width = 0;
+    for(const std::vector<Mpz>& b : bits) {
+        width = std::max(width, b.size());
+    }
+    std::vector<Mpz> columns(width);
+    MpzTaskGroup group{executor};
+    for(std::size_t b=0; b<width; ++b) {
+        group.run([&, b]() {
+            std::vector<Mpz> column;
+            for(std::vector<Mpz>& segment : bits) {
+                if(b < segment.size()) {
+                    column.push_back(std::move(segment[b]));
+                }
+            }
+            columns[b] = product(std::move(column), executor);
+        });
+    }
+    group.wait();
+    Mpz r{1ul};
+    for(std::size_t b=width; b-->0;) {
+        r = mul(mul(r, r, executor), columns[b], executor);
+    }
+    return r;
+}
+
+//Exponent of p in n!
+static unsigned long legendre(unsigned long n, const unsigned long p) {
+    unsigned long e = 0;
+    while(n) {
+        n /= p;
+        e += n;
+    }
+    return e;
+}
+
+
+
+//Entry points
+Mpz parallel_fac(const unsigned long n, MpzExecutor& executor) {
+    Mpz r;
+    if(n < facSerial) {
+        mpz_fac_ui(r.get_mpz_t(), n);
+        return r;
+    }
+    r = odd_prime_product(n, [n](const unsigned long p) { return legendre(n, p); }, executor);
+    mpz_mul_2exp(r.get_mpz_t(), r.get_mpz_t(), legendre(n, 2));
+    return r;
+}
+
+//n!! = 2^(n/2) * (n/2)! for even n, n! / (2^m * m!) with m = (n-1)/2 for
+//odd ones
+Mpz parallel_fac2(const unsigned long n, MpzExecutor& executor) {
+    if(n < 2*facSerial) {
+        Mpz r;
+        mpz_2fac_ui(r.get_mpz_t(), n);
+        return r;
+    }
+    if(!(n & 1)) {
+        Mpz r = parallel_fac(n / 2, executor);
+        mpz_mul_2exp(r.get_mpz_t(), r.get_mpz_t(), n / 2);
+        return r;
+    }
+    const unsigned long m = (n - 1) / 2;
+    return odd_prime_product(n, [n, m](const unsigned long p) { return legendre(n, p) - legendre(m, p); }, executor);
+}
+
+//Kummer: the exponent of p is the number of carries adding k & n-k in
+//base p, Legendre's formula gives the same
+Mpz parallel_bin(const unsigned long n, const unsigned long k, MpzExecutor& executor) {
+    Mpz r;
+    if(k > n) {
+        return r;
+    }
+    const unsigned long j = std::min(k, n - k);
+    if(j < binSerial || n / j > binDensity) {
+        mpz_bin_uiui(r.get_mpz_t(), n, k);
+        return r;
+    }
+    const auto exponent = [n, j](const unsigned long p) {
+        return legendre(n, p) - legendre(j, p) - legendre(n - j, p);
+    };
+    r = odd_prime_product(n, exponent, executor);
+    mpz_mul_2exp(r.get_mpz_t(), r.get_mpz_t(), exponent(2));
+    return r;
+}
+
+
+//By
+//  F(2k+1) = 4*F(k)^2 - F(k-1)^2 + 2*(-1)^k
+//  F(2k-1) = F(k)^2 + F(k-1)^2
+//  F(2k) = F(2k+1) - F(2k-1)
+void parallel_fib2(Mpz& f, Mpz& g, const unsigned long n, MpzExecutor& executor) {
+    if(n < fibSerial) {
+        mpz_fib2_ui(f.get_mpz_t(), g.get_mpz_t(), n);
+        return;
+    }
+    const unsigned long k = n / 2;
+    parallel_fib2(f, g, k, executor);
+    Mpz a, b;
+    MpzTaskGroup group{executor};
+    group.run([&]() {
+        a = mul(f, f, executor);
+    });
+    b = mul(g, g, executor);
+    group.wait();
+    //f = F(2k+1), g = F(2k-1)
+    mpz_mul_2exp(f.get_mpz_t(), a.get_mpz_t(), 2);
+    f -= b;
+    if(k & 1) {
+        f -= 2ul;
+    } else {
+        f += 2ul;
+    }
+    g = std::move(a);
+    g += b;
+    if(n & 1) {
+        //F(2k) = F(2k+1) - F(2k-1)
+        g = f - g;
+    } else {
+        f -= g;
+    }
+}
+
+//The last step needs only one product:
+//  F(2k) = F(k) * (F(k) + 2*F(k-1))
+//  F(2k+1) = (2*F(k) + F(k-1)) * (2*F(k) - F(k-1)) + 2*(-1)^k
+Mpz parallel_fib(const unsigned long n, MpzExecutor& executor) {
+    Mpz f, g;
+    if(n < fibSerial) {
+        mpz_fib_ui(f.get_mpz_t(), n);
+        return f;
+    }
+    const unsigned long k = n / 2;
+    parallel_fib2(f, g, k, executor);
+    g <<= 1;
+    if(!(n & 1)) {
+        g += f;
+        return mul(f, g, executor);
+    }
+    f <<= 1;
+    g >>= 1;
+    Mpz r = mul(f + g, f - g, executor);
+    if(k & 1) {
+        r -= 2ul;
+    } else {
+        r += 2ul;
+    }
+    return r;
+}
+
+
+
+//Routing
+static bool big_enough(const double bits) {
+    return bits >= static_cast<double>(GMP_NUMB_BITS) * static_cast<double>(MpzParallelMul::threshold());
+}
+
+//log2(n!) by Stirling (lgamma isn't thread safe)
+static double fac_bits(const unsigned long n) {
+    if(n < 2) {
+        return 0;
+    }
+    const double x = static_cast<double>(n);
+    return (x * std::log(x) - x + 0.5 * std::log(2 * std::numbers::pi * x)) / std::numbers::ln2;
+}
+
+void factorial(const mpz_ptr r, const unsigned long n) {
+    if(n >= facSerial && big_enough(fac_bits(n))) {
+        mpz_swap(r, parallel_fac(n).get_mpz_t());
+    } else {
+        mpz_fac_ui(r, n);
+    }
+}
+
+void double_factorial(const mpz_ptr r, const unsigned long n) {
+    if(n >= 2*facSerial && big_enough(fac_bits(n) / 2)) {
+        mpz_swap(r, parallel_fac2(n).get_mpz_t());
+    } else {
+        mpz_2fac_ui(r, n);
+    }
+}
+
+void binomial(const mpz_ptr r, const unsigned long n, const unsigned long k) {
+    if(k <= n && std::min(k, n - k) >= binSerial && big_enough(fac_bits(n) - fac_bits(k) - fac_bits(n - k))) {
+        mpz_swap(r, parallel_bin(n, k).get_mpz_t());
+    } else {
+        mpz_bin_uiui(r, n, k);
+    }
+}
+
+//log2(F(n))
+static double fib_bits(const unsigned long n) {
+    return 0.6942419136 * static_cast<double>(n);
+}
+
+void fibonacci(const mpz_ptr r, const unsigned long n) {
+    if(n >= fibSerial && big_enough(fib_bits(n))) {
+        mpz_swap(r, parallel_fib(n).get_mpz_t());
+    } else {
+        mpz_fib_ui(r, n);
+    }
+}
+
+void fibonacci2(const mpz_ptr f, const mpz_ptr g, const unsigned long n) {
+    if(n >= fibSerial && big_enough(fib_bits(n))) {
+        Mpz a, b;
+        parallel_fib2(a, b, n);
+        mpz_swap(f, a.get_mpz_t());
+        mpz_swap(g, b.get_mpz_t());
+    } else {
+        mpz_fib2_ui(f, g, n);
+    }
+}
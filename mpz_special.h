@@ -0,0 +1,51 @@
+#ifndef MPZ_SPECIAL_H
+#define MPZ_SPECIAL_H
+
+
+
+#include "mpz.h"
+#include "mpz_executor.h"
+
+
+
+//Parallel factorials, binomials & Fibonacci numbers
+//https://gmplib.org/manual/Factorial-Algorithm
+//https://gmplib.org/manual/Binomial-Coefficients-Algorithm
+//https://gmplib.org/manual/Fibonacci-Numbers-Algorithm
+//
+//GMP computes these on one core. Here:
+//- Factorials & binomials are products of prime powers, the exponents by
+//  Legendre's formula (for binomials the carries of Kummer's theorem). The
+//  primes are sieved in segments on separate tasks, each segment multiplies
+//  its primes up by exponent bit, the segments are combined by a parallel
+//  product tree and the bits by squaring (r = r^2 * P_b from the top bit).
+//  Powers of two are a final shift.
+//- Fibonacci numbers double F(k-1), F(k) to F(2k-1), F(2k) with the two
+//  squares F(k)^2 & F(k-1)^2 on separate tasks, from GMP's mpz_fib2_ui
+//  below ~2^17.
+//Products of huge numbers are split over the executor too (see mpz_mul.h).
+//
+//fac, fac2, bin & fib (mpz.h) go through factorial(), double_factorial(),
+//binomial() & fibonacci(), which take these with MpzExecutor::shared() for
+//results of at least MpzParallelMul::threshold() limbs.
+
+
+
+Mpz parallel_fac(const unsigned long n, MpzExecutor& executor=MpzExecutor::shared());
+Mpz parallel_fac2(const unsigned long n, MpzExecutor& executor=MpzExecutor::shared());
+Mpz parallel_bin(const unsigned long n, const unsigned long k, MpzExecutor& executor=MpzExecutor::shared());
+Mpz parallel_fib(const unsigned long n, MpzExecutor& executor=MpzExecutor::shared());
+//f = F(n), g = F(n-1) with F(-1) = 1, like mpz_fib2_ui
+void parallel_fib2(Mpz& f, Mpz& g, const unsigned long n, MpzExecutor& executor=MpzExecutor::shared());
+
+//r = n!, n!!, (n choose k), F(n) & F(n), F(n-1) by GMP, or by the above if
+//the result is big enough
+void factorial(mpz_ptr r, const unsigned long n);
+void double_factorial(mpz_ptr r, const unsigned long n);
+void binomial(mpz_ptr r, const unsigned long n, const unsigned long k);
+void fibonacci(mpz_ptr r, const unsigned long n);
+void fibonacci2(mpz_ptr f, mpz_ptr g, const unsigned long n);
+
+
+
+#endif //MPZ_SPECIAL_H
@@ -0,0 +1,166 @@
+#include "mpz_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <sstream>
+#include <gmp.h>
+
+
+
+#ifdef MPZ_INSTRUMENT
+//Per thread counters
+//Only the owning thread writes, so updates are a relaxed load & store
+//instead of a locked read-modify-write. Blocks are never freed, they stay
+//in the list with the totals of their thread after it exits.
+struct alignas(64) MpzAllocCounters {
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> reallocations{0};
+    std::atomic<std::uint64_t> frees{0};
+    std::atomic<std::uint64_t> bytesAllocated{0};
+    std::atomic<std::uint64_t> bytesFreed{0};
+    std::atomic<std::int64_t> liveBytes{0};
+    std::atomic<std::int64_t> peakLiveBytes{0};
+    std::array<std::atomic<std::uint64_t>, mpzStatsBuckets> reallocGrowth{};
+    MpzAllocCounters* next = nullptr;
+};
+
+static std::atomic<MpzAllocCounters*> head{nullptr};
+
+template<typename T>
+static void bump(std::atomic<T>& counter, const T n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static MpzAllocCounters& local() {
+    thread_local MpzAllocCounters* const counters = []() {
+        MpzAllocCounters* const c = new MpzAllocCounters;
+        c->next = head.load(std::memory_order_relaxed);
+        while(!head.compare_exchange_weak(c->next, c, std::memory_order_release, std::memory_order_relaxed)) {}
+        return c;
+    }();
+    return *counters;
+}
+
+static void add_live(MpzAllocCounters& c, const std::int64_t bytes) {
+    const std::int64_t live = c.liveBytes.load(std::memory_order_relaxed) + bytes;
+    c.liveBytes.store(live, std::memory_order_relaxed);
+    if(live > c.peakLiveBytes.load(std::memory_order_relaxed)) {
+        c.peakLiveBytes.store(live, std::memory_order_relaxed);
+    }
+}
+
+
+
+//Counting memory functions, forward to the ones found at install()
+static void* (*wrappedAlloc)(std::size_t) = nullptr;
+static void* (*wrappedRealloc)(void*, std::size_t, std::size_t) = nullptr;
+static void (*wrappedFree)(void*, std::size_t) = nullptr;
+
+static void* counting_alloc(const std::size_t size) {
+    MpzAllocCounters& c = local();
+    bump(c.allocations, std::uint64_t{1});
+    bump(c.bytesAllocated, std::uint64_t{size});
+    add_live(c, static_cast<std::int64_t>(size));
+    return wrappedAlloc(size);
+}
+
+static void* counting_realloc(void* ptr, const std::size_t oldSize, const std::size_t newSize) {
+    MpzAllocCounters& c = local();
+    bump(c.reallocations, std::uint64_t{1});
+    if(newSize > oldSize) {
+        bump(c.reallocGrowth[std::bit_width(newSize - oldSize)], std::uint64_t{1});
+        bump(c.bytesAllocated, std::uint64_t{newSize - oldSize});
+    } else {
+        bump(c.reallocGrowth[0], std::uint64_t{1});
+        bump(c.bytesFreed, std::uint64_t{oldSize - newSize});
+    }
+    add_live(c, static_cast<std::int64_t>(newSize) - static_cast<std::int64_t>(oldSize));
+    return wrappedRealloc(ptr, oldSize, newSize);
+}
+
+static void counting_free(void* ptr, const std::size_t size) {
+    MpzAllocCounters& c = local();
+    bump(c.frees, std::uint64_t{1});
+    bump(c.bytesFreed, std::uint64_t{size});
+    add_live(c, -static_cast<std::int64_t>(size));
+    wrappedFree(ptr, size);
+}
+#endif
+
+
+
+void MpzAllocStats::install() {
+#ifdef MPZ_INSTRUMENT
+    void* (*a)(std::size_t);
+    void* (*r)(void*, std::size_t, std::size_t);
+    void (*f)(void*, std::size_t);
+    mp_get_memory_functions(&a, &r, &f);
+    if(a == counting_alloc) {
+        return;
+    }
+    wrappedAlloc = a;
+    wrappedRealloc = r;
+    wrappedFree = f;
+    mp_set_memory_functions(counting_alloc, counting_realloc, counting_free);
+#endif
+}
+
+void MpzAllocStats::uninstall() {
+#ifdef MPZ_INSTRUMENT
+    void* (*a)(std::size_t);
+    mp_get_memory_functions(&a, nullptr, nullptr);
+    if(a == counting_alloc) {
+        mp_set_memory_functions(wrappedAlloc, wrappedRealloc, wrappedFree);
+    }
+#endif
+}
+
+
+MpzAllocSnapshot MpzAllocStats::snapshot() {
+    MpzAllocSnapshot s;
+#ifdef MPZ_INSTRUMENT
+    for(const MpzAllocCounters* c=head.load(std::memory_order_acquire); c; c=c->next) {
+        constexpr std::memory_order relaxed = std::memory_order_relaxed;
+        s.allocations += c->allocations.load(relaxed);
+        s.reallocations += c->reallocations.load(relaxed);
+        s.frees += c->frees.load(relaxed);
+        s.bytesAllocated += c->bytesAllocated.load(relaxed);
+        s.bytesFreed += c->bytesFreed.load(relaxed);
+        s.liveBytes += c->liveBytes.load(relaxed);
+        const std::int64_t peak = c->peakLiveBytes.load(relaxed);
+        s.peakLiveBytes = std::max(s.peakLiveBytes, static_cast<std::uint64_t>(peak));
+        ++s.peakLiveHistogram[std::bit_width(static_cast<std::uint64_t>(peak))];
+        for(std::size_t b=0; b<mpzStatsBuckets; ++b) {
+            s.reallocGrowth[b] += c->reallocGrowth[b].load(relaxed);
+        }
+        ++s.threads;
+    }
+    s.liveBlocks = static_cast<std::int64_t>(s.allocations) - static_cast<std::int64_t>(s.frees);
+#endif
+    return s;
+}
+
+
+
+static void write_histogram(std::ostream& os, const std::array<std::uint64_t, mpzStatsBuckets>& h) {
+    const auto last = std::find_if(h.rbegin(), h.rend(), [](const std::uint64_t n) { return n != 0; });
+    os << '[';
+    for(auto it=h.begin(); it!=last.base(); ++it) {
+        os << (it == h.begin() ? "" : ", ") << *it;
+    }
+    os << ']';
+}
+
+std::string MpzAllocSnapshot::to_json() const {
+    std::ostringstream os;
+    os << "{\"allocations\": " << allocations << ", \"reallocations\": " << reallocations << ", \"frees\": " << frees
+            << ", \"bytes_allocated\": " << bytesAllocated << ", \"bytes_freed\": " << bytesFreed
+            << ", \"live_blocks\": " << liveBlocks << ", \"live_bytes\": " << liveBytes << ", \"threads\": " << threads
+            << ", \"peak_live_bytes\": " << peakLiveBytes << ", \"peak_live_histogram\": ";
+    write_histogram(os, peakLiveHistogram);
+    os << ", \"realloc_growth\": ";
+    write_histogram(os, reallocGrowth);
+    os << '}';
+    return os.str();
+}
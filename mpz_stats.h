@@ -0,0 +1,72 @@
+#ifndef MPZ_STATS_H
+#define MPZ_STATS_H
+
+
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+
+//Allocation instrumentation
+//https://gmplib.org/manual/Custom-Allocation
+//
+//MpzAllocStats::install() wraps whatever GMP memory functions are current
+//(malloc or MpzPool) with counting ones. Every thread counts into its own
+//cache line with plain relaxed stores, no locks & no shared writes, and
+//snapshot() sums up all threads. Counters only grow, the difference of two
+//snapshots is the activity in between. Live bytes are kept per thread, so a
+//block freed on another thread than it was allocated on moves bytes from
+//one thread's count to the other's, their sum stays exact.
+//
+//Compiled in with MPZ_INSTRUMENT defined (CMake option, on by default),
+//without it install() does nothing and snapshots are all zero. Nothing is
+//counted before install() either, so the cost is zero until it's called.
+
+
+
+//Histograms have a bucket per bit width, bucket b counts values in
+//[2^(b-1), 2^b), bucket 0 the zeros
+inline constexpr std::size_t mpzStatsBuckets = 65;
+
+struct MpzAllocSnapshot {
+    std::uint64_t allocations = 0;
+    std::uint64_t reallocations = 0;
+    std::uint64_t frees = 0;
+    std::uint64_t bytesAllocated = 0; //incl. growth by reallocation
+    std::uint64_t bytesFreed = 0; //incl. shrinking by reallocation
+    std::int64_t liveBlocks = 0;
+    std::int64_t liveBytes = 0;
+    std::uint64_t threads = 0; //that ever allocated
+    std::uint64_t peakLiveBytes = 0; //highest of a single thread
+    //threads by their peak live bytes
+    std::array<std::uint64_t, mpzStatsBuckets> peakLiveHistogram{};
+    //reallocations by the bytes they grew by, shrinking ones in bucket 0
+    std::array<std::uint64_t, mpzStatsBuckets> reallocGrowth{};
+
+    //One JSON object, histograms without the trailing empty buckets
+    [[nodiscard]] std::string to_json() const;
+};
+
+
+class MpzAllocStats {
+public:
+#ifdef MPZ_INSTRUMENT
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    //Best before GMP allocates anything. Blocks from before are still freed
+    //by the wrapped functions, but count as negative live bytes.
+    static void install();
+    static void uninstall(); //back to the wrapped functions
+
+    [[nodiscard]] static MpzAllocSnapshot snapshot();
+};
+
+
+
+#endif //MPZ_STATS_H
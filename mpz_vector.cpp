@@ -0,0 +1,222 @@
+#include "mpz_vector.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+
+
+static std::size_t limb_count(const mp_size_t size) {
+    return size < 0 ? -size : size;
+}
+
+
+
+//Construction
+MpzVector::MpzVector(const std::span<const Mpz> v) {
+    append(v);
+}
+
+
+std::size_t MpzVector::size() const {
+    return slots.size();
+}
+
+bool MpzVector::empty() const {
+    return slots.empty();
+}
+
+std::span<const mp_limb_t> MpzVector::limbs() const {
+    return arena;
+}
+
+
+void MpzVector::reserve(const std::size_t count, const std::size_t limbs) {
+    slots.reserve(count);
+    arena.reserve(limbs);
+}
+
+void MpzVector::clear() {
+    slots.clear();
+    arena.clear();
+}
+
+void MpzVector::push_back(const Mpz& x) {
+    const mpz_srcptr X = x.get_mpz_t();
+    const std::size_t n = mpz_size(X);
+    const std::size_t end = arena.size();
+    //x may be a view into the arena that resize() moves
+    const mp_limb_t* d = X->_mp_d;
+    const bool inside = !std::less<>{}(d, arena.data()) && std::less<>{}(d, arena.data() + end);
+    const std::size_t from = inside ? d - arena.data() : 0;
+    arena.resize(end + n);
+    if(inside) {
+        d = arena.data() + from;
+    }
+    std::copy_n(d, n, arena.data() + end);
+    slots.push_back({end, X->_mp_size});
+}
+
+void MpzVector::append(const std::span<const Mpz> v) {
+    std::size_t n = arena.size();
+    for(const Mpz& x : v) {
+        n += mpz_size(x.get_mpz_t());
+    }
+    reserve(slots.size() + v.size(), n);
+    for(const Mpz& x : v) {
+        push_back(x);
+    }
+}
+
+//v may be *this
+void MpzVector::append(const MpzVector& v) {
+    const std::size_t base = arena.size(), limbs = v.arena.size(), n = v.slots.size();
+    arena.resize(base + limbs);
+    std::copy_n(v.arena.data(), limbs, arena.data() + base);
+    slots.reserve(slots.size() + n);
+    for(std::size_t i=0; i<n; ++i) {
+        slots.push_back({base + v.slots[i].offset, v.slots[i].size});
+    }
+}
+
+
+
+//Access
+mpz_srcptr MpzVector::element(const std::size_t i, const mpz_ptr x) const {
+    return mpz_roinit_n(x, arena.data() + slots[i].offset, slots[i].size);
+}
+
+MpzView MpzVector::operator[](const std::size_t i) const {
+    const Slot& s = slots[i];
+    return {{arena.data() + s.offset, limb_count(s.size)}, (s.size > 0) - (s.size < 0)};
+}
+
+MpzView MpzVector::at(const std::size_t i) const {
+    if(i >= slots.size()) {
+        throw std::out_of_range("MpzVector: index out of range");
+    }
+    return (*this)[i];
+}
+
+std::vector<Mpz> MpzVector::to_vector() const {
+    std::vector<Mpz> v;
+    v.reserve(slots.size());
+    for(std::size_t i=0; i<slots.size(); ++i) {
+        v.push_back(*(*this)[i]);
+    }
+    return v;
+}
+
+
+
+//Elementwise
+//Results go through one scratch integer, so nothing is allocated per
+//element. Results that don't grow overwrite the arena from the front,
+//the write position never passes the element being read.
+void MpzVector::transform(const std::function<void(mpz_ptr, mpz_srcptr, std::size_t)>& f, const bool shrinks) {
+    Mpz scratch;
+    const mpz_ptr s = scratch.get_mpz_t();
+    mpz_t x;
+    std::vector<mp_limb_t> next;
+    if(!shrinks) {
+        next.reserve(arena.size() + slots.size());
+    }
+    std::size_t w = 0;
+    for(std::size_t i=0; i<slots.size(); ++i) {
+        f(s, element(i, x), i);
+        const std::size_t n = mpz_size(s);
+        if(shrinks) {
+            std::copy_n(mpz_limbs_read(s), n, arena.data() + w);
+        } else {
+            next.insert(next.end(), mpz_limbs_read(s), mpz_limbs_read(s) + n);
+        }
+        slots[i] = {w, s->_mp_size};
+        w += n;
+    }
+    if(shrinks) {
+        arena.resize(w);
+    } else {
+        arena = std::move(next);
+    }
+}
+
+
+MpzVector& MpzVector::operator+=(const unsigned long k) {
+    transform([k](const mpz_ptr r, const mpz_srcptr x, std::size_t) {
+        mpz_add_ui(r, x, k);
+    }, false);
+    return *this;
+}
+
+MpzVector& MpzVector::operator+=(const Mpz& k) {
+    const mpz_srcptr K = k.get_mpz_t();
+    transform([K](const mpz_ptr r, const mpz_srcptr x, std::size_t) {
+        mpz_add(r, x, K);
+    }, false);
+    return *this;
+}
+
+MpzVector& MpzVector::operator+=(const MpzVector& other) {
+    if(other.size() != size()) {
+        throw std::invalid_argument("MpzVector: sizes differ");
+    }
+    //other's elements are read before the arena is replaced, so it may be *this
+    transform([&other](const mpz_ptr r, const mpz_srcptr x, const std::size_t i) {
+        mpz_t y;
+        mpz_add(r, x, other.element(i, y));
+    }, false);
+    return *this;
+}
+
+MpzVector& MpzVector::operator*=(const unsigned long k) {
+    transform([k](const mpz_ptr r, const mpz_srcptr x, std::size_t) {
+        mpz_mul_ui(r, x, k);
+    }, false);
+    return *this;
+}
+
+MpzVector& MpzVector::operator*=(const Mpz& k) {
+    const mpz_srcptr K = k.get_mpz_t();
+    transform([K](const mpz_ptr r, const mpz_srcptr x, std::size_t) {
+        mpz_mul(r, x, K);
+    }, false);
+    return *this;
+}
+
+MpzVector& MpzVector::operator%=(const unsigned long m) {
+    if(!m) {
+        throw std::invalid_argument("MpzVector: zero modulus");
+    }
+    transform([m](const mpz_ptr r, const mpz_srcptr x, std::size_t) {
+        mpz_tdiv_r_ui(r, x, m);
+    }, true);
+    return *this;
+}
+
+MpzVector& MpzVector::operator%=(const Mpz& m) {
+    if(!m) {
+        throw std::invalid_argument("MpzVector: zero modulus");
+    }
+    //copied, m may be an element that gets overwritten
+    const Mpz modulus = m;
+    const mpz_srcptr M = modulus.get_mpz_t();
+    transform([M](const mpz_ptr r, const mpz_srcptr x, std::size_t) {
+        mpz_tdiv_r(r, x, M);
+    }, true);
+    return *this;
+}
+
+
+bool operator==(const MpzVector& lhs, const MpzVector& rhs) {
+    if(lhs.size() != rhs.size()) {
+        return false;
+    }
+    for(std::size_t i=0; i<lhs.size(); ++i) {
+        const MpzVector::Slot a = lhs.slots[i], b = rhs.slots[i];
+        if(a.size != b.size || !std::equal(lhs.arena.begin() + a.offset, lhs.arena.begin() + a.offset + limb_count(a.size),
+                rhs.arena.begin() + b.offset)) {
+            return false;
+        }
+    }
+    return true;
+}
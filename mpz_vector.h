@@ -0,0 +1,79 @@
+#ifndef MPZ_VECTOR_H
+#define MPZ_VECTOR_H
+
+
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "mpz.h"
+#include "mpz_view.h"
+
+
+
+//Sequence of integers with all limbs in one arena
+//
+//  MpzVector v;
+//  v.append(numbers);
+//  v *= 3ul; v += k; v %= m; //one linear pass each
+//  MpzView x = v[i];
+//
+//Element i is the slot {offset, size}: |size| limbs at arena[offset], the
+//sign of size its sign (like _mp_size). Instead of one heap buffer per
+//element everything lies back to back, walking the vector walks memory in
+//order and appending doesn't allocate per element.
+//
+//Elements are handed out as MpzViews into the arena. Like iterators of a
+//std::vector they're invalidated by any change to the MpzVector.
+//Elementwise operations compute each element into one scratch integer and
+//write it back, results that don't grow are compacted in place.
+class MpzVector {
+private:
+    struct Slot {
+        std::size_t offset;
+        mp_size_t size;
+    };
+
+    std::vector<mp_limb_t> arena;
+    std::vector<Slot> slots;
+
+    [[nodiscard]] mpz_srcptr element(const std::size_t i, mpz_ptr x) const;
+    void transform(const std::function<void(mpz_ptr, mpz_srcptr, std::size_t)>& f, const bool shrinks);
+
+public:
+    MpzVector() = default;
+    explicit MpzVector(std::span<const Mpz> v);
+
+    [[nodiscard]] std::size_t size() const;
+    [[nodiscard]] bool empty() const;
+    //all limbs, in element order
+    [[nodiscard]] std::span<const mp_limb_t> limbs() const;
+
+    void reserve(const std::size_t count, const std::size_t limbs);
+    void clear();
+    void push_back(const Mpz& x);
+    void append(std::span<const Mpz> v);
+    void append(const MpzVector& v);
+
+    [[nodiscard]] MpzView operator[](const std::size_t i) const;
+    [[nodiscard]] MpzView at(const std::size_t i) const; //throws std::out_of_range
+    [[nodiscard]] std::vector<Mpz> to_vector() const;
+
+    //Elementwise, vectors have to be of the same size
+    MpzVector& operator+=(const unsigned long k);
+    MpzVector& operator+=(const Mpz& k);
+    MpzVector& operator+=(const MpzVector& other);
+    MpzVector& operator*=(const unsigned long k);
+    MpzVector& operator*=(const Mpz& k);
+    //Remainders like Mpz's %, sign of the element, m != 0
+    MpzVector& operator%=(const unsigned long m);
+    MpzVector& operator%=(const Mpz& m);
+
+    friend bool operator==(const MpzVector& lhs, const MpzVector& rhs);
+};
+
+
+
+#endif //MPZ_VECTOR_H
@@ -0,0 +1,58 @@
+#include "mpz_view.h"
+
+
+
+//mpz_roinit_n drops high zero limbs & leaves _mp_alloc at 0, single limbs
+//go inline so they look like any small Mpz
+void MpzView::borrow(const mp_limb_t* const limbs, const std::size_t n, const int sign) {
+    mpz_roinit_n(value.x, limbs, sign < 0 ? -static_cast<mp_size_t>(n) : static_cast<mp_size_t>(n));
+    const int size = value.x->_mp_size;
+    if(size >= -1 && size <= 1) {
+        value.init_small(size ? limbs[0] : 0, size);
+    }
+}
+
+
+MpzView::MpzView() = default;
+
+MpzView::MpzView(const std::span<const mp_limb_t> limbs, const int sign) {
+    borrow(limbs.data(), sign ? limbs.size() : 0, sign);
+}
+
+MpzView::MpzView(const Mpz& x) {
+    borrow(x.x->_mp_d, mpz_size(x.x), x.x->_mp_size);
+}
+
+MpzView::MpzView(const mpz_srcptr x) {
+    borrow(x->_mp_d, mpz_size(x), x->_mp_size);
+}
+
+//A small value points to its own limb, not to other's
+MpzView::MpzView(const MpzView& other) : MpzView(other.value) {}
+
+MpzView& MpzView::operator=(const MpzView& other) {
+    borrow(other.value.x->_mp_d, mpz_size(other.value.x), other.value.x->_mp_size);
+    return *this;
+}
+
+
+MpzView::operator const Mpz&() const {
+    return value;
+}
+
+const Mpz& MpzView::operator*() const {
+    return value;
+}
+
+const Mpz* MpzView::operator->() const {
+    return &value;
+}
+
+
+mpz_srcptr MpzView::get_mpz_t() const {
+    return value.x;
+}
+
+std::span<const mp_limb_t> MpzView::limbs() const {
+    return {value.x->_mp_d, mpz_size(value.x)};
+}
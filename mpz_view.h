@@ -0,0 +1,54 @@
+#ifndef MPZ_VIEW_H
+#define MPZ_VIEW_H
+
+
+
+#include <cstddef>
+#include <span>
+
+#include "mpz.h"
+
+
+
+//Read-only integer over limbs owned by someone else
+//https://gmplib.org/manual/Integer-Special-Functions (mpz_roinit_n)
+//
+//  MpzView v{archive.limbs(i), archive.sign(i)}; //no copy of the limbs
+//  Mpz g = gcd(v, n);
+//  std::string s = v->to_string(16);
+//
+//A view converts to const Mpz&, so it goes everywhere a const Mpz& does:
+//operators, comparisons, free functions. Members are reached through ->.
+//Copying into an Mpz copies the limbs, all else reads them in place.
+//
+//The limbs have to stay alive and unchanged as long as the view is used,
+//a view of an Mpz is invalidated by writing to that Mpz. Values below 2^64
+//are copied into the view itself.
+class MpzView {
+private:
+    Mpz value;
+
+    void borrow(const mp_limb_t* limbs, const std::size_t n, const int sign);
+
+public:
+    MpzView(); //0
+    //|x| = limbs, least significant first, high zero limbs are ignored
+    MpzView(std::span<const mp_limb_t> limbs, const int sign=1);
+    MpzView(const Mpz& x);
+    MpzView(const mpz_srcptr x);
+    MpzView(const MpzView& other);
+    MpzView& operator=(const MpzView& other);
+    MpzView(Mpz&&) = delete; //would dangle
+
+    operator const Mpz&() const;
+    const Mpz& operator*() const;
+    const Mpz* operator->() const;
+
+    [[nodiscard]] mpz_srcptr get_mpz_t() const;
+    //|x|, least significant first, empty for 0
+    [[nodiscard]] std::span<const mp_limb_t> limbs() const;
+};
+
+
+
+#endif //MPZ_VIEW_H